@@ -0,0 +1,23 @@
+# LLDPCTL_FOUND - System has liblldpctl
+# LLDPCTL_INCLUDE_DIRS - The liblldpctl include directories
+# LLDPCTL_LIBRARIES - The libraries needed to use liblldpctl
+
+find_package(PkgConfig QUIET)
+if(PKG_CONFIG_FOUND)
+    pkg_check_modules(PC_LLDPCTL QUIET lldpctl)
+endif()
+
+find_path(LLDPCTL_INCLUDE_DIR lldpctl.h
+        HINTS ${PC_LLDPCTL_INCLUDEDIR} ${PC_LLDPCTL_INCLUDE_DIRS})
+
+find_library(LLDPCTL_LIBRARY NAMES lldpctl
+        HINTS ${PC_LLDPCTL_LIBDIR} ${PC_LLDPCTL_LIBRARY_DIRS})
+
+set(LLDPCTL_LIBRARIES ${LLDPCTL_LIBRARY})
+set(LLDPCTL_INCLUDE_DIRS ${LLDPCTL_INCLUDE_DIR})
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LLDPCTL DEFAULT_MSG
+        LLDPCTL_LIBRARY LLDPCTL_INCLUDE_DIR)
+
+mark_as_advanced(LLDPCTL_INCLUDE_DIR LLDPCTL_LIBRARY)
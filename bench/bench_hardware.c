@@ -0,0 +1,103 @@
+/* Measures what save_hardware_chassis() spends on the hardware and software
+ * versions at startup: running `uname -m` and `lsb_release -d` as it did
+ * before, against reading sysfs, uname(2) and os-release in-process, both
+ * on first use and from the cache.  The sysrepo writes are the same either
+ * way and are left out.
+ *
+ * usage: bench_hardware [rounds] */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "os_info.h"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+/* Runs 'command' and returns whether it printed anything. */
+static int run_command(const char *command)
+{
+    char buffer[256];
+    int lines = 0;
+    FILE *fp;
+
+    fp = popen(command, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+        lines++;
+    }
+    return pclose(fp) == 0 && lines > 0;
+}
+
+static uint64_t run_popen(int *found)
+{
+    uint64_t start = now_ns();
+
+    *found = run_command("uname -m 2>/dev/null") +
+             run_command("lsb_release -d 2>/dev/null");
+    return now_ns() - start;
+}
+
+static uint64_t run_probe(int *found)
+{
+    uint64_t start;
+
+    os_info_destroy();
+    start = now_ns();
+    *found = (os_info_hardware_version() != NULL) +
+             (os_info_software_version() != NULL);
+    return now_ns() - start;
+}
+
+static uint64_t run_cached(int *found)
+{
+    uint64_t start = now_ns();
+
+    *found = (os_info_hardware_version() != NULL) +
+             (os_info_software_version() != NULL);
+    return now_ns() - start;
+}
+
+static void run(const char *label, int rounds, uint64_t (*fn)(int *))
+{
+    uint64_t total = 0;
+    int found = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        total += fn(&found);
+    }
+
+    printf("%-8s x %4d rounds: %12" PRIu64 " ns per round, %d of 2 versions found\n",
+           label, rounds, total / rounds, found);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds;
+
+    rounds = argc > 1 ? atoi(argv[1]) : 10;
+    if (rounds <= 0) {
+        fprintf(stderr, "rounds must be positive\n");
+        return 1;
+    }
+
+    run("popen", rounds, run_popen);
+    run("probe", rounds, run_probe);
+    run("cached", rounds, run_cached);
+
+    printf("hardware-rev: %s\nsoftware-rev: %s\n",
+           os_info_hardware_version() ? os_info_hardware_version() : "(none)",
+           os_info_software_version() ? os_info_software_version() : "(none)");
+    os_info_destroy();
+
+    return 0;
+}
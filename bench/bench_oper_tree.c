@@ -0,0 +1,125 @@
+/* Measures the cost of building the statistics of one interface in an
+ * operational tree, formatting an XPath per leaf against attaching the
+ * leaves to the list entry directly.
+ *
+ * usage: bench_oper_tree <yang search dir> [interfaces] [rounds]
+ *
+ * The search dir has to hold ietf-interfaces and its imports. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libyang/libyang.h>
+
+#include "dynamic-string.h"
+#include "oper_tree.h"
+
+static const char *counter_names[IF_COUNTER_MAX] = {
+    "in-octets", "in-unicast-pkts", "in-errors", "in-discards",
+    "out-octets", "out-unicast-pkts", "out-errors", "out-discards",
+};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+/* The way the providers built the tree before: one absolute path per leaf. */
+static void build_by_path(const struct ly_ctx *ctx, int count, struct lyd_node **tree)
+{
+    const char *format = "/ietf-interfaces:interfaces/interface[name='%s']/statistics/%s";
+    struct ds path = DS_EMPTY_INITIALIZER;
+    struct ds value = DS_EMPTY_INITIALIZER;
+    char name[16];
+
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "eth%d", i);
+
+        ds_clear(&path);
+        ds_put_format(&path, format, name, "discontinuity-time");
+        lyd_new_path(*tree, ctx, ds_cstr(&path), "2021-01-01T00:00:00+00:00", 0,
+                     *tree == NULL ? tree : NULL);
+
+        for (int j = 0; j < IF_COUNTER_MAX; j++) {
+            ds_clear(&path);
+            ds_put_format(&path, format, name, counter_names[j]);
+            ds_clear(&value);
+            ds_put_format(&value, "%d", i * j);
+            lyd_new_path(*tree, NULL, ds_cstr(&path), ds_cstr(&value), 0, NULL);
+        }
+    }
+
+    ds_destroy(&path);
+    ds_destroy(&value);
+}
+
+static void build_direct(const struct ly_ctx *ctx, int count, struct lyd_node **tree)
+{
+    struct lyd_node *intf;
+    uint64_t counters[IF_COUNTER_MAX];
+    char name[16];
+
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "eth%d", i);
+        for (int j = 0; j < IF_COUNTER_MAX; j++) {
+            counters[j] = i * j;
+        }
+
+        intf = oper_tree_interface(ctx, tree, name);
+        oper_tree_interface_statistics(intf, "2021-01-01T00:00:00+00:00", counters);
+    }
+}
+
+static void run(const char *label, const struct ly_ctx *ctx, int count, int rounds,
+                void (*build)(const struct ly_ctx *, int, struct lyd_node **))
+{
+    struct lyd_node *tree;
+    uint64_t start, total = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        tree = NULL;
+        start = now_ns();
+        build(ctx, count, &tree);
+        total += now_ns() - start;
+        lyd_free_all(tree);
+    }
+
+    printf("%-8s %6d interfaces x %4d rounds: %8" PRIu64 " ns per interface\n",
+           label, count, rounds, total / ((uint64_t)count * rounds));
+}
+
+int main(int argc, char **argv)
+{
+    struct ly_ctx *ctx = NULL;
+    int count, rounds;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <yang search dir> [interfaces] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    count = argc > 2 ? atoi(argv[2]) : 64;
+    rounds = argc > 3 ? atoi(argv[3]) : 100;
+    if (count <= 0 || rounds <= 0) {
+        fprintf(stderr, "interfaces and rounds must be positive\n");
+        return 1;
+    }
+
+    if (ly_ctx_new(argv[1], 0, &ctx) != LY_SUCCESS ||
+        ly_ctx_load_module(ctx, "ietf-interfaces", NULL, NULL) == NULL) {
+        fprintf(stderr, "Load ietf-interfaces from %s failed\n", argv[1]);
+        ly_ctx_destroy(ctx);
+        return 1;
+    }
+
+    run("path", ctx, count, rounds, build_by_path);
+    run("direct", ctx, count, rounds, build_direct);
+
+    ly_ctx_destroy(ctx);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/* Measures the VLAN set operations of a bridge port: building the member
+ * and untagged sets, testing membership, taking the tagged members as the
+ * difference of the two and compressing the result into ranges.  The
+ * append lists that br_vlan_t used before are measured for comparison.
+ *
+ * usage: bench_vlan_bitmap [vlans] [rounds] */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vlan-bitmap.h"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+/* Every third VLAN from 2 on is a member, every other member is untagged. */
+static int member_vid(int i)
+{
+    return 2 + 3 * i;
+}
+
+/* The lists br_vlan_t held before: IDs appended into the first free slot. */
+struct vlan_list {
+    uint32_t ids[VLAN_N_IDS];
+};
+
+static void list_append(struct vlan_list *list, uint32_t vid)
+{
+    for (int i = 0; i < VLAN_N_IDS; i++) {
+        if (list->ids[i] == 0) {
+            list->ids[i] = vid;
+            return;
+        }
+    }
+}
+
+static int list_contains(const struct vlan_list *list, uint32_t vid)
+{
+    for (int i = 0; i < VLAN_N_IDS && list->ids[i] != 0; i++) {
+        if (list->ids[i] == vid) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t run_list(int count, int *hits, int *ranges)
+{
+    static struct vlan_list members, untagged, tagged;
+    uint64_t start = now_ns();
+    int last = -2;
+
+    memset(&members, 0, sizeof(members));
+    memset(&untagged, 0, sizeof(untagged));
+    memset(&tagged, 0, sizeof(tagged));
+
+    for (int i = 0; i < count; i++) {
+        list_append(&members, member_vid(i));
+        if (i % 2) {
+            list_append(&untagged, member_vid(i));
+        }
+    }
+    *hits = 0;
+    for (int vid = 1; vid < VLAN_N_IDS; vid++) {
+        *hits += list_contains(&members, vid);
+    }
+    for (int i = 0; i < VLAN_N_IDS && members.ids[i] != 0; i++) {
+        if (!list_contains(&untagged, members.ids[i])) {
+            list_append(&tagged, members.ids[i]);
+        }
+    }
+
+    *ranges = 0;
+    for (int i = 0; i < VLAN_N_IDS && tagged.ids[i] != 0; i++) {
+        if ((int)tagged.ids[i] != last + 1) {
+            (*ranges)++;
+        }
+        last = tagged.ids[i];
+    }
+
+    return now_ns() - start;
+}
+
+static uint64_t run_bitmap(int count, int *hits, int *ranges)
+{
+    struct vlan_bitmap members, untagged, tagged;
+    uint64_t start = now_ns();
+    int first, last, vid;
+
+    vlan_bitmap_init(&members);
+    vlan_bitmap_init(&untagged);
+    for (int i = 0; i < count; i++) {
+        vlan_bitmap_set(&members, member_vid(i));
+        if (i % 2) {
+            vlan_bitmap_set(&untagged, member_vid(i));
+        }
+    }
+    *hits = 0;
+    for (vid = 1; vid < VLAN_N_IDS; vid++) {
+        *hits += vlan_bitmap_contains(&members, vid);
+    }
+    vlan_bitmap_and_not(&tagged, &members, &untagged);
+
+    *ranges = 0;
+    for (vid = 0; vlan_bitmap_next_range(&tagged, vid, &first, &last); vid = last + 1) {
+        (*ranges)++;
+    }
+
+    return now_ns() - start;
+}
+
+static void run(const char *label, int count, int rounds,
+                uint64_t (*fn)(int, int *, int *))
+{
+    uint64_t total = 0;
+    int hits = 0, ranges = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        total += fn(count, &hits, &ranges);
+    }
+
+    printf("%-8s %5d vlans x %5d rounds: %10" PRIu64 " ns per round, "
+           "%d members, %d tagged ranges\n",
+           label, count, rounds, total / rounds, hits, ranges);
+}
+
+int main(int argc, char **argv)
+{
+    int count, rounds;
+
+    count = argc > 1 ? atoi(argv[1]) : 1000;
+    rounds = argc > 2 ? atoi(argv[2]) : 100;
+    if (count <= 0 || member_vid(count - 1) >= VLAN_N_IDS || rounds <= 0) {
+        fprintf(stderr, "vlans must be from 1 to %d, rounds positive\n",
+                (VLAN_N_IDS - 2) / 3);
+        return 1;
+    }
+
+    run("list", count, rounds, run_list);
+    run("bitmap", count, rounds, run_bitmap);
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+/* Measures how the per-port collection scales over the worker pool: the
+ * MTU, flags and speed ioctls that collect_ips() and the ioctl fallback of
+ * the speed make per port, and a refresh of the driver statistics as the
+ * collector does it every period.
+ *
+ * It creates 'ports' dummy interfaces (bwN, needs CAP_NET_ADMIN and the
+ * dummy driver) and removes them at the end.  If they cannot be created it
+ * goes on with the loopback interface standing in for every port.
+ *
+ * usage: bench_workers [ports] [rounds] */
+
+#include <inttypes.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+
+#include "ethtool_stats.h"
+#include "sset.h"
+#include "worker_pool.h"
+
+static const unsigned int worker_counts[] = {0, 1, 2, 4};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static int create_dummies(struct nl_sock *sk, int ports)
+{
+    struct rtnl_link *link;
+    char name[IFNAMSIZ];
+    int rc = 0;
+
+    for (int i = 0; i < ports && rc == 0; i++) {
+        link = rtnl_link_alloc();
+        snprintf(name, sizeof(name), "bw%d", i);
+        rtnl_link_set_name(link, name);
+        rc = rtnl_link_set_type(link, "dummy");
+        if (rc == 0) {
+            rc = rtnl_link_add(sk, link, NLM_F_CREATE | NLM_F_EXCL);
+        }
+        rtnl_link_put(link);
+    }
+
+    return rc;
+}
+
+static void delete_dummies(struct nl_sock *sk, int ports)
+{
+    struct rtnl_link *link;
+    char name[IFNAMSIZ];
+
+    for (int i = 0; i < ports; i++) {
+        link = rtnl_link_alloc();
+        snprintf(name, sizeof(name), "bw%d", i);
+        rtnl_link_set_name(link, name);
+        rtnl_link_delete(sk, link);
+        rtnl_link_put(link);
+    }
+}
+
+/* What collection does for one port, each ioctl on a socket of its own as
+ * get_interface_mtu_and_flags() and get_interface_speed() do. */
+static void port_cb(size_t idx, void *aux)
+{
+    const char *name = ((const char **)aux)[idx];
+    struct ethtool_cmd edata = { .cmd = ETHTOOL_GSET };
+    struct ifreq ifr;
+    int sockfd;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, sizeof(ifr.ifr_name) - 1);
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd >= 0) {
+        ioctl(sockfd, SIOCGIFMTU, &ifr);
+        ioctl(sockfd, SIOCGIFFLAGS, &ifr);
+        close(sockfd);
+    }
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd >= 0) {
+        ifr.ifr_data = (void *)&edata;
+        ioctl(sockfd, SIOCETHTOOL, &ifr);
+        close(sockfd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct sset names = SSET_INITIALIZER(&names);
+    const char **ports_array;
+    struct nl_sock *sk;
+    uint64_t start, collect_ns, refresh_ns, base_ns = 0;
+    int ports, rounds;
+    bool dummies;
+    char name[IFNAMSIZ];
+
+    ports = argc > 1 ? atoi(argv[1]) : 256;
+    rounds = argc > 2 ? atoi(argv[2]) : 100;
+    if (ports <= 0 || rounds <= 0) {
+        fprintf(stderr, "ports and rounds must be positive\n");
+        return 1;
+    }
+
+    sk = nl_socket_alloc();
+    if (sk == NULL || nl_connect(sk, NETLINK_ROUTE) != 0) {
+        fprintf(stderr, "connect to rtnetlink failed\n");
+        return 1;
+    }
+
+    dummies = create_dummies(sk, ports) == 0;
+    if (!dummies) {
+        delete_dummies(sk, ports);
+        printf("no dummy interfaces, every port is lo\n");
+    }
+
+    ports_array = malloc(ports * sizeof(*ports_array));
+    for (int i = 0; i < ports; i++) {
+        snprintf(name, sizeof(name), "bw%d", i);
+        ports_array[i] = dummies ? strdup(name) : "lo";
+        sset_add(&names, ports_array[i]);
+    }
+
+    for (size_t w = 0; w < sizeof(worker_counts) / sizeof(worker_counts[0]); w++) {
+        if (worker_pool_init(worker_counts[w]) != 0) {
+            fprintf(stderr, "start %u workers failed\n", worker_counts[w]);
+            break;
+        }
+
+        start = now_ns();
+        for (int r = 0; r < rounds; r++) {
+            worker_pool_run(ports, port_cb, ports_array);
+        }
+        collect_ns = (now_ns() - start) / rounds;
+
+        start = now_ns();
+        for (int r = 0; r < rounds; r++) {
+            ethtool_stats_refresh(&names);
+        }
+        refresh_ns = (now_ns() - start) / rounds;
+
+        if (w == 0) {
+            base_ns = collect_ns;
+        }
+        printf("%u workers, %d ports: collect %10" PRIu64 " ns (x%.2f), "
+               "driver statistics refresh %10" PRIu64 " ns\n",
+               worker_counts[w], ports, collect_ns,
+               collect_ns ? (double)base_ns / collect_ns : 0, refresh_ns);
+
+        worker_pool_destroy();
+    }
+
+    ethtool_stats_destroy();
+    if (dummies) {
+        delete_dummies(sk, ports);
+        for (int i = 0; i < ports; i++) {
+            free((char *)ports_array[i]);
+        }
+    }
+    free(ports_array);
+    sset_destroy(&names);
+    nl_socket_free(sk);
+
+    return 0;
+}
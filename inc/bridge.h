@@ -1,27 +1,59 @@
+#include "hmap.h"
+#include "repo.h"
 #include "shash.h"
+#include "vlan-bitmap.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sysrepo.h>
 
-#define VLAN_BITMAP_MAX 4096
 #define NAME_LEN 32
 
 typedef struct br_vlan_s {
     uint16_t pvid;
-    uint32_t vlan_bitmap[VLAN_BITMAP_MAX];
-    uint32_t untagged_bitmap[VLAN_BITMAP_MAX];
+    struct vlan_bitmap vlans;       /* Member VLANs. */
+    struct vlan_bitmap untagged;    /* Members that egress untagged. */
 } br_vlan_t;
 
+/* The VLANs of a bridge or of a bridge port. */
+typedef struct br_port_vlan_s {
+    struct hmap_node node;          /* By ifindex. */
+    int ifindex;
+    int master;                     /* The bridge of a port, its own index
+                                     * for a bridge. */
+    char name[NAME_LEN];
+    br_vlan_t vlan;
+} br_port_vlan_t;
+
 typedef struct bridge_s {
     char name[NAME_LEN];
     unsigned int index;
     char hw_addr[24];
     char types[32];
+    bool vlan_filtering;            /* Else its entries have no VLAN. */
     br_vlan_t vlan;
+    struct hmap ports;              /* br_port_vlan_t of its ports. */
 } bridge_t;
 
-void get_bridge_vlan(const char *br_name, br_vlan_t *vlan);
+/* Fills 'ports' with the VLANs of every bridge and bridge port, from a single
+ * AF_BRIDGE link dump.  Returns 0 or a negative libnl error. */
+int dump_bridge_vlans(struct hmap *ports);
+br_port_vlan_t *find_bridge_vlans(const struct hmap *ports, int ifindex);
+void destroy_bridge_vlans(struct hmap *ports);
+
+/* Collects the bridges and the VLANs of their ports into 'bridges', which
+ * are freed with destroy_bridges(). */
 void collect_bridges(struct shash *bridges);
+void destroy_bridges(struct shash *bridges);
+
+/* The configuration of the bridges and the VLANs of their ports, on a batch
+ * editing the running and the operational datastore respectively. */
+void save_bridges_running(struct shash *bridges, write_batch_t *batch);
+void save_bridges_operational(struct shash *bridges, write_batch_t *batch);
 
-void save_bridges(struct shash *bridges, sr_session_ctx_t *session);
+/* The component of VLAN 'vid' of a bridge is named "vlanN"; the one of a
+ * VLAN-unaware bridge, whose entries the kernel reports in VLAN 0, is named
+ * after the bridge.  bridge_component_vid() returns -1 for other names. */
+void bridge_component_name(char *name, size_t size, const char *bridge, int vid);
+int bridge_component_vid(const char *component, const char *bridge);
 
@@ -0,0 +1,64 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H 1
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "list.h"
+
+/* A background thread that keeps the snapshots (snapshot.h) of data that
+ * changes without a notification current, so that no get waits for the
+ * kernel or lldpd: a provider only marks the data read and serializes the
+ * last snapshot.
+ *
+ * Each collector runs every period, but only while its data is read: after
+ * COLLECTOR_IDLE_MS without a get it stops, and the first get after that
+ * wakes it.  That get is still answered from the last snapshot.
+ *
+ * Data that comes with notifications (links, addresses, FDBs, MDBs and the
+ * neighbor table) is mirrored on the event loop instead. */
+
+#define COLLECTOR_IDLE_MS 60000
+
+struct collector {
+    const char *name;               /* For the log. */
+
+    /* Collects and publishes a snapshot.  Returns 0, or -1 if the previous
+     * snapshot stays. */
+    int (*collect)(void *aux);
+    void *aux;
+
+    unsigned int period_ms;
+
+    _Atomic uint64_t read_us;       /* get_monotonic_us() of the last get. */
+    _Atomic uint64_t collected_us;  /* Of the last collection, 0 if none. */
+    uint64_t next_us;               /* Of the next one, for the thread. */
+
+    _Atomic uint64_t n_reads;
+    _Atomic uint64_t n_fresh;       /* Within two periods of a collection. */
+
+    struct list_node node;
+};
+
+#define COLLECTOR_INITIALIZER(NAME, COLLECT, PERIOD_MS) \
+    { NAME, COLLECT, NULL, PERIOD_MS, 0, 0, 0, 0, 0, { NULL, NULL } }
+
+/* Sets the period in milliseconds, at least 1.  Call it before
+ * collector_add(). */
+void collector_set_period(struct collector *collector, unsigned int period_ms);
+
+/* Collects 'collector' with 'aux' once, so the first get finds a snapshot,
+ * and adds it to the thread.  Call it before collector_start(). */
+void collector_add(struct collector *collector, void *aux);
+
+int collector_start();
+
+/* Stops the thread and logs how many gets found a fresh snapshot. */
+void collector_stop();
+
+/* Marks the data of 'collector' read, waking the thread if it is idle.
+ * Never blocks on a collection. */
+void collector_read(struct collector *collector);
+
+#endif /* collector.h */
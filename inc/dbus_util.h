@@ -1,6 +1,12 @@
 #ifndef DBUS_UTIL_H
 #define DBUS_UTIL_H 
 
-void dbus_query(char* param);
+/* Connects to the system bus; the connection is then served by the event
+ * loop, which must be initialized. */
+int dbus_util_init();
+void dbus_util_destroy();
+
+/* Sends the call and returns, the reply is read on the event loop. */
+void dbus_query(const char* param);
 
 #endif /* #ifndef DBUS_UTIL_H */
@@ -0,0 +1,40 @@
+#ifndef ETHTOOL_H
+#define ETHTOOL_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Link settings from the kernel's ethtool generic netlink family.  One dump
+ * returns the settings of every port, and changes made through ethtool are
+ * announced on the family's monitor group.  Kernels before 5.6 do not have
+ * the family; ethtool_init() fails there and callers fall back to the
+ * SIOCETHTOOL ioctl. */
+
+struct ethtool_link {
+    uint32_t speed;  /* Mb/s, SPEED_UNKNOWN if there is no link. */
+    uint8_t  duplex; /* DUPLEX_* */
+};
+
+typedef void (*ethtool_link_cb)(const char *name, const struct ethtool_link *link,
+                                void *aux);
+
+int ethtool_init();
+void ethtool_destroy();
+bool ethtool_available();
+
+/* Calls 'cb' for every port, from a single ETHTOOL_MSG_LINKMODES_GET dump. */
+int ethtool_dump_links(ethtool_link_cb cb, void *aux);
+int ethtool_get_link(const char *name, struct ethtool_link *link);
+
+/* Called for a change of the channels or the private flags of port 'name',
+ * which can change the set of its driver statistics. */
+typedef void (*ethtool_change_cb)(const char *name, void *aux);
+
+/* File descriptor of the monitor group socket, and the handler to call when
+ * it becomes readable; 'cb' is called for every ETHTOOL_MSG_LINKMODES_NTF,
+ * 'changed' for every ETHTOOL_MSG_CHANNELS_NTF and _PRIVFLAGS_NTF.  Returns
+ * a negative libnl error code if notifications were lost (-NLE_NOMEM). */
+int ethtool_monitor_fd();
+int ethtool_monitor_process(ethtool_link_cb cb, ethtool_change_cb changed, void *aux);
+
+#endif /* ethtool.h */
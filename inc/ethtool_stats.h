@@ -0,0 +1,51 @@
+#ifndef ETHTOOL_STATS_H
+#define ETHTOOL_STATS_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sset.h"
+
+/* Driver statistics of a port (ETH_SS_STATS), such as the per-queue and
+ * per-traffic-class counters.  The names and the count of a port's counters
+ * are read once and cached; a dump only fetches the values with
+ * ETHTOOL_GSTATS on a shared socket into a reused buffer, and a snapshot
+ * shares the cached names. */
+
+typedef void (*ethtool_stat_cb)(const char *name, uint64_t value, void *aux);
+
+/* Calls 'cb' for every driver counter of 'port'.  Returns 0 on success, or
+ * a negative errno value. */
+int ethtool_stats_foreach(const char *port, ethtool_stat_cb cb, void *aux);
+
+#define ETHTOOL_STATS_DEFAULT_PERIOD_MS 50
+
+void ethtool_stats_set_period(unsigned int period_ms);
+
+/* Dumps the driver counters of every port in 'ports' and publishes them as
+ * one snapshot (snapshot.h). */
+void ethtool_stats_refresh(const struct sset *ports);
+
+/* Refreshes the snapshot of 'ports' once and hands it to the collector
+ * (collector.h), which refreshes it every period while it is read. */
+void ethtool_stats_collect(const struct sset *ports);
+
+/* Marks the snapshot read, once per get. */
+void ethtool_stats_note_read();
+
+/* Calls 'cb' for every counter of 'port' in the current snapshot, without
+ * asking the driver.  Returns false if the snapshot has none for 'port'.
+ * Call it in a snapshot read section. */
+bool ethtool_stats_snapshot_foreach(const char *port, ethtool_stat_cb cb, void *aux);
+
+/* With 'notified', the count of a port's counters is only asked for again
+ * after ethtool_stats_counters_changed(); otherwise before every dump. */
+void ethtool_stats_set_notified(bool notified);
+
+/* Called when the counters of a port may have changed: its channels or
+ * private flags changed, it was removed, or notifications were lost. */
+void ethtool_stats_counters_changed();
+
+void ethtool_stats_destroy();
+
+#endif /* ethtool_stats.h */
@@ -0,0 +1,33 @@
+#ifndef FDB_H
+#define FDB_H 1
+
+#include <stddef.h>
+#include <sysrepo.h>
+
+/* A mirror of the forwarding databases of the kernel bridges.  It is filled
+ * from one AF_BRIDGE neighbor dump and then kept current from RTNLGRP_NEIGH
+ * notifications, so gets are served from memory without asking the kernel.
+ *
+ * The notifications are read on the event loop (reactor.h), which the
+ * monitor (monitor.h) registers fdb_get_fd() with: call fdb_process() when
+ * it becomes readable. */
+
+int fdb_init();
+void fdb_destroy();
+
+int fdb_get_fd();
+void fdb_process();
+
+size_t fdb_count();
+
+/* Provides /ieee802-dot1q-bridge:bridges/bridge/component/filtering-database
+ * from the mirror.  The entries of a VLAN-aware bridge are in the component
+ * of their VLAN, "vlanN"; those of a VLAN-unaware bridge have no VLAN and are
+ * in the component named after the bridge.  save_bridges_running() creates
+ * both kinds, sysrepo only asks for the filtering-database of components
+ * that exist. */
+void bridge_filtering_database_provider(sr_session_ctx_t *session,
+                                        const char *request_xpath,
+                                        struct lyd_node **parent);
+
+#endif /* fdb.h */
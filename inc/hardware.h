@@ -3,6 +3,9 @@
 
 #include <sysrepo.h>
 
-void save_hardware_chassis(sr_session_ctx_t *session);
+#include "repo.h"
+
+/* The chassis class in running, its versions and maker in operational. */
+void save_hardware_chassis(write_batch_t *batch);
 
 #endif /* hardware.h */
\ No newline at end of file
@@ -5,23 +5,13 @@
 #include <netinet/in.h>
 #include <sysrepo.h>
 
+#include "hmap.h"
 #include "list.h"
+#include "repo.h"
 #include "shash.h"
 #include "svec.h"
 #include "sset.h"
 
-struct interface {
-    char        *name;
-    int          index;
-    char         hw_addr[24];
-    unsigned int flags; /* Flags from SIOCGIFFLAGS see netdevice(7) */
-    char        *type;
-    uint64_t     speed;
-    int          vlan_id;
-    int          pvid;
-    char        *master_name;
-};
-
 struct address {
     struct list_node node;
     bool             is_ipv4;
@@ -37,22 +27,65 @@ struct ip {
     struct list_node addresses;
 };
 
+/* The state of an interface as it was last written to sysrepo.  Updates are
+ * compared against it, so only the leaves that changed are set or deleted. */
+struct interface_snapshot {
+    bool         valid;      /* Speed and oper_state have been published. */
+    uint64_t     speed;
+    uint8_t      oper_state; /* IF_OPER_* */
+    unsigned int flags;
+    struct ip   *ip;         /* MTU and addresses, NULL until published. */
+};
+
+struct interface {
+    char        *name;
+    int          index;
+    struct hmap_node index_node;    /* In the monitor's index by 'index'. */
+    char         hw_addr[24];
+    unsigned int flags; /* Flags from SIOCGIFFLAGS see netdevice(7) */
+    char        *type;
+    uint64_t     speed;
+    int          vlan_id;
+    int          pvid;
+    char        *master_name;
+    struct interface_snapshot published;
+};
+
 struct interface *interface_create();
 void interface_destroy(struct interface *intf);
 
 void collect_interfaces(struct shash *interfaces);
-void save_interface_running(struct interface *intf, sr_session_ctx_t *session);
+void save_interface_running(struct interface *intf, write_batch_t *batch);
 void save_interface_operational(struct interface *interface,
-        sr_session_ctx_t *session);
+        write_batch_t *batch);
 
 bool collect_ips(struct shash *interfaces, struct shash *ips);
-void save_ips(struct shash *ips, sr_session_ctx_t *session);
-void update_ips(struct shash *interfaces, sr_session_ctx_t *session);
+void save_ips(struct interface *intf, struct ip *ip, write_batch_t *batch);
+/* Collects the addresses of 'interfaces' and saves what changed on 'batch'. */
+void save_interfaces_ips(struct shash *interfaces, write_batch_t *batch);
+/* The updates only queue their edits on 'queue', the writer thread applies
+ * them, so the event loop never waits for sysrepo. */
+void update_ips(struct shash *interfaces, oper_actions_t *queue);
+
+void update_interfaces_speed(struct shash *interfaces, oper_actions_t *queue);
 
-void update_interfaces_speed(struct shash *interfaces, sr_session_ctx_t *session);
+void update_interface_link(struct interface *intf, unsigned int flags,
+                           uint8_t oper_state, int mtu, oper_actions_t *queue);
+void update_interface_speed(struct interface *intf, uint32_t speed,
+                            oper_actions_t *queue);
+void update_interface_address(struct interface *intf, bool is_ipv4,
+                              const char *addr, uint8_t prefix, bool deleted,
+                              oper_actions_t *queue);
 
-void interface_statistics_provider(sr_session_ctx_t *session, struct lyd_node **parent);
-void interface_oper_status_provider(sr_session_ctx_t *session, struct lyd_node **parent);
+void interface_statistics_provider(sr_session_ctx_t *session, const char *request_xpath,
+                                   struct lyd_node **parent);
+void interface_driver_statistics_provider(sr_session_ctx_t *session,
+                                          const char *request_xpath,
+                                          struct lyd_node **parent);
+void interface_rates_provider(sr_session_ctx_t *session, const char *request_xpath,
+                              struct lyd_node **parent);
+void interface_oper_status_provider(sr_session_ctx_t *session, const char *request_xpath,
+                                    struct lyd_node **parent);
 
 struct sset *get_interface_names();
 void destroy_interface_names();
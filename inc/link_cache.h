@@ -0,0 +1,34 @@
+#ifndef LINK_CACHE_H
+#define LINK_CACHE_H 1
+
+#include <netlink/cache.h>
+#include <netlink/route/link.h>
+
+/* One process-wide rtnl link cache, kept current by an nl_cache_mngr from
+ * RTNLGRP_LINK notifications and shared by every collector and provider.
+ *
+ * The cache is not thread safe on its own: hold link_cache_lock() for as long
+ * as the cache or any link taken from it is used. */
+int link_cache_init();
+void link_cache_destroy();
+
+void link_cache_lock();
+void link_cache_unlock();
+struct nl_cache *link_cache_get();
+
+/* File descriptor of the manager's notification socket, and the handler to
+ * call when it becomes readable. */
+int link_cache_get_fd();
+void link_cache_process();
+
+/* Link attributes that change without a notification, the counters in
+ * particular, are not current in the cache.  This queries a single link by
+ * name from the kernel on the shared request socket.  The caller owns the
+ * returned reference. */
+struct rtnl_link *link_cache_query(const char *name);
+
+/* Dumps every link from the kernel on the same socket into a new cache that
+ * the caller frees with nl_cache_free(). */
+struct nl_cache *link_cache_dump();
+
+#endif /* link_cache.h */
@@ -8,8 +8,6 @@
 #include "list.h"
 #include "svec.h"
 
-#include "libxml/parser.h"
-
 struct capability {
     struct list_node node;
     char *type;
@@ -87,42 +85,37 @@ typedef struct lldp_node_s {
 } lldp_node_t;
 
 struct capability *capability_init();
-struct capability *get_capability_from_node(xmlNodePtr node);
 void capability_destroy(struct capability *capability);
 
 struct chassis *chassis_init();
-struct chassis *get_chassis_from_node(xmlNodePtr node);
 void chassis_destroy(struct chassis *);
 
 struct advertised *advertised_init();
-struct advertised *get_advertised_from_node(xmlNodePtr node);
 void advertised_destroy(struct advertised *);
 
 struct negotiation *negotiation_init();
-struct negotiation *get_negotiation_from_node(xmlNodePtr node);
 void negotiation_destroy(struct negotiation *);
 
 struct port *port_init();
-struct port *get_port_from_node(xmlNodePtr node);
 void port_destroy(struct port *);
 
 struct vlan *vlan_init();
-struct vlan *get_vlan_from_node(xmlNodePtr node);
 void vlan_destroy(struct vlan *);
 
 struct ppvid *ppvid_init();
-struct ppvid *get_ppvid_from_node(xmlNodePtr node);
 void ppvid_destroy(struct ppvid *);
 
 lldp_t *lldp_init();
-lldp_t *get_lldp_from_node(xmlNodePtr node);
 void lldp_destroy(lldp_t *);
 
-char *get_node_content_str(xmlNodePtr node);
-char *get_node_prop_str(xmlNodePtr node, const char *attrib_name);
-void get_node_prop_bool(xmlNodePtr node, const char *attrib_name, bool *value);
-void get_node_prop_enabled(xmlNodePtr node, const char *attrib_name, bool *value);
-
-void lldp_port_provider(sr_session_ctx_t *session, struct lyd_node **parent);
+/* lldpd is always asked for the neighbors of every port; a request for one
+ * port only filters them while the tree is built. */
+void lldp_port_provider(sr_session_ctx_t *session, const char *request_xpath,
+                        struct lyd_node **parent);
+/* Asks lldpd for the neighbors once and hands them to the collector
+ * (collector.h), which asks again every second while lldp_port_provider()
+ * reads them because the neighbor table (lldp_table.h) is not in sync. */
+void lldp_neighbors_collect();
+void lldp_provider_destroy();
 
 #endif /* LLDP_H */
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef LLDP_CTL_H
+#define LLDP_CTL_H 1
+
+#include <stdbool.h>
+
+#include "list.h"
+
+/* Talks to lldpd in process over its control socket with liblldpctl,
+ * instead of running lldpcli and parsing its XML output.  Only built if
+ * liblldpctl is found (HAVE_LLDPCTL). */
+
+/* Uses lldpd's control socket at 'path' instead of the default one, e.g. to
+ * talk to a locally started "lldpd -u path". */
+void lldp_ctl_set_socket(const char *path);
+
+/* Appends the neighbors of every port to 'neighbors' as lldp_t records.
+ * Returns false, with 'neighbors' left untouched, if lldpd could not be
+ * queried. */
+bool lldp_ctl_collect_neighbors(struct list_node *neighbors);
+
+/* Returns a copy of the local chassis ID if it is a MAC address, or NULL. */
+char *lldp_ctl_get_chassis_id();
+
+/* Keeps the neighbor table (lldp_table.h) current from lldpd's neighbor
+ * change notifications on a thread of its own. */
+int lldp_ctl_watch_start();
+void lldp_ctl_watch_stop();
+
+void lldp_ctl_destroy();
+
+#endif /* lldp_ctl.h */
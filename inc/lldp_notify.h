@@ -0,0 +1,45 @@
+#ifndef LLDP_NOTIFY_H
+#define LLDP_NOTIFY_H 1
+
+#include <sysrepo.h>
+
+/* Changes of the LLDP neighbor table are counted into the remote-statistics
+ * of ieee802-dot1ab-lldp and sent as the tsn-lldp-notifications
+ * remote-table-change notification.
+ *
+ * Changes are not sent one by one.  The first change of a burst opens a
+ * window, and everything that changed until the window closes goes out in a
+ * single notification that holds the counts of the window and the net change
+ * of every neighbor, so that a flapping link does not flood the listeners. */
+
+#define LLDP_NOTIFY_DEFAULT_WINDOW_MS 1000
+
+/* Number of neighbors one notification lists at most; the changes of any
+ * further neighbor are only counted. */
+#define LLDP_NOTIFY_MAX_CHANGES 1024
+
+enum lldp_change {
+    LLDP_CHANGE_INSERTED,
+    LLDP_CHANGE_UPDATED,
+    LLDP_CHANGE_DELETED,
+    LLDP_CHANGE_AGED_OUT,
+};
+
+/* Sets the coalescing window, 0 sends what changed as soon as possible.
+ * Takes effect on the next lldp_notify_start(). */
+void lldp_notify_set_window(unsigned int window_ms);
+
+/* The window is a timer of the event loop, which must be initialized. */
+int lldp_notify_start(sr_conn_ctx_t *connection);
+void lldp_notify_stop();
+
+/* Records a change of the neighbor with the key (port, chassis_id, rid).
+ * Never waits for sysrepo, so it may be called with the table locked.
+ * Before lldp_notify_start() the change is only counted. */
+void lldp_notify_change(const char *port, const char *chassis_id, const char *rid,
+                        enum lldp_change change);
+
+void lldp_remote_statistics_provider(sr_session_ctx_t *session, const char *request_xpath,
+                                     struct lyd_node **parent);
+
+#endif /* lldp_notify.h */
@@ -0,0 +1,47 @@
+#ifndef LLDP_TABLE_H
+#define LLDP_TABLE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "list.h"
+#include "lldp.h"
+
+/* The LLDP neighbors of all local ports, kept current from lldpd's change
+ * notifications and keyed by (local port, remote chassis ID, remote index).
+ * Every change bumps a generation counter, so readers can tell whether the
+ * neighbors changed since they last looked.
+ *
+ * The table is only used once it was synchronized with lldpd; while it is
+ * not, e.g. before the first sync or after the connection to lldpd was
+ * lost, readers have to ask lldpd themselves.
+ *
+ * Every insert, update and removal is passed on to lldp_notify_change().  A
+ * sync after the connection was lost reports the difference to the records
+ * the table held before, which are kept until then. */
+
+/* Replaces the whole table with the records in 'neighbors', which are taken
+ * over, and marks it synchronized. */
+void lldp_table_reset(struct list_node *neighbors);
+void lldp_table_invalidate();
+
+/* Adds 'lldp', or replaces the record with the same key; takes it over. */
+void lldp_table_set(lldp_t *lldp);
+/* Removes the record with the key.  'ttl' is the TTL lldpd last received
+ * from the neighbor, 0 after a shutdown LLDPDU, or -1 if it is not known
+ * and the one of the record is taken. */
+void lldp_table_remove(const char *port, const char *chassis_id, const char *rid,
+                       int ttl);
+
+/* Read locks the table and stores its generation into '*generation'.
+ * Returns false, without a lock held, if the table is not synchronized. */
+bool lldp_table_read_lock(uint64_t *generation);
+void lldp_table_unlock();
+
+/* Calls 'cb' for the neighbors of 'port', or of every port if it is NULL.
+ * The read lock has to be held. */
+void lldp_table_foreach(const char *port, void (*cb)(const lldp_t *, void *), void *aux);
+
+void lldp_table_destroy();
+
+#endif /* lldp_table.h */
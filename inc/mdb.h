@@ -0,0 +1,30 @@
+#ifndef MDB_H
+#define MDB_H 1
+
+#include <stddef.h>
+#include <sysrepo.h>
+
+/* A mirror of the multicast databases of the kernel bridges: the groups that
+ * IGMP and MLD snooping, or management, put on each bridge with the ports
+ * they are forwarded to.  It is filled from one RTM_GETMDB dump and then
+ * kept current from RTNLGRP_MDB notifications, like the FDB mirror.
+ *
+ * The notifications are read on the event loop (reactor.h), which the
+ * monitor (monitor.h) registers mdb_get_fd() with: call mdb_process() when
+ * it becomes readable. */
+
+int mdb_init();
+void mdb_destroy();
+
+int mdb_get_fd();
+void mdb_process();
+
+size_t mdb_count();
+
+/* Provides the tsn-bridge-mdb:multicast-database of the components of
+ * /ieee802-dot1q-bridge:bridges/bridge, named as the FDB ones are. */
+void bridge_multicast_database_provider(sr_session_ctx_t *session,
+                                        const char *request_xpath,
+                                        struct lyd_node **parent);
+
+#endif /* mdb.h */
@@ -0,0 +1,15 @@
+#ifndef MONITOR_H
+#define MONITOR_H 1
+
+#include "repo.h"
+#include "shash.h"
+
+/* Subscribes to the kernel's link and address notifications (RTNLGRP_LINK,
+ * RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR) and keeps 'interfaces' and the
+ * datastores current from the event loop, which must be initialized.  The
+ * edits are queued on 'queue'.  Nothing is written unless the kernel
+ * reports a change. */
+int monitor_start(struct shash *interfaces, oper_actions_t *queue);
+void monitor_stop();
+
+#endif /* monitor.h */
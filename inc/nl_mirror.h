@@ -0,0 +1,59 @@
+#ifndef NL_MIRROR_H
+#define NL_MIRROR_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <netlink/netlink.h>
+
+#include "hmap.h"
+
+/* A kernel table mirrored in memory from rtnetlink, as the FDB and the MDB
+ * are: dumped once, then kept current from the notifications of one
+ * multicast group.  The socket joins the group before the dump, so that
+ * nothing that changes in between is missed; replaying a change that is in
+ * the dump already is harmless.
+ *
+ * When notifications are lost to an overflow, the ones still queued are
+ * discarded, as they are older than the new dump and would undo changes
+ * that were lost, and the table is dumped again.  A dump is taken into a
+ * fresh table without the lock and swapped in, so readers only wait for the
+ * swap.
+ *
+ * The owner fills in the first part and keeps the table and its lock. */
+struct nl_mirror {
+    const char *name;               /* "FDB", "MDB", for the log. */
+    const char *unit;               /* What count() counts, for the log. */
+    int group;                      /* RTNLGRP_*. */
+    int buffer_size;                /* Of the notification socket. */
+    int dump_type;                  /* RTM_GET*. */
+    const void *dump_hdr;           /* Family header of the dump request. */
+    size_t dump_hdr_len;
+    uint16_t new_type, del_type;    /* RTM_NEW*, RTM_DEL*. */
+
+    struct hmap *table;
+    pthread_rwlock_t *rwlock;
+
+    /* Adds ('add') or removes what message 'hdr' reports to 'table', the
+     * mirror under the lock or a table being dumped into. */
+    void (*apply)(struct nlmsghdr *hdr, struct hmap *table, bool add);
+    void (*clear)(struct hmap *table);
+    size_t (*count)(const struct hmap *table);
+
+    struct nl_sock *event_sk;
+    bool discarding;
+};
+
+/* Subscribes to the notifications and takes the first dump.  Returns 0 or
+ * -1, then the mirror stays empty. */
+int nl_mirror_init(struct nl_mirror *mirror);
+void nl_mirror_destroy(struct nl_mirror *mirror);
+
+/* File descriptor of the notification socket, -1 if there is none, and the
+ * handler to call when it becomes readable. */
+int nl_mirror_get_fd(const struct nl_mirror *mirror);
+void nl_mirror_process(struct nl_mirror *mirror);
+
+#endif /* nl_mirror.h */
@@ -0,0 +1,55 @@
+#ifndef OPER_TREE_H
+#define OPER_TREE_H 1
+
+#include <stdint.h>
+#include <libyang/libyang.h>
+
+/* Helpers for the oper-data providers.  Instead of formatting an absolute
+ * XPath per leaf and having libyang parse and resolve it again, each list
+ * entry is created once and its children are attached to it directly by
+ * name. */
+
+/* Returns the top-level container 'name' of 'module' that the provider's
+ * nodes go under.  A new one is created into '*parent' unless '*parent'
+ * already is that container. */
+struct lyd_node *oper_tree_root(const struct ly_ctx *ctx, const char *module,
+                                const char *name, struct lyd_node **parent);
+
+/* Returns the value of the first key of 'node' if it is an entry of list
+ * 'list', otherwise NULL. */
+const char *oper_tree_list_key(const struct lyd_node *node, const char *list);
+
+/* Returns /ietf-interfaces:interfaces/interface[name='name'], creating it
+ * under the root in '*parent' unless '*parent' already is that entry. */
+struct lyd_node *oper_tree_interface(const struct ly_ctx *ctx,
+                                     struct lyd_node **parent,
+                                     const char *name);
+
+/* The counters of ietf-interfaces statistics that are published, in the
+ * order of the model. */
+enum interface_counter {
+    IF_COUNTER_IN_OCTETS,
+    IF_COUNTER_IN_UNICAST_PKTS,
+    IF_COUNTER_IN_ERRORS,
+    IF_COUNTER_IN_DISCARDS,
+    IF_COUNTER_OUT_OCTETS,
+    IF_COUNTER_OUT_UNICAST_PKTS,
+    IF_COUNTER_OUT_ERRORS,
+    IF_COUNTER_OUT_DISCARDS,
+    IF_COUNTER_MAX
+};
+
+/* Adds the statistics container with 'counters' to the interface entry
+ * 'intf' and returns it. */
+struct lyd_node *oper_tree_interface_statistics(struct lyd_node *intf,
+                                                const char *discontinuity_time,
+                                                const uint64_t *counters);
+
+struct lyd_node *oper_tree_add_container(struct lyd_node *node, const char *name);
+/* Adds container 'name' that 'module' augments into 'node'. */
+struct lyd_node *oper_tree_add_augment(const struct ly_ctx *ctx, struct lyd_node *node,
+                                       const char *module, const char *name);
+void oper_tree_add_str(struct lyd_node *node, const char *name, const char *value);
+void oper_tree_add_uint64(struct lyd_node *node, const char *name, uint64_t value);
+
+#endif /* oper_tree.h */
@@ -0,0 +1,17 @@
+#ifndef OS_INFO_H
+#define OS_INFO_H 1
+
+/* The versions of the machine and of the system it runs, read in-process
+ * on first use and kept for the life of the daemon.
+ *
+ * The hardware version is the DMI product name and version, else the
+ * devicetree model, else the machine of uname(2).  The software version is
+ * the PRETTY_NAME of os-release(5).  Both return NULL if nothing is found. */
+
+const char *os_info_hardware_version();
+const char *os_info_software_version();
+
+/* Frees the cached versions; the next call reads them again. */
+void os_info_destroy();
+
+#endif /* os_info.h */
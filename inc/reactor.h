@@ -0,0 +1,45 @@
+#ifndef REACTOR_H
+#define REACTOR_H 1
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/* The event loop of the daemon: one epoll set on the main thread that
+ * dispatches the sysrepo event pipe, the netlink sockets, D-Bus and the
+ * timers as they become ready.  Nothing is polled on a period.
+ *
+ * Descriptors are registered and removed on the loop thread, or before
+ * reactor_run().  Timers may be armed from any thread, and reactor_stop()
+ * may be called from any thread or a signal handler. */
+
+/* Called with the epoll events of 'fd', e.g. EPOLLIN. */
+typedef void (*reactor_fd_cb)(int fd, uint32_t events, void *aux);
+typedef void (*reactor_timer_cb)(void *aux);
+
+struct reactor_timer;
+
+int reactor_init();
+void reactor_destroy();
+
+/* Watches 'fd' for 'events'.  A descriptor can be registered once. */
+int reactor_add_fd(int fd, uint32_t events, reactor_fd_cb cb, void *aux);
+/* Changes the events 'fd' is watched for, 0 to pause it. */
+int reactor_mod_fd(int fd, uint32_t events);
+/* Stops watching 'fd'.  Its callback is not called any more, even for
+ * events already collected in the current round. */
+void reactor_del_fd(int fd);
+
+/* Creates a timer on a timerfd, disarmed. */
+struct reactor_timer *reactor_timer_create(reactor_timer_cb cb, void *aux);
+/* Fires once after 'after_ms', then every 'interval_ms' unless it is 0.
+ * 'after_ms' 0 disarms the timer. */
+void reactor_timer_arm(struct reactor_timer *, unsigned int after_ms,
+                       unsigned int interval_ms);
+void reactor_timer_destroy(struct reactor_timer *);
+
+/* Dispatches events until reactor_stop().  Returns 0, or -1 if epoll
+ * fails. */
+int reactor_run();
+void reactor_stop();
+
+#endif /* reactor.h */
@@ -1,9 +1,12 @@
 #ifndef REPO_H
 #define REPO_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <sysrepo.h>
 #include <pthread.h>
 
+#include "hmap.h"
 #include "list.h"
 
 typedef enum {
@@ -12,18 +15,107 @@ typedef enum {
 } action_type_t;
 
 typedef struct action_s {
-    struct list_node node;
+    struct list_node node;          /* In the queue, in arrival order. */
+    struct hmap_node hmap_node;     /* In 'by_path' while queued. */
     action_type_t type;
+    sr_datastore_t ds;
     char *path;
-    sr_val_t val;
+    sr_val_t *val;                  /* SET_ITEM: the value, or NULL... */
+    char *str;                      /* ...with the value as a string. */
 } action_t;
 
+/* A write-behind queue: collectors and event handlers queue their edits and
+ * go on, and a writer thread applies them on a session of its own.
+ *
+ * An edit replaces one to the same path and datastore that is still queued,
+ * so only the last value is written, and a delete drops the queued edits
+ * below its path.  The writer takes everything queued at once and applies
+ * the deletes before the sets, in one transaction per datastore; edits
+ * queued meanwhile make up the next batch.  A producer only waits when
+ * more than OPER_ACTIONS_MAX_QUEUED edits are queued, until the writer has
+ * taken them.
+ *
+ * sysrepo keeps pushed operational data per session, and only the session
+ * that pushed a value can replace it: every operational edit of the daemon,
+ * the startup ones included, goes through this queue. */
+#define OPER_ACTIONS_MAX_QUEUED 4096
+
 typedef struct oper_actions_s {
     pthread_mutex_t mutex;
+    pthread_cond_t queued;          /* Wakes the writer. */
+    pthread_cond_t taken;           /* Wakes producers held back. */
     struct list_node actions;
+    struct hmap by_path;
+    size_t n_actions;
+
+    sr_session_ctx_t *session;      /* The writer's. */
+    pthread_t thread;
+    bool running;
+
+    uint64_t n_queued;              /* Edits queued. */
+    uint64_t n_coalesced;           /* Edits replaced or dropped. */
+    uint64_t n_batches;
+    uint64_t n_waits;               /* Producers held back. */
+    uint64_t n_errors;
 } oper_actions_t;
 
 void oper_actions_init(oper_actions_t *actions);
+/* Starts the writer on a session of 'connection'. */
+int oper_actions_start(oper_actions_t *actions, sr_conn_ctx_t *connection);
+/* Applies what is queued and stops the writer. */
+void oper_actions_stop(oper_actions_t *actions);
+void oper_actions_destroy(oper_actions_t *actions);
+
+void oper_actions_set(oper_actions_t *actions, sr_datastore_t ds,
+                      const char *path, const sr_val_t *val);
+void oper_actions_set_str(oper_actions_t *actions, sr_datastore_t ds,
+                          const char *path, const char *value);
+void oper_actions_delete(oper_actions_t *actions, sr_datastore_t ds,
+                         const char *path);
+
+/* Collects every edit of one collection cycle on 'session' and applies them
+ * as a single sysrepo transaction per datastore, instead of one transaction
+ * per interface or per address.  The number of commits and the time spent
+ * in them are logged when the cycle ends.
+ *
+ * A batch begun with write_batch_begin_queued() passes its edits on to a
+ * write-behind queue instead and never waits for sysrepo.
+ *
+ * A batch begun with write_batch_begin_reconcile() edits nothing as it goes:
+ * its sets describe the whole content wanted in the running datastore under
+ * the 'owned' subtrees.  write_batch_end() compares that with what running
+ * holds and applies only the difference, in one transaction, deleting what
+ * was not set; so write_batch_delete() has nothing to do, and a restart over
+ * unchanged state writes nothing and raises no change event.  Such a batch
+ * stays on the running datastore. */
+typedef struct write_batch_s {
+    sr_session_ctx_t *session;
+    oper_actions_t *queue;
+    sr_datastore_t ds;           /* Of the queued edits. */
+    const char *const *owned;    /* Reconciled subtrees, NULL terminated. */
+    const struct ly_ctx *ly_ctx;
+    struct lyd_node *desired;    /* What the sets of a reconcile describe. */
+    const char *name;
+    unsigned int edits;          /* Edits queued since the cycle began. */
+    unsigned int pending;        /* Edits not applied yet. */
+    unsigned int commits;        /* sr_apply_changes() calls. */
+    unsigned int errors;         /* Failed edits and commits. */
+    uint64_t start_us;
+    uint64_t commit_us;          /* Time spent in sr_apply_changes(). */
+} write_batch_t;
+
+void write_batch_begin(write_batch_t *batch, sr_session_ctx_t *session,
+                       const char *name);
+void write_batch_begin_queued(write_batch_t *batch, oper_actions_t *queue,
+                              const char *name);
+void write_batch_begin_reconcile(write_batch_t *batch, sr_session_ctx_t *session,
+                                 const char *name, const char *const *owned);
+int write_batch_set(write_batch_t *batch, const char *path, const sr_val_t *val);
+int write_batch_set_str(write_batch_t *batch, const char *path, const char *value);
+int write_batch_delete(write_batch_t *batch, const char *path);
+int write_batch_flush(write_batch_t *batch);
+int write_batch_switch_ds(write_batch_t *batch, sr_datastore_t ds);
+void write_batch_end(write_batch_t *batch);
 
 void clear_sysrepo();
 
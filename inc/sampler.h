@@ -0,0 +1,47 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sset.h"
+
+/* A background thread samples the byte, packet, error and drop counters of
+ * every port at a fixed period into a per-port ring.  The sampler thread is
+ * the ring's only writer; readers never take a lock and never block it. */
+
+#define SAMPLER_DEFAULT_PERIOD_MS 10
+
+/* Number of samples kept per port, a power of 2. */
+#define SAMPLER_RING_SIZE 1024
+
+struct port_rates {
+    uint32_t period_ms;     /* Sample period. */
+    uint32_t samples;       /* Samples the peaks were taken over. */
+    uint64_t in_bps;        /* Average over the last second. */
+    uint64_t in_pps;
+    uint64_t out_bps;
+    uint64_t out_pps;
+    uint64_t in_peak_bps;   /* Highest rate between two samples. */
+    uint64_t in_peak_pps;
+    uint64_t out_peak_bps;
+    uint64_t out_peak_pps;
+};
+
+/* Sets the sample period, 0 disables the sampler.  Takes effect on the next
+ * sampler_start(). */
+void sampler_set_period(unsigned int period_ms);
+
+int sampler_start(const struct sset *ports);
+void sampler_stop();
+
+/* Computes the rates of 'port' from its ring.  Returns false if the port is
+ * not sampled or there are fewer than 2 samples yet. */
+bool sampler_get_rates(const char *port, struct port_rates *rates);
+
+/* Copies the IF_COUNTER_MAX counters of the newest sample of 'port' into
+ * 'counters'.  Returns false if the port is not sampled or has no sample
+ * yet. */
+bool sampler_get_counters(const char *port, uint64_t *counters);
+
+#endif /* sampler.h */
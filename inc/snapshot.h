@@ -0,0 +1,39 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H 1
+
+#include <stdatomic.h>
+
+/* Immutable snapshots of operational data, built by a collector
+ * (collector.h) and read by the providers without a lock.
+ *
+ * A collector publishes a new snapshot with one atomic pointer swap.  The
+ * snapshot it replaces is freed once every reader that may still see it has
+ * left its read section, so readers never block writers and never wait for
+ * them.  Read sections are counted in two halves, the current one and the
+ * one being drained, in the manner of SRCU. */
+
+struct snapshot_slot {
+    _Atomic(void *) current;
+    void (*destroy)(void *);    /* Frees a replaced snapshot. */
+};
+
+#define SNAPSHOT_SLOT_INITIALIZER(DESTROY) { NULL, DESTROY }
+
+/* Enters a read section and returns the value to leave it with.  Sections
+ * may nest, and may span any number of slots. */
+unsigned int snapshot_read_lock();
+void snapshot_read_unlock(unsigned int idx);
+
+/* Returns the snapshot of 'slot', which stays valid until the read section
+ * is left, or NULL if none was published. */
+const void *snapshot_get(struct snapshot_slot *slot);
+
+/* Makes 'snapshot', which may be NULL, the current one of 'slot' and frees
+ * the previous one after the readers that may see it are gone.  Must not be
+ * called in a read section. */
+void snapshot_publish(struct snapshot_slot *slot, void *snapshot);
+
+/* Frees the current snapshot of 'slot'. */
+void snapshot_slot_clear(struct snapshot_slot *slot);
+
+#endif /* snapshot.h */
@@ -0,0 +1,37 @@
+#ifndef STATS_CACHE_H
+#define STATS_CACHE_H 1
+
+#include <stdint.h>
+
+#include "shash.h"
+
+/* Interface counters from one kernel dump of every link, for the ports the
+ * sampler (sampler.h) does not sample.  The collector (collector.h) dumps
+ * them every period while they are read and publishes each dump as an
+ * immutable snapshot (snapshot.h); a get only reads the current one and
+ * never waits for the kernel.  A get for one interface reads that
+ * interface out of the dump of every link. */
+struct stats_snapshot {
+    struct shash counters;  /* Link name -> uint64_t[IF_COUNTER_MAX]. */
+    uint64_t     taken_us;  /* get_monotonic_us() of the dump. */
+};
+
+#define STATS_CACHE_DEFAULT_PERIOD_MS 50
+
+void stats_cache_set_period(unsigned int period_ms);
+
+/* Dumps the counters once and hands them to the collector. */
+void stats_cache_collect();
+
+/* Marks the counters read and returns the current snapshot, or NULL if the
+ * kernel was never dumped.  Call it in a snapshot read section, the
+ * snapshot is valid until it is left. */
+const struct stats_snapshot *stats_cache_current();
+
+/* Returns the IF_COUNTER_MAX counters of link 'name', or NULL. */
+const uint64_t *stats_snapshot_find(const struct stats_snapshot *snapshot,
+                                    const char *name);
+
+void stats_cache_destroy();
+
+#endif /* stats_cache.h */
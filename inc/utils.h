@@ -16,4 +16,6 @@ uint8_t netmask_prefix(struct sockaddr *netmask);
 
 uint64_t get_age(char *age_str);
 
+char *get_xpath_key(const char *xpath, const char *list, const char *key);
+
 #endif /* utils.h */
\ No newline at end of file
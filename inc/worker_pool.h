@@ -0,0 +1,31 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H 1
+
+#include <stddef.h>
+
+/* A small fixed pool of threads that runs per-port work in parallel, e.g.
+ * the ioctls of a collection over a few hundred ports.
+ *
+ * The items of a run are split into one contiguous shard per worker and
+ * the calling thread.  Each takes items from the front of its own shard,
+ * and once it is empty steals from the others, so a few slow ports do not
+ * hold up the run.  Items are handed out by index; a callback that only
+ * writes the state of its own item needs no lock. */
+
+#define WORKER_POOL_DEFAULT_WORKERS 4
+
+/* Maximum number of threads, the caller included, that work on a run. */
+#define WORKER_POOL_MAX_WORKERS 64
+
+typedef void (*worker_pool_cb)(size_t idx, void *aux);
+
+/* Starts 'n_workers' threads besides the callers of worker_pool_run(); 0
+ * runs every item on the calling thread. */
+int worker_pool_init(unsigned int n_workers);
+void worker_pool_destroy();
+
+/* Calls 'cb' for every index in [0, n_items) and returns once all of them
+ * are done.  Runs from different threads are taken one after the other. */
+void worker_pool_run(size_t n_items, worker_pool_cb cb, void *aux);
+
+#endif /* worker_pool.h */
@@ -0,0 +1,84 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define ARENA_CHUNK_SIZE 16384
+#define ARENA_ALIGN (sizeof(void *) > sizeof(uint64_t) \
+                     ? sizeof(void *) : sizeof(uint64_t))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    /* Followed by the chunk's data. */
+};
+
+#define ARENA_HEADER_SIZE \
+    ((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+void
+arena_init(struct arena *arena)
+{
+    arena->chunks = NULL;
+    arena->pos = NULL;
+    arena->left = 0;
+}
+
+void
+arena_destroy(struct arena *arena)
+{
+    struct arena_chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena_init(arena);
+}
+
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+    struct arena_chunk *chunk;
+    void *p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size > arena->left) {
+        size_t data_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+
+        chunk = xmalloc(ARENA_HEADER_SIZE + data_size);
+        if (size > ARENA_CHUNK_SIZE / 4 && arena->chunks != NULL) {
+            /* A large block gets a chunk of its own behind the current one,
+             * so the rest of the current chunk is not wasted. */
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+            return (char *) chunk + ARENA_HEADER_SIZE;
+        }
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->pos = (char *) chunk + ARENA_HEADER_SIZE;
+        arena->left = data_size;
+    }
+
+    p = arena->pos;
+    arena->pos += size;
+    arena->left -= size;
+    return p;
+}
+
+void *
+arena_zalloc(struct arena *arena, size_t size)
+{
+    void *p = arena_alloc(arena, size);
+    memset(p, 0, size);
+    return p;
+}
+
+char *
+arena_strdup(struct arena *arena, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    return memcpy(arena_alloc(arena, len), s, len);
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* A bump allocator.  Allocations cannot be freed one by one; everything
+ * allocated from an arena is released at once by arena_destroy(). */
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *chunks; /* Most recent first. */
+    char *pos;                  /* Next free byte in the first chunk. */
+    size_t left;                /* Free bytes after 'pos'. */
+};
+
+#define ARENA_INITIALIZER { NULL, NULL, 0 }
+
+void arena_init(struct arena *);
+void arena_destroy(struct arena *);
+
+void *arena_alloc(struct arena *, size_t);
+void *arena_zalloc(struct arena *, size_t);
+char *arena_strdup(struct arena *, const char *);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* arena.h */
@@ -1,6 +1,7 @@
 #include "util.h"
 
 #include <stdlib.h>
+#include <time.h>
 
 void *xmalloc(size_t size)
 {
@@ -8,6 +9,7 @@ void *xmalloc(size_t size)
     if (p == NULL) {
         abort();
     }
+    return p;
 }
 
 void *xrealloc(void *p, size_t size)
@@ -24,4 +26,12 @@ x2nrealloc(void *p, size_t *n, size_t s)
 {
     *n = *n == 0 ? 1 : 2 * *n;
     return xrealloc(p, *n * s);
-}
\ No newline at end of file
+}
+
+uint64_t get_monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
@@ -110,6 +110,9 @@ void *xmalloc(size_t);
 void *xrealloc(void *p, size_t size);
 void *x2nrealloc(void *p, size_t *n, size_t s);
 
+/* Returns CLOCK_MONOTONIC in microseconds. */
+uint64_t get_monotonic_us(void);
+
 /* Returns true if X is a power of 2, otherwise false. */
 #define IS_POW2(X) ((X) && !((X) & ((X) - 1)))
 
@@ -0,0 +1,249 @@
+#include "vlan-bitmap.h"
+#include <string.h>
+
+#include "dynamic-string.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+typedef __m128i vlan_vec;
+#define VEC_LOAD(P) _mm_load_si128((const __m128i *) (P))
+#define VEC_STORE(P, V) _mm_store_si128((__m128i *) (P), V)
+#define VEC_OR(A, B) _mm_or_si128(A, B)
+#define VEC_AND(A, B) _mm_and_si128(A, B)
+#define VEC_AND_NOT(A, B) _mm_andnot_si128(B, A)
+#define VEC_XOR(A, B) _mm_xor_si128(A, B)
+#define VEC_ZERO() _mm_setzero_si128()
+#define VEC_IS_ZERO(V) \
+    (_mm_movemask_epi8(_mm_cmpeq_epi8(V, _mm_setzero_si128())) == 0xffff)
+#define VLAN_BITMAP_VEC 1
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+typedef uint64x2_t vlan_vec;
+#define VEC_LOAD(P) vld1q_u64(P)
+#define VEC_STORE(P, V) vst1q_u64(P, V)
+#define VEC_OR(A, B) vorrq_u64(A, B)
+#define VEC_AND(A, B) vandq_u64(A, B)
+#define VEC_AND_NOT(A, B) vbicq_u64(A, B)
+#define VEC_XOR(A, B) veorq_u64(A, B)
+#define VEC_ZERO() vdupq_n_u64(0)
+#define VEC_IS_ZERO(V) \
+    ((vgetq_lane_u64(V, 0) | vgetq_lane_u64(V, 1)) == 0)
+#define VLAN_BITMAP_VEC 1
+#endif
+
+/* Applies OP to every pair of words, two at a time with vector registers.
+ * OP_WORD is the scalar equivalent. */
+#ifdef VLAN_BITMAP_VEC
+#define VLAN_BITMAP_BINOP(DST, A, B, OP, OP_WORD)                       \
+    for (int i_ = 0; i_ < VLAN_BITMAP_WORDS; i_ += 2) {                 \
+        VEC_STORE(&(DST)->words[i_],                                    \
+                  OP(VEC_LOAD(&(A)->words[i_]),                         \
+                     VEC_LOAD(&(B)->words[i_])));                       \
+    }
+#else
+#define VLAN_BITMAP_BINOP(DST, A, B, OP, OP_WORD)                       \
+    for (int i_ = 0; i_ < VLAN_BITMAP_WORDS; i_++) {                    \
+        (DST)->words[i_] = OP_WORD((A)->words[i_], (B)->words[i_]);     \
+    }
+#endif
+
+#define WORD_OR(A, B) ((A) | (B))
+#define WORD_AND(A, B) ((A) & (B))
+#define WORD_AND_NOT(A, B) ((A) & ~(B))
+
+void
+vlan_bitmap_init(struct vlan_bitmap *bitmap)
+{
+    memset(bitmap, 0, sizeof *bitmap);
+}
+
+/* Returns the bits from 'first' to 'last' of a word, both in 0...63. */
+static uint64_t
+word_mask(int first, int last)
+{
+    uint64_t high = last == 63 ? UINT64_MAX : (UINT64_C(1) << (last + 1)) - 1;
+
+    return high & ~((UINT64_C(1) << first) - 1);
+}
+
+static void
+update_range(struct vlan_bitmap *bitmap, int first, int last, bool set)
+{
+    int first_word, last_word;
+
+    if (first < 0) {
+        first = 0;
+    }
+    if (last >= VLAN_N_IDS) {
+        last = VLAN_N_IDS - 1;
+    }
+    if (first > last) {
+        return;
+    }
+
+    first_word = first / 64;
+    last_word = last / 64;
+    for (int i = first_word; i <= last_word; i++) {
+        uint64_t mask = word_mask(i == first_word ? first % 64 : 0,
+                                  i == last_word ? last % 64 : 63);
+
+        if (set) {
+            bitmap->words[i] |= mask;
+        } else {
+            bitmap->words[i] &= ~mask;
+        }
+    }
+}
+
+void
+vlan_bitmap_set_range(struct vlan_bitmap *bitmap, int first, int last)
+{
+    update_range(bitmap, first, last, true);
+}
+
+void
+vlan_bitmap_clear_range(struct vlan_bitmap *bitmap, int first, int last)
+{
+    update_range(bitmap, first, last, false);
+}
+
+size_t
+vlan_bitmap_count(const struct vlan_bitmap *bitmap)
+{
+    size_t count = 0;
+
+    for (int i = 0; i < VLAN_BITMAP_WORDS; i++) {
+        count += __builtin_popcountll(bitmap->words[i]);
+    }
+
+    return count;
+}
+
+bool
+vlan_bitmap_is_empty(const struct vlan_bitmap *bitmap)
+{
+#ifdef VLAN_BITMAP_VEC
+    vlan_vec acc = VEC_ZERO();
+
+    for (int i = 0; i < VLAN_BITMAP_WORDS; i += 2) {
+        acc = VEC_OR(acc, VEC_LOAD(&bitmap->words[i]));
+    }
+    return VEC_IS_ZERO(acc);
+#else
+    uint64_t acc = 0;
+
+    for (int i = 0; i < VLAN_BITMAP_WORDS; i++) {
+        acc |= bitmap->words[i];
+    }
+    return acc == 0;
+#endif
+}
+
+bool
+vlan_bitmap_equal(const struct vlan_bitmap *a, const struct vlan_bitmap *b)
+{
+#ifdef VLAN_BITMAP_VEC
+    vlan_vec acc = VEC_ZERO();
+
+    for (int i = 0; i < VLAN_BITMAP_WORDS; i += 2) {
+        acc = VEC_OR(acc, VEC_XOR(VEC_LOAD(&a->words[i]),
+                                  VEC_LOAD(&b->words[i])));
+    }
+    return VEC_IS_ZERO(acc);
+#else
+    return memcmp(a->words, b->words, sizeof a->words) == 0;
+#endif
+}
+
+static int
+scan(const struct vlan_bitmap *bitmap, int start, uint64_t invert)
+{
+    uint64_t word;
+    int i;
+
+    if (start < 0) {
+        start = 0;
+    }
+    if (start >= VLAN_N_IDS) {
+        return VLAN_N_IDS;
+    }
+
+    i = start / 64;
+    word = (bitmap->words[i] ^ invert) & ~((UINT64_C(1) << (start % 64)) - 1);
+    for (;;) {
+        if (word) {
+            return i * 64 + __builtin_ctzll(word);
+        }
+        if (++i >= VLAN_BITMAP_WORDS) {
+            return VLAN_N_IDS;
+        }
+        word = bitmap->words[i] ^ invert;
+    }
+}
+
+int
+vlan_bitmap_scan(const struct vlan_bitmap *bitmap, int start)
+{
+    return scan(bitmap, start, 0);
+}
+
+int
+vlan_bitmap_scan_zero(const struct vlan_bitmap *bitmap, int start)
+{
+    return scan(bitmap, start, UINT64_MAX);
+}
+
+bool
+vlan_bitmap_next_range(const struct vlan_bitmap *bitmap, int start,
+                       int *first, int *last)
+{
+    *first = vlan_bitmap_scan(bitmap, start);
+    if (*first >= VLAN_N_IDS) {
+        return false;
+    }
+
+    *last = vlan_bitmap_scan_zero(bitmap, *first + 1) - 1;
+    return true;
+}
+
+void
+vlan_bitmap_format_ranges(const struct vlan_bitmap *bitmap, struct ds *ds)
+{
+    int vid, first, last;
+
+    for (vid = 0; vlan_bitmap_next_range(bitmap, vid, &first, &last);
+         vid = last + 1) {
+        if (vid != 0) {
+            ds_put_char(ds, ',');
+        }
+        if (first == last) {
+            ds_put_format(ds, "%d", first);
+        } else {
+            ds_put_format(ds, "%d-%d", first, last);
+        }
+    }
+}
+
+void
+vlan_bitmap_or(struct vlan_bitmap *dst, const struct vlan_bitmap *a,
+               const struct vlan_bitmap *b)
+{
+    VLAN_BITMAP_BINOP(dst, a, b, VEC_OR, WORD_OR);
+}
+
+void
+vlan_bitmap_and(struct vlan_bitmap *dst, const struct vlan_bitmap *a,
+                const struct vlan_bitmap *b)
+{
+    VLAN_BITMAP_BINOP(dst, a, b, VEC_AND, WORD_AND);
+}
+
+void
+vlan_bitmap_and_not(struct vlan_bitmap *dst, const struct vlan_bitmap *a,
+                    const struct vlan_bitmap *b)
+{
+    VLAN_BITMAP_BINOP(dst, a, b, VEC_AND_NOT, WORD_AND_NOT);
+}
@@ -0,0 +1,85 @@
+#ifndef VLAN_BITMAP_H
+#define VLAN_BITMAP_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+struct ds;
+
+/* A set of VLAN IDs, one bit per ID from 0 to 4095.
+ *
+ * The set operations work on whole words, 128 bits at a time with SSE2 or
+ * NEON where the compiler targets it. */
+
+#define VLAN_N_IDS 4096
+#define VLAN_BITMAP_WORDS (VLAN_N_IDS / 64)
+
+struct vlan_bitmap {
+    uint64_t words[VLAN_BITMAP_WORDS];
+} __attribute__((aligned(16)));
+
+#define VLAN_BITMAP_INITIALIZER { { 0 } }
+
+void vlan_bitmap_init(struct vlan_bitmap *);
+
+static inline bool
+vlan_bitmap_contains(const struct vlan_bitmap *bitmap, int vid)
+{
+    return (bitmap->words[vid / 64] >> (vid % 64)) & 1;
+}
+
+static inline void
+vlan_bitmap_set(struct vlan_bitmap *bitmap, int vid)
+{
+    bitmap->words[vid / 64] |= UINT64_C(1) << (vid % 64);
+}
+
+static inline void
+vlan_bitmap_clear(struct vlan_bitmap *bitmap, int vid)
+{
+    bitmap->words[vid / 64] &= ~(UINT64_C(1) << (vid % 64));
+}
+
+/* Sets or clears the IDs from 'first' to 'last', both included. */
+void vlan_bitmap_set_range(struct vlan_bitmap *, int first, int last);
+void vlan_bitmap_clear_range(struct vlan_bitmap *, int first, int last);
+
+size_t vlan_bitmap_count(const struct vlan_bitmap *);
+bool vlan_bitmap_is_empty(const struct vlan_bitmap *);
+bool vlan_bitmap_equal(const struct vlan_bitmap *, const struct vlan_bitmap *);
+
+/* Returns the lowest ID from 'start' on that is in, or not in, the set;
+ * VLAN_N_IDS if there is none. */
+int vlan_bitmap_scan(const struct vlan_bitmap *, int start);
+int vlan_bitmap_scan_zero(const struct vlan_bitmap *, int start);
+
+/* Finds the first run of consecutive IDs from 'start' on and stores its
+ * bounds into '*first' and '*last'.  Returns false if there is none. */
+bool vlan_bitmap_next_range(const struct vlan_bitmap *, int start,
+                            int *first, int *last);
+
+/* Appends the set to 'ds' as a list of ranges, e.g. "1,10-20,4094". */
+void vlan_bitmap_format_ranges(const struct vlan_bitmap *, struct ds *);
+
+/* 'dst' = 'a' | 'b', 'a' & 'b' and 'a' & ~'b'.  'dst' may be 'a' or 'b'. */
+void vlan_bitmap_or(struct vlan_bitmap *dst, const struct vlan_bitmap *a,
+                    const struct vlan_bitmap *b);
+void vlan_bitmap_and(struct vlan_bitmap *dst, const struct vlan_bitmap *a,
+                     const struct vlan_bitmap *b);
+void vlan_bitmap_and_not(struct vlan_bitmap *dst, const struct vlan_bitmap *a,
+                         const struct vlan_bitmap *b);
+
+#define VLAN_BITMAP_FOR_EACH(VID, BITMAP)                       \
+    for ((VID) = vlan_bitmap_scan(BITMAP, 0); (VID) < VLAN_N_IDS;  \
+         (VID) = vlan_bitmap_scan(BITMAP, (VID) + 1))
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* vlan-bitmap.h */
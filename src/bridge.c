@@ -5,152 +5,249 @@
 #include <sys/socket.h>
 #include <string.h>
 
+#include <linux/if_bridge.h>
+#include <linux/rtnetlink.h>
 #include <netlink/netlink.h>
+#include <netlink/msg.h>
 #include <netlink/route/link.h>
 #include <netlink/route/link/bridge.h>
-#include <cjson/cJSON.h>
 
+#include "hash.h"
+#include "link_cache.h"
 #include "log.h"
+#include "repo.h"
 #include "dynamic-string.h"
+#include "util.h"
 #include "utils.h"
 
-#define BUFFER_LENGTH 1024
+br_port_vlan_t *find_bridge_vlans(const struct hmap *ports, int ifindex)
+{
+    br_port_vlan_t *port;
 
-void get_bridge_vlan(const char *br_name, br_vlan_t *vlan)
+    HMAP_FOR_EACH_WITH_HASH (port, node, hash_int(ifindex, 0), ports) {
+        if (port->ifindex == ifindex) {
+            return port;
+        }
+    }
+
+    return NULL;
+}
+
+/* Adds the IFLA_BRIDGE_VLAN_INFO entries in 'af_spec' to 'vlan'.  With
+ * RTEXT_FILTER_BRVLAN_COMPRESSED, VLANs with the same flags come as one
+ * range of two entries. */
+static void parse_vlan_info(struct nlattr *af_spec, br_vlan_t *vlan)
 {
-    FILE* fp = NULL;
-    char buffer[BUFFER_LENGTH] = {0};
-    struct ds command = DS_EMPTY_INITIALIZER;
-    struct ds output = DS_EMPTY_INITIALIZER;
-    const char *err = NULL;
-    cJSON *root = NULL;
-    const cJSON *bridge = NULL, *vlan_node = NULL, *id_node = NULL, *flags_node = NULL;
-    cJSON *flag_node = NULL;
-    char *flag;
-    int len = 0, id = 0;
-
-    bzero(vlan, sizeof(*vlan));
-
-    ds_put_format(&command, "bridge -j vlan show dev %s", br_name);
-
-    fp = popen(ds_cstr(&command), "r");
-    if (NULL == fp) {
-        log_error("Execute command-%s failed", ds_cstr(&command));
-        return;
+    const struct bridge_vlan_info *info;
+    struct nlattr *attr;
+    int rem, first = -1;
+
+    nla_for_each_nested (attr, af_spec, rem) {
+        if (nla_type(attr) != IFLA_BRIDGE_VLAN_INFO ||
+            nla_len(attr) < (int)sizeof(*info)) {
+            continue;
+        }
+
+        info = nla_data(attr);
+        if (info->vid == 0 || info->vid >= VLAN_N_IDS) {
+            continue;
+        }
+
+        if (info->flags & BRIDGE_VLAN_INFO_RANGE_BEGIN) {
+            first = info->vid;
+            continue;
+        }
+        if (!(info->flags & BRIDGE_VLAN_INFO_RANGE_END) || first < 0) {
+            first = info->vid;
+        }
+
+        vlan_bitmap_set_range(&vlan->vlans, first, info->vid);
+        if (info->flags & BRIDGE_VLAN_INFO_UNTAGGED) {
+            vlan_bitmap_set_range(&vlan->untagged, first, info->vid);
+        }
+        /* The PVID is never part of a range. */
+        if (info->flags & BRIDGE_VLAN_INFO_PVID) {
+            vlan->pvid = info->vid;
+        }
+        first = -1;
     }
+}
 
-    while (fgets(buffer, BUFFER_LENGTH, fp) != NULL) {
-        ds_put_cstr(&output, buffer);
+static int vlan_dump_cb(struct nl_msg *msg, void *arg)
+{
+    struct hmap *ports = (struct hmap*)arg;
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+    struct nlattr *tb[IFLA_MAX + 1];
+    struct ifinfomsg *ifi;
+    br_port_vlan_t *port;
+
+    if (hdr->nlmsg_type != RTM_NEWLINK ||
+        nlmsg_parse(hdr, sizeof(*ifi), tb, IFLA_MAX, NULL) < 0)
+    {
+        return NL_OK;
     }
 
-    ds_destroy(&command);
-    pclose(fp);
+    ifi = nlmsg_data(hdr);
+    port = find_bridge_vlans(ports, ifi->ifi_index);
+    if (port == NULL) {
+        port = xmalloc(sizeof(*port));
+        memset(port, 0, sizeof(*port));
+        port->ifindex = ifi->ifi_index;
+        hmap_insert(ports, &port->node, hash_int(port->ifindex, 0));
+    }
 
-    root = cJSON_Parse(ds_cstr(&output));
-    if (NULL == root) {
-        if ((err = cJSON_GetErrorPtr()) != NULL) {
-            log_error("Parse bridge vlan's output failed: %s", err);
-        }
+    if (tb[IFLA_IFNAME] != NULL) {
+        nla_strlcpy(port->name, tb[IFLA_IFNAME], sizeof(port->name));
+    }
+    if (tb[IFLA_MASTER] != NULL) {
+        port->master = nla_get_u32(tb[IFLA_MASTER]);
+    }
+    if (tb[IFLA_AF_SPEC] != NULL) {
+        parse_vlan_info(tb[IFLA_AF_SPEC], &port->vlan);
+    }
+
+    return NL_OK;
+}
+
+int dump_bridge_vlans(struct hmap *ports)
+{
+    struct ifinfomsg ifi = { .ifi_family = AF_BRIDGE };
+    struct nl_sock *sk;
+    struct nl_msg *msg = NULL;
+    int rc;
+
+    sk = nl_socket_alloc();
+    if (sk == NULL) {
+        log_error("Allocate nl socket failed");
+        return -NLE_NOMEM;
     }
 
-    bridge = cJSON_GetObjectItemCaseSensitive(root, br_name);
-    if (NULL == bridge) {
-        log_error("the output of bridge vlan show is invalid: %s", ds_cstr(&output));
+    rc = nl_connect(sk, NETLINK_ROUTE);
+    if (rc != 0) {
+        log_error("Connect to nl failed: %s", nl_geterror(rc));
         goto cleanup;
     }
 
-    if (!cJSON_IsArray(bridge)) {
-        log_warn("%s's vlan node is not array: %s", br_name, cJSON_Print(bridge));
+    msg = nlmsg_alloc_simple(RTM_GETLINK, NLM_F_DUMP);
+    if (msg == NULL ||
+        nlmsg_append(msg, &ifi, sizeof(ifi), NLMSG_ALIGNTO) < 0 ||
+        nla_put_u32(msg, IFLA_EXT_MASK, RTEXT_FILTER_BRVLAN_COMPRESSED) < 0)
+    {
+        log_error("Build bridge vlan dump request failed");
+        rc = -NLE_NOMEM;
         goto cleanup;
     }
 
-    len = cJSON_GetArraySize(bridge);
-    for (int i = 0; i < len; i++) {
-        vlan_node = cJSON_GetArrayItem(bridge, i);
-        id_node = cJSON_GetObjectItemCaseSensitive(vlan_node, "vlan");
-        if (!cJSON_IsNumber(id_node)) {
-            log_error("vlan id is inalid for %s", br_name);
-            continue;
+    nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, vlan_dump_cb, ports);
+
+    rc = nl_send_auto(sk, msg);
+    if (rc < 0) {
+        log_error("Request bridge vlans failed: %s", nl_geterror(rc));
+        goto cleanup;
+    }
+
+    rc = nl_recvmsgs_default(sk);
+    if (rc < 0) {
+        log_error("Receive bridge vlans failed: %s", nl_geterror(rc));
+        goto cleanup;
+    }
+    rc = 0;
+
+cleanup:
+    nlmsg_free(msg);
+    nl_close(sk);
+    nl_socket_free(sk);
+    return rc;
+}
+
+void destroy_bridge_vlans(struct hmap *ports)
+{
+    br_port_vlan_t *port, *next;
+
+    HMAP_FOR_EACH_SAFE (port, next, node, ports) {
+        hmap_remove(ports, &port->node);
+        free(port);
+    }
+    hmap_destroy(ports);
+}
+
+static bridge_t *find_bridge_by_index(const struct shash *bridges, unsigned int ifindex)
+{
+    struct shash_node *node;
+    bridge_t *br;
+
+    SHASH_FOR_EACH(node, bridges) {
+        br = (bridge_t*)node->data;
+        if (br->index == ifindex) {
+            return br;
         }
-        id = id_node->valueint;
-        flags_node = cJSON_GetObjectItemCaseSensitive(vlan_node, "flags");
-
-        if (NULL == flags_node) {
-            for (int j = 0; j < VLAN_BITMAP_MAX; j++) {
-                if (vlan->vlan_bitmap[j] == 0) {
-                    vlan->vlan_bitmap[j] = id;
-                    break;
-                }
-            }
-        } else {
-            if (!cJSON_IsArray(flags_node)) {
-                log_error("The flags node of bridge is invalid: %s", cJSON_Print(flags_node));
-                continue;
-            }
+    }
 
-            bool is_pvid = false, is_untagged = false;
-            int n = cJSON_GetArraySize(flags_node);
-            for (int j = 0; j < n; j++) {
-                flag_node = cJSON_GetArrayItem(flags_node, j);
-                if (cJSON_IsString(flag_node)) {
-                    flag = cJSON_GetStringValue(flag_node);
-                    if (strcmp(flag, "PVID") == 0) {
-                        is_pvid = true;
-                    } else if (strstr(flag, "Untagged") != NULL) {
-                        is_untagged = true;
-                    }
-                }
-            }
+    return NULL;
+}
 
-            if (is_pvid && vlan->pvid != 0) {
-                log_error("There are multiple pvid");
-            } else if (is_pvid) {
-                vlan->pvid = id;
-            } else if (is_untagged) {
-                for (int j = 0; j < VLAN_BITMAP_MAX; j++) {
-                    if (vlan->untagged_bitmap[j] == 0) {
-                        vlan->untagged_bitmap[j] = id;
-                        break;
-                    }
-                }
-            }
+/* Moves the dumped VLANs of the ports of every bridge in 'bridges' from
+ * 'vlans' into the bridge. */
+static void attach_ports(struct shash *bridges, struct hmap *vlans)
+{
+    br_port_vlan_t *port, *next;
+    bridge_t *br;
+
+    HMAP_FOR_EACH_SAFE (port, next, node, vlans) {
+        /* The dump reports the bridge itself with its own index as master,
+         * it is not one of its ports. */
+        if (port->master == 0 || port->name[0] == '\0' ||
+            port->ifindex == port->master) {
+            continue;
+        }
+
+        br = find_bridge_by_index(bridges, port->master);
+        if (br != NULL) {
+            hmap_remove(vlans, &port->node);
+            hmap_insert(&br->ports, &port->node, hash_int(port->ifindex, 0));
         }
     }
+}
 
-cleanup:
-    cJSON_Delete(root);
-    ds_clear(&output);
+/* libnl has no accessor for IFLA_BR_VLAN_FILTERING, sysfs has it. */
+static bool get_vlan_filtering(const char *name)
+{
+    char path[64];
+    FILE *fp;
+    int value = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/bridge/vlan_filtering", name);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    if (fscanf(fp, "%d", &value) != 1) {
+        value = 0;
+    }
+    fclose(fp);
+
+    return value != 0;
 }
 
 void collect_bridges(struct shash *bridges)
 {
     struct if_nameindex *if_ni, *idx_p;
-    struct nl_sock *sk = NULL;
     struct nl_cache *cache = NULL;
     struct rtnl_link *link = NULL;
+    struct hmap vlans = HMAP_INITIALIZER(&vlans);
+    br_port_vlan_t *br_vlans;
     bridge_t *br;
-    int status = 0;
-    br_vlan_t *vlan = NULL;
-    char name[NAME_LEN] = { 0 };
 
-    if_ni = if_nameindex();
-
-    sk = nl_socket_alloc();
-    if (sk == NULL) {
-        log_error("Allocate nl socket failed");
-        return;
+    if (dump_bridge_vlans(&vlans) != 0) {
+        log_warn("Bridge vlans are not available");
     }
 
-    status = nl_connect(sk, NETLINK_ROUTE);
-    if (status != 0) {
-        log_error("Connect to nl failed");
-        nl_socket_free(sk);
-        return;
-    }
+    if_ni = if_nameindex();
 
-    status = rtnl_link_alloc_cache(sk, AF_UNSPEC, &cache);
-    if (status != 0) {
-        log_error("Allocate rtnl link cache failed");
+    link_cache_lock();
+    cache = link_cache_get();
+    if (cache == NULL) {
+        log_error("The rtnl link cache is not available");
         goto cleanup;
     }
 
@@ -165,11 +262,16 @@ void collect_bridges(struct shash *bridges)
                 bzero(br, sizeof(bridge_t));
                 strncpy(br->name, idx_p->if_name, sizeof(br->name));
                 br->index = idx_p->if_index;
+                br->vlan_filtering = get_vlan_filtering(br->name);
+                hmap_init(&br->ports);
 
                 struct nl_addr *addr = rtnl_link_get_addr(link);
                 nl_addr2str(addr, br->hw_addr, sizeof(br->hw_addr) - 1);
 
-                get_bridge_vlan(br->name, &br->vlan);
+                br_vlans = find_bridge_vlans(&vlans, br->index);
+                if (br_vlans != NULL) {
+                    br->vlan = br_vlans->vlan;
+                }
 
                 shash_add(bridges, idx_p->if_name, br);
             }
@@ -179,37 +281,90 @@ void collect_bridges(struct shash *bridges)
     }
 
 cleanup:
-    if (cache != NULL) {
-        nl_cache_free(cache);
+    link_cache_unlock();
+
+    if (if_ni != NULL) {
+        if_freenameindex(if_ni);
     }
 
-    if (sk != NULL) {
-        nl_close(sk);
-        nl_socket_free(sk);
+    attach_ports(bridges, &vlans);
+    destroy_bridge_vlans(&vlans);
+}
+
+void destroy_bridges(struct shash *bridges)
+{
+    struct shash_node *node;
+    bridge_t *br;
+
+    SHASH_FOR_EACH(node, bridges) {
+        br = (bridge_t*)node->data;
+        destroy_bridge_vlans(&br->ports);
+        free(br);
     }
+    shash_destroy(bridges);
 }
 
-void save_bridges(struct shash *bridges, sr_session_ctx_t *session)
+/* Publishes the VLANs of the ports of 'br' as operational data, each set as
+ * one list of ranges rather than an edit per VLAN. */
+static void save_bridge_ports(const bridge_t *br, write_batch_t *batch)
 {
-    int rc = SR_ERR_OK;
-    struct shash_node *br_node = NULL;
-    bridge_t *br = NULL;
     struct ds path = DS_EMPTY_INITIALIZER;
-    sr_val_t val = {0};
+    struct ds ranges = DS_EMPTY_INITIALIZER;
+    static const char *set_names[] = { "member", "untagged", "tagged" };
+    const struct vlan_bitmap *sets[3];
+    struct vlan_bitmap tagged;
+    const br_port_vlan_t *port;
+    char pvid[8];
+    size_t prefix;
+
+    HMAP_FOR_EACH (port, node, &br->ports) {
+        ds_clear(&path);
+        ds_put_format(&path,
+                      "/ietf-interfaces:interfaces/interface[name='%s']/ieee802-dot1q-bridge:bridge-port/",
+                      port->name);
+        prefix = path.length;
+
+        ds_put_cstr(&path, "bridge-name");
+        write_batch_set_str(batch, ds_cstr(&path), br->name);
+
+        if (port->vlan.pvid != 0) {
+            ds_truncate(&path, prefix);
+            ds_put_cstr(&path, "pvid");
+            snprintf(pvid, sizeof(pvid), "%u", port->vlan.pvid);
+            write_batch_set_str(batch, ds_cstr(&path), pvid);
+        }
 
-    rc = sr_delete_item(session,
-                        "/ieee802-dot1q-bridge:bridges/bridge",
-                        SR_EDIT_DEFAULT);
-    if (rc != SR_ERR_OK) {
-        log_error("Delete bridges from sysrepo failed: %s", sr_strerror(rc));
-    }
+        vlan_bitmap_and_not(&tagged, &port->vlan.vlans, &port->vlan.untagged);
+        sets[0] = &port->vlan.vlans;
+        sets[1] = &port->vlan.untagged;
+        sets[2] = &tagged;
+
+        for (int i = 0; i < 3; i++) {
+            if (vlan_bitmap_is_empty(sets[i])) {
+                continue;
+            }
 
-    rc = sr_apply_changes(session, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Delete bridge apply failed: %s", sr_strerror(rc));
-        sr_discard_changes(session);
+            ds_clear(&ranges);
+            vlan_bitmap_format_ranges(sets[i], &ranges);
+
+            ds_truncate(&path, prefix);
+            ds_put_format(&path, "tsn-bridge-port-vlans:vlans/%s", set_names[i]);
+            write_batch_set_str(batch, ds_cstr(&path), ds_cstr(&ranges));
+        }
     }
 
+    ds_destroy(&path);
+    ds_destroy(&ranges);
+}
+
+void save_bridges_running(struct shash *bridges, write_batch_t *batch)
+{
+    struct shash_node *br_node = NULL;
+    bridge_t *br = NULL;
+    struct ds path = DS_EMPTY_INITIALIZER;
+    sr_val_t val = {0};
+    int vid;
+
     SHASH_FOR_EACH(br_node, bridges) {
         br = (bridge_t*)br_node->data;
 
@@ -219,13 +374,7 @@ void save_bridges(struct shash *bridges, sr_session_ctx_t *session)
                       br->name);
         val.type = SR_STRING_T;
         val.data.string_val = to_ieee_mac_addr(br->hw_addr);
-        rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-        if (rc != SR_ERR_OK) {
-            log_error("Set %s=%s failed: %s",
-                      ds_cstr(&path),
-                      val.data.string_val,
-                      sr_strerror(rc));
-        }
+        write_batch_set(batch, ds_cstr(&path), &val);
 
         ds_clear(&path);
         ds_put_format(&path,
@@ -233,60 +382,78 @@ void save_bridges(struct shash *bridges, sr_session_ctx_t *session)
                       br->name);
         val.type = SR_IDENTITYREF_T;
         val.data.identityref_val = "provider-edge-bridge";
-        rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-        if (rc != SR_ERR_OK) {
-            log_error("Set %s=%s failed: %s",
-                      ds_cstr(&path),
-                      val.data.identityref_val,
-                      sr_strerror(rc));
-        }
-
-        for (int i = 0; i < VLAN_BITMAP_MAX; i++) {
-            if (br->vlan.vlan_bitmap[i] != 0) {
-                char vlan_name[16] = {0};
-                snprintf(vlan_name, 16, "vlan%d", br->vlan.vlan_bitmap[i]);
-
-                ds_clear(&path);
-                ds_put_format(&path,
-                              "/ieee802-dot1q-bridge:bridges/bridge[name='%s']/component[name='%s']/type",
-                              br->name,
-                              vlan_name);
-                val.type = SR_IDENTITYREF_T;
-                val.data.identityref_val = "edge-relay-component";
-                rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-                if (rc != SR_ERR_OK) {
-                    log_error("Set %s=%s failed: %s",
-                              ds_cstr(&path),
-                              val.data.identityref_val,
-                              sr_strerror(rc));
-                }
-
-                ds_clear(&path);
-                ds_put_format(&path,
-                              "/ieee802-dot1q-bridge:bridges/bridge[name='%s']/component[name='%s']/bridge-vlan/vlan[vid='%d']/name",
-                              br->name,
-                              vlan_name,
-                              br->vlan.vlan_bitmap[i]);
-                val.type = SR_STRING_T;
-                val.data.string_val = vlan_name;
-                rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-                if (rc != SR_ERR_OK) {
-                    log_error("Set %s=%s failed: %s",
-                              ds_cstr(&path),
-                              vlan_name,
-                              sr_strerror(rc));
-                }
-            } else {
-                break;
-            }
+        write_batch_set(batch, ds_cstr(&path), &val);
+
+        /* The entries of a VLAN-unaware bridge have no VLAN, they are
+         * served in a component named after the bridge. */
+        if (!br->vlan_filtering) {
+            ds_clear(&path);
+            ds_put_format(&path,
+                          "/ieee802-dot1q-bridge:bridges/bridge[name='%s']/component[name='%s']/type",
+                          br->name,
+                          br->name);
+            val.type = SR_IDENTITYREF_T;
+            val.data.identityref_val = "edge-relay-component";
+            write_batch_set(batch, ds_cstr(&path), &val);
         }
 
-        rc = sr_apply_changes(session, 0);
-        if (rc != SR_ERR_OK) {
-            log_error("Set bridge's address and type apply failed: %s", sr_strerror(rc));
-            sr_discard_changes(session);
+        VLAN_BITMAP_FOR_EACH (vid, &br->vlan.vlans) {
+            char vlan_name[16] = {0};
+            snprintf(vlan_name, 16, "vlan%d", vid);
+
+            ds_clear(&path);
+            ds_put_format(&path,
+                          "/ieee802-dot1q-bridge:bridges/bridge[name='%s']/component[name='%s']/type",
+                          br->name,
+                          vlan_name);
+            val.type = SR_IDENTITYREF_T;
+            val.data.identityref_val = "edge-relay-component";
+            write_batch_set(batch, ds_cstr(&path), &val);
+
+            ds_clear(&path);
+            ds_put_format(&path,
+                          "/ieee802-dot1q-bridge:bridges/bridge[name='%s']/component[name='%s']/bridge-vlan/vlan[vid='%d']/name",
+                          br->name,
+                          vlan_name,
+                          vid);
+            val.type = SR_STRING_T;
+            val.data.string_val = vlan_name;
+            write_batch_set(batch, ds_cstr(&path), &val);
         }
     }
 
     ds_destroy(&path);
 }
+
+void save_bridges_operational(struct shash *bridges, write_batch_t *batch)
+{
+    struct shash_node *br_node = NULL;
+
+    SHASH_FOR_EACH(br_node, bridges) {
+        save_bridge_ports((bridge_t*)br_node->data, batch);
+    }
+}
+
+void bridge_component_name(char *name, size_t size, const char *bridge, int vid)
+{
+    if (vid != 0) {
+        snprintf(name, size, "vlan%d", vid);
+    } else {
+        snprintf(name, size, "%s", bridge);
+    }
+}
+
+int bridge_component_vid(const char *component, const char *bridge)
+{
+    int vid;
+    char end;
+
+    if (bridge != NULL && strcmp(component, bridge) == 0) {
+        return 0;
+    }
+    if (sscanf(component, "vlan%d%c", &vid, &end) != 1 || vid <= 0 || vid >= 4095) {
+        return -1;
+    }
+
+    return vid;
+}
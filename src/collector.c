@@ -0,0 +1,200 @@
+#include "collector.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "log.h"
+#include "util.h"
+
+/* Log the ratio of fresh reads every so many gets. */
+#define COLLECTOR_LOG_INTERVAL 1000
+
+#define IDLE_US (COLLECTOR_IDLE_MS * 1000ul)
+
+static struct list_node collectors = LIST_INITIALIZER(&collectors);
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static bool running = false;
+static _Atomic bool sleeping = false;   /* Until a get wakes the thread. */
+
+void collector_set_period(struct collector *c, unsigned int period_ms)
+{
+    c->period_ms = period_ms > 0 ? period_ms : 1;
+}
+
+static void collect(struct collector *c)
+{
+    if (c->collect(c->aux) == 0) {
+        atomic_store(&c->collected_us, get_monotonic_us());
+    }
+    c->next_us = get_monotonic_us() + c->period_ms * 1000ul;
+}
+
+void collector_add(struct collector *c, void *aux)
+{
+    c->aux = aux;
+    collect(c);
+
+    pthread_mutex_lock(&mutex);
+    list_push_back(&collectors, &c->node);
+    pthread_mutex_unlock(&mutex);
+}
+
+static bool is_active(struct collector *c, uint64_t now)
+{
+    return now - atomic_load(&c->read_us) <= IDLE_US;
+}
+
+/* Collects the active collectors that are due, without holding the mutex
+ * while it collects.  Returns when the next one is due, or 0 if all of them
+ * are idle. */
+static uint64_t collect_due()
+{
+    struct collector *c;
+    uint64_t now, next = 0;
+
+    LIST_FOR_EACH (c, node, &collectors) {
+        now = get_monotonic_us();
+        if (!is_active(c, now)) {
+            continue;
+        }
+
+        if (c->next_us <= now) {
+            pthread_mutex_unlock(&mutex);
+            collect(c);
+            pthread_mutex_lock(&mutex);
+        }
+
+        if (next == 0 || c->next_us < next) {
+            next = c->next_us;
+        }
+    }
+
+    return next;
+}
+
+static bool any_active()
+{
+    struct collector *c;
+    uint64_t now = get_monotonic_us();
+
+    LIST_FOR_EACH (c, node, &collectors) {
+        if (is_active(c, now)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *collector_main(void *arg)
+{
+    struct timespec deadline;
+    uint64_t next;
+
+    pthread_mutex_lock(&mutex);
+    while (running) {
+        next = collect_due();
+        if (!running) {
+            break;
+        }
+
+        if (next != 0) {
+            deadline.tv_sec = next / 1000000;
+            deadline.tv_nsec = next % 1000000 * 1000;
+            pthread_cond_timedwait(&wake, &mutex, &deadline);
+            continue;
+        }
+
+        /* A get marks its collector read before it looks at 'sleeping', so
+         * either the check below sees the read, or the get sees 'sleeping'
+         * and signals, which it can only do once the thread waits. */
+        atomic_store(&sleeping, true);
+        if (!any_active()) {
+            pthread_cond_wait(&wake, &mutex);
+        }
+        atomic_store(&sleeping, false);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return NULL;
+}
+
+int collector_start()
+{
+    pthread_condattr_t attr;
+
+    /* The deadlines are get_monotonic_us() values. */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    running = true;
+    if (pthread_create(&thread, NULL, collector_main, NULL) != 0) {
+        log_error("Create collector thread failed");
+        running = false;
+        pthread_cond_destroy(&wake);
+        return -1;
+    }
+
+    log_info("Collect %lu snapshots while they are read",
+             (unsigned long)list_size(&collectors));
+    return 0;
+}
+
+static void log_ratio(struct collector *c)
+{
+    uint64_t n_reads = atomic_load(&c->n_reads);
+    uint64_t n_fresh = atomic_load(&c->n_fresh);
+
+    log_info("%s: %"PRIu64" gets, %"PRIu64" found a fresh snapshot, ratio %"PRIu64"%%",
+             c->name, n_reads, n_fresh, n_reads ? n_fresh * 100 / n_reads : 0);
+}
+
+void collector_stop()
+{
+    struct collector *c;
+
+    if (!running) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    running = false;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&mutex);
+
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&wake);
+
+    LIST_FOR_EACH (c, node, &collectors) {
+        log_ratio(c);
+    }
+    list_init(&collectors);
+}
+
+void collector_read(struct collector *c)
+{
+    uint64_t now = get_monotonic_us();
+    uint64_t last, n_reads;
+
+    last = atomic_exchange(&c->read_us, now);
+
+    n_reads = atomic_fetch_add(&c->n_reads, 1) + 1;
+    if (now - atomic_load(&c->collected_us) <= 2 * c->period_ms * 1000ul) {
+        atomic_fetch_add(&c->n_fresh, 1);
+    }
+    if (n_reads % COLLECTOR_LOG_INTERVAL == 0) {
+        log_ratio(c);
+    }
+
+    /* An idle collector is not in the deadline the thread waits for. */
+    if (atomic_load(&sleeping) || now - last > IDLE_US) {
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+    }
+}
@@ -2,20 +2,163 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+
+#include "dbus_util.h"
+#include "reactor.h"
+
+static DBusConnection* conn = NULL;
+
+static void dispatch()
+{
+    while (dbus_connection_dispatch(conn) == DBUS_DISPATCH_DATA_REMAINS) {
+        continue;
+    }
+}
 
 /**
- * Call a method on a remote object
+ * Watches: libdbus watches its socket for reading and for writing with two
+ * watches, each gets its own dup of the socket so both fit in the epoll set
  */
-void dbus_query(char* param)
+static uint32_t watch_events(DBusWatch* watch)
 {
-    DBusMessage* msg;
-    DBusMessageIter args;
-    DBusConnection* conn;
-    DBusError err;
-    DBusPendingCall* pending;
-    int ret;
+    unsigned int flags;
+    uint32_t events = 0;
 
-    printf("Calling remote method with %s\n", param);
+    if (!dbus_watch_get_enabled(watch)) {
+        return 0;
+    }
+
+    flags = dbus_watch_get_flags(watch);
+    if (flags & DBUS_WATCH_READABLE) {
+        events |= EPOLLIN;
+    }
+    if (flags & DBUS_WATCH_WRITABLE) {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+static void watch_cb(int fd, uint32_t events, void* aux)
+{
+    unsigned int flags = 0;
+
+    if (events & EPOLLIN) {
+        flags |= DBUS_WATCH_READABLE;
+    }
+    if (events & EPOLLOUT) {
+        flags |= DBUS_WATCH_WRITABLE;
+    }
+    if (events & EPOLLERR) {
+        flags |= DBUS_WATCH_ERROR;
+    }
+    if (events & EPOLLHUP) {
+        flags |= DBUS_WATCH_HANGUP;
+    }
+
+    dbus_watch_handle((DBusWatch*)aux, flags);
+    dispatch();
+}
+
+static dbus_bool_t add_watch(DBusWatch* watch, void* data)
+{
+    int* fd = malloc(sizeof(*fd));
+
+    if (NULL == fd) {
+        return FALSE;
+    }
+
+    *fd = dup(dbus_watch_get_unix_fd(watch));
+    if (*fd < 0 || reactor_add_fd(*fd, watch_events(watch), watch_cb, watch) != 0) {
+        fprintf(stderr, "Add D-Bus watch failed\n");
+        if (*fd >= 0) {
+            close(*fd);
+        }
+        free(fd);
+        return FALSE;
+    }
+
+    dbus_watch_set_data(watch, fd, free);
+    return TRUE;
+}
+
+static void remove_watch(DBusWatch* watch, void* data)
+{
+    int* fd = dbus_watch_get_data(watch);
+
+    if (NULL != fd) {
+        reactor_del_fd(*fd);
+        close(*fd);
+        dbus_watch_set_data(watch, NULL, NULL);
+    }
+}
+
+static void toggle_watch(DBusWatch* watch, void* data)
+{
+    int* fd = dbus_watch_get_data(watch);
+
+    if (NULL != fd) {
+        reactor_mod_fd(*fd, watch_events(watch));
+    }
+}
+
+/**
+ * Timeouts: one timerfd each, repeating while enabled
+ */
+static void timeout_cb(void* aux)
+{
+    dbus_timeout_handle((DBusTimeout*)aux);
+    dispatch();
+}
+
+static void arm_timeout(DBusTimeout* timeout)
+{
+    struct reactor_timer* timer = dbus_timeout_get_data(timeout);
+    int interval = dbus_timeout_get_interval(timeout);
+
+    if (interval < 1) {
+        interval = 1;
+    }
+
+    if (dbus_timeout_get_enabled(timeout)) {
+        reactor_timer_arm(timer, interval, interval);
+    } else {
+        reactor_timer_arm(timer, 0, 0);
+    }
+}
+
+static dbus_bool_t add_timeout(DBusTimeout* timeout, void* data)
+{
+    struct reactor_timer* timer = reactor_timer_create(timeout_cb, timeout);
+
+    if (NULL == timer) {
+        return FALSE;
+    }
+
+    dbus_timeout_set_data(timeout, timer, NULL);
+    arm_timeout(timeout);
+    return TRUE;
+}
+
+static void remove_timeout(DBusTimeout* timeout, void* data)
+{
+    reactor_timer_destroy(dbus_timeout_get_data(timeout));
+    dbus_timeout_set_data(timeout, NULL, NULL);
+}
+
+static void toggle_timeout(DBusTimeout* timeout, void* data)
+{
+    if (NULL != dbus_timeout_get_data(timeout)) {
+        arm_timeout(timeout);
+    }
+}
+
+/**
+ * Connect to the system bus and serve it from the event loop
+ */
+int dbus_util_init()
+{
+    DBusError err;
 
     // initialiset the errors
     dbus_error_init(&err);
@@ -27,60 +170,64 @@ void dbus_query(char* param)
         dbus_error_free(&err);
     }
     if (NULL == conn) {
-        exit(1);
+        return -1;
     }
 
+    // the daemon goes on without the bus
+    dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
     // request our name on the bus
-    ret = dbus_bus_request_name(conn, "com.example.SampleService", 0, &err);
+    dbus_bus_request_name(conn, "com.example.SampleService", 0, &err);
     if (dbus_error_is_set(&err)) {
         fprintf(stderr, "Name Error (%s)\n", err.message);
         dbus_error_free(&err);
     }
 
-    // create a new method call and check for errors
-    msg = dbus_message_new_method_call("com.example.SampleService", // target for the method call
-            "/SomeObject", // object to call on
-            "com.example.SampleInterface", // interface to call on
-            "HelloWorld"); // method name
-    if (NULL == msg) {
-        fprintf(stderr, "Message Null\n");
-        exit(1);
+    if (!dbus_connection_set_watch_functions(conn, add_watch, remove_watch,
+                                             toggle_watch, NULL, NULL) ||
+        !dbus_connection_set_timeout_functions(conn, add_timeout, remove_timeout,
+                                               toggle_timeout, NULL, NULL)) {
+        fprintf(stderr, "Attach D-Bus to event loop failed\n");
+        dbus_util_destroy();
+        return -1;
     }
 
-    // append arguments
-    dbus_message_iter_init_append(msg, &args);
-    if (!dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &param)) {
-        fprintf(stderr, "Out Of Memory!\n");
-        exit(1);
-    }
+    return 0;
+}
 
-    // send message and get a handle for a reply
-    if (!dbus_connection_send_with_reply (conn, msg, &pending, -1)) { // -1 is default timeout
-        fprintf(stderr, "Out Of Memory!\n");
-        exit(1);
-    }
-    if (NULL == pending) {
-        fprintf(stderr, "Pending Call Null\n");
-        exit(1);
+void dbus_util_destroy()
+{
+    if (NULL == conn) {
+        return;
     }
-    dbus_connection_flush(conn);
-
-    printf("Request Sent\n");
 
-    // free message
-    dbus_message_unref(msg);
+    dbus_connection_set_watch_functions(conn, NULL, NULL, NULL, NULL, NULL);
+    dbus_connection_set_timeout_functions(conn, NULL, NULL, NULL, NULL, NULL);
+    dbus_connection_unref(conn);
+    conn = NULL;
+}
 
-    // block until we recieve a reply
-    dbus_pending_call_block(pending);
+/**
+ * Read the reply of dbus_query(), called from the event loop
+ */
+static void reply_cb(DBusPendingCall* pending, void* data)
+{
+    DBusMessage* msg;
+    DBusMessageIter args;
 
     // get the reply message
     msg = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
     if (NULL == msg) {
         fprintf(stderr, "Reply Null\n");
-        exit(1);
+        return;
+    }
+
+    if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_ERROR) {
+        fprintf(stderr, "Reply Error (%s)\n", dbus_message_get_error_name(msg));
+        dbus_message_unref(msg);
+        return;
     }
-    // free the pending message handle
-    dbus_pending_call_unref(pending);
 
     // read the parameters
     if (!dbus_message_iter_init(msg, &args))
@@ -95,7 +242,6 @@ void dbus_query(char* param)
 
             while ((ctype = dbus_message_iter_get_arg_type(&dict)) !=
                     DBUS_TYPE_INVALID) {
-                DBusMessageIter entry;
                 const char *key;
 
                 if (ctype == DBUS_TYPE_STRING) {
@@ -103,14 +249,67 @@ void dbus_query(char* param)
                     fprintf(stderr, "ret_str - %s\n", key);
                 }
 
-                //dbus_message_iter_next(&entry);
                 dbus_message_iter_next(&dict);
             }
         }
     }
 
-    // free reply and close connection
+    // free reply
     dbus_message_unref(msg);
-    dbus_connection_unref(conn);
 }
 
+/**
+ * Call a method on a remote object, the reply is read by reply_cb()
+ */
+void dbus_query(const char* param)
+{
+    DBusMessage* msg;
+    DBusMessageIter args;
+    DBusPendingCall* pending;
+
+    if (NULL == conn) {
+        fprintf(stderr, "Not connected to D-Bus\n");
+        return;
+    }
+
+    printf("Calling remote method with %s\n", param);
+
+    // create a new method call and check for errors
+    msg = dbus_message_new_method_call("com.example.SampleService", // target for the method call
+            "/SomeObject", // object to call on
+            "com.example.SampleInterface", // interface to call on
+            "HelloWorld"); // method name
+    if (NULL == msg) {
+        fprintf(stderr, "Message Null\n");
+        return;
+    }
+
+    // append arguments
+    dbus_message_iter_init_append(msg, &args);
+    if (!dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &param)) {
+        fprintf(stderr, "Out Of Memory!\n");
+        dbus_message_unref(msg);
+        return;
+    }
+
+    // queue the message, it is written once the socket is writable
+    if (!dbus_connection_send_with_reply(conn, msg, &pending, -1)) { // -1 is default timeout
+        fprintf(stderr, "Out Of Memory!\n");
+        dbus_message_unref(msg);
+        return;
+    }
+    dbus_message_unref(msg);
+    if (NULL == pending) {
+        fprintf(stderr, "Pending Call Null\n");
+        return;
+    }
+
+    if (!dbus_pending_call_set_notify(pending, reply_cb, NULL, NULL)) {
+        fprintf(stderr, "Out Of Memory!\n");
+        dbus_pending_call_cancel(pending);
+        dbus_pending_call_unref(pending);
+        return;
+    }
+
+    printf("Request Sent\n");
+}
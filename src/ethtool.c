@@ -0,0 +1,301 @@
+#include "ethtool.h"
+
+#include <net/if.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <linux/ethtool.h>
+#include <linux/ethtool_netlink.h>
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <netlink/genl/ctrl.h>
+
+#include "compiler.h"
+#include "log.h"
+
+static int family = -1;
+
+static struct nl_sock *request_sk = NULL;
+static pthread_mutex_t request_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct nl_sock *monitor_sk = NULL;
+
+struct link_request {
+    ethtool_link_cb cb;
+    ethtool_change_cb changed;  /* For the monitor only. */
+    void *aux;
+};
+
+static struct nl_sock *connect_socket()
+{
+    struct nl_sock *sk;
+    int rc;
+
+    sk = nl_socket_alloc();
+    if (sk == NULL) {
+        log_error("Allocate nl socket failed");
+        return NULL;
+    }
+
+    rc = genl_connect(sk);
+    if (rc != 0) {
+        log_error("Connect to generic netlink failed: %s", nl_geterror(rc));
+        nl_socket_free(sk);
+        return NULL;
+    }
+
+    return sk;
+}
+
+int ethtool_init()
+{
+    int group, rc;
+
+    request_sk = connect_socket();
+    if (request_sk == NULL) {
+        return -1;
+    }
+
+    family = genl_ctrl_resolve(request_sk, ETHTOOL_GENL_NAME);
+    if (family < 0) {
+        log_warn("The kernel has no ethtool netlink family: %s", nl_geterror(family));
+        goto error;
+    }
+
+    monitor_sk = connect_socket();
+    if (monitor_sk == NULL) {
+        goto error;
+    }
+
+    group = genl_ctrl_resolve_grp(request_sk, ETHTOOL_GENL_NAME, ETHTOOL_MCGRP_MONITOR_NAME);
+    if (group < 0) {
+        log_error("Resolve ethtool monitor group failed: %s", nl_geterror(group));
+        goto error;
+    }
+
+    nl_socket_disable_seq_check(monitor_sk);
+    rc = nl_socket_add_membership(monitor_sk, group);
+    if (rc != 0) {
+        log_error("Join ethtool monitor group failed: %s", nl_geterror(rc));
+        goto error;
+    }
+    nl_socket_set_nonblocking(monitor_sk);
+
+    return 0;
+
+error:
+    ethtool_destroy();
+    return -1;
+}
+
+void ethtool_destroy()
+{
+    if (monitor_sk != NULL) {
+        nl_close(monitor_sk);
+        nl_socket_free(monitor_sk);
+        monitor_sk = NULL;
+    }
+
+    pthread_mutex_lock(&request_mutex);
+    if (request_sk != NULL) {
+        nl_close(request_sk);
+        nl_socket_free(request_sk);
+        request_sk = NULL;
+    }
+    pthread_mutex_unlock(&request_mutex);
+
+    family = -1;
+}
+
+bool ethtool_available()
+{
+    return family >= 0;
+}
+
+/* Parses an ETHTOOL_MSG_LINKMODES_GET_REPLY or _NTF. */
+static int link_modes_cb(struct nl_msg *msg, void *arg)
+{
+    struct link_request *request = (struct link_request*)arg;
+    struct nlattr *tb[ETHTOOL_A_LINKMODES_MAX + 1];
+    struct nlattr *header[ETHTOOL_A_HEADER_MAX + 1];
+    struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+    struct ethtool_link link = {SPEED_UNKNOWN, DUPLEX_UNKNOWN};
+
+    if (hdr->cmd != ETHTOOL_MSG_LINKMODES_GET_REPLY &&
+        hdr->cmd != ETHTOOL_MSG_LINKMODES_NTF) {
+        return NL_OK;
+    }
+
+    if (genlmsg_parse(nlmsg_hdr(msg), 0, tb, ETHTOOL_A_LINKMODES_MAX, NULL) < 0 ||
+        tb[ETHTOOL_A_LINKMODES_HEADER] == NULL ||
+        nla_parse_nested(header, ETHTOOL_A_HEADER_MAX,
+                         tb[ETHTOOL_A_LINKMODES_HEADER], NULL) < 0 ||
+        header[ETHTOOL_A_HEADER_DEV_NAME] == NULL)
+    {
+        return NL_OK;
+    }
+
+    if (tb[ETHTOOL_A_LINKMODES_SPEED] != NULL) {
+        link.speed = nla_get_u32(tb[ETHTOOL_A_LINKMODES_SPEED]);
+    }
+
+    if (tb[ETHTOOL_A_LINKMODES_DUPLEX] != NULL) {
+        link.duplex = nla_get_u8(tb[ETHTOOL_A_LINKMODES_DUPLEX]);
+    }
+
+    request->cb(nla_get_string(header[ETHTOOL_A_HEADER_DEV_NAME]), &link, request->aux);
+    return NL_OK;
+}
+
+/* Sends ETHTOOL_MSG_LINKMODES_GET for port 'name', or for every port if it
+ * is NULL, and hands each reply to 'request'. */
+static int request_link_modes(const char *name, struct link_request *request)
+{
+    struct nl_msg *msg;
+    struct nlattr *header;
+    int rc;
+
+    msg = nlmsg_alloc();
+    if (msg == NULL) {
+        return -NLE_NOMEM;
+    }
+
+    if (genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, family, 0,
+                    name == NULL ? NLM_F_DUMP : 0,
+                    ETHTOOL_MSG_LINKMODES_GET, ETHTOOL_GENL_VERSION) == NULL) {
+        rc = -NLE_NOMEM;
+        goto out;
+    }
+
+    /* The supported and advertised modes are not needed, compact bitsets
+     * keep the replies small. */
+    header = nla_nest_start(msg, ETHTOOL_A_LINKMODES_HEADER);
+    if (name != NULL) {
+        NLA_PUT_STRING(msg, ETHTOOL_A_HEADER_DEV_NAME, name);
+    }
+    NLA_PUT_U32(msg, ETHTOOL_A_HEADER_FLAGS, ETHTOOL_FLAG_COMPACT_BITSETS);
+    nla_nest_end(msg, header);
+
+    pthread_mutex_lock(&request_mutex);
+    if (request_sk == NULL) {
+        rc = -NLE_BAD_SOCK;
+    } else {
+        nl_socket_modify_cb(request_sk, NL_CB_VALID, NL_CB_CUSTOM, link_modes_cb, request);
+        rc = nl_send_auto(request_sk, msg);
+        if (rc >= 0) {
+            rc = nl_recvmsgs_default(request_sk);
+        }
+    }
+    pthread_mutex_unlock(&request_mutex);
+    goto out;
+
+nla_put_failure:
+    rc = -NLE_NOMEM;
+out:
+    nlmsg_free(msg);
+    return rc;
+}
+
+int ethtool_dump_links(ethtool_link_cb cb, void *aux)
+{
+    struct link_request request = {cb, NULL, aux};
+    int rc;
+
+    if (!ethtool_available()) {
+        return -NLE_OBJ_NOTFOUND;
+    }
+
+    rc = request_link_modes(NULL, &request);
+    if (rc < 0) {
+        log_error("Dump ethtool link modes failed: %s", nl_geterror(rc));
+    }
+
+    return rc;
+}
+
+static void copy_link(const char *name UNUSED, const struct ethtool_link *link, void *aux)
+{
+    *(struct ethtool_link*)aux = *link;
+}
+
+int ethtool_get_link(const char *name, struct ethtool_link *link)
+{
+    struct link_request request = {copy_link, NULL, link};
+    int rc;
+
+    if (!ethtool_available()) {
+        return -NLE_OBJ_NOTFOUND;
+    }
+
+    link->speed = SPEED_UNKNOWN;
+    link->duplex = DUPLEX_UNKNOWN;
+
+    rc = request_link_modes(name, &request);
+    if (rc < 0) {
+        log_error("Get ethtool link modes of interface-%s failed: %s",
+                  name, nl_geterror(rc));
+    }
+
+    return rc;
+}
+
+int ethtool_monitor_fd()
+{
+    return monitor_sk != NULL ? nl_socket_get_fd(monitor_sk) : -1;
+}
+
+/* Returns the device name in the header of an ethtool message, or NULL; the
+ * header is attribute 1 of every message. */
+static const char *get_header_dev_name(struct genlmsghdr *hdr)
+{
+    struct nlattr *header[ETHTOOL_A_HEADER_MAX + 1];
+    struct nlattr *attr;
+
+    attr = nla_find(genlmsg_attrdata(hdr, 0), genlmsg_attrlen(hdr, 0),
+                    ETHTOOL_A_CHANNELS_HEADER);
+    if (attr == NULL ||
+        nla_parse_nested(header, ETHTOOL_A_HEADER_MAX, attr, NULL) < 0 ||
+        header[ETHTOOL_A_HEADER_DEV_NAME] == NULL) {
+        return NULL;
+    }
+
+    return nla_get_string(header[ETHTOOL_A_HEADER_DEV_NAME]);
+}
+
+static int monitor_cb(struct nl_msg *msg, void *arg)
+{
+    struct link_request *request = (struct link_request*)arg;
+    struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+    const char *name;
+
+    switch (hdr->cmd) {
+    case ETHTOOL_MSG_LINKMODES_NTF:
+        return link_modes_cb(msg, arg);
+    case ETHTOOL_MSG_CHANNELS_NTF:
+    case ETHTOOL_MSG_PRIVFLAGS_NTF:
+        name = get_header_dev_name(hdr);
+        if (name != NULL) {
+            request->changed(name, request->aux);
+        }
+        break;
+    }
+
+    return NL_OK;
+}
+
+int ethtool_monitor_process(ethtool_link_cb cb, ethtool_change_cb changed, void *aux)
+{
+    struct link_request request = {cb, changed, aux};
+    int rc;
+
+    nl_socket_modify_cb(monitor_sk, NL_CB_VALID, NL_CB_CUSTOM, monitor_cb, &request);
+    rc = nl_recvmsgs_default(monitor_sk);
+    if (rc == -NLE_AGAIN) {
+        return 0;
+    }
+    if (rc < 0) {
+        log_error("Receive ethtool notification failed: %s", nl_geterror(rc));
+    }
+
+    return rc;
+}
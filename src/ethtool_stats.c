@@ -0,0 +1,480 @@
+#include "ethtool_stats.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+#include "collector.h"
+#include "log.h"
+#include "shash.h"
+#include "snapshot.h"
+#include "sset.h"
+#include "util.h"
+#include "worker_pool.h"
+
+/* A cached name is NUL terminated even if it fills ETH_GSTRING_LEN. */
+#define STAT_NAME_LEN (ETH_GSTRING_LEN + 1)
+
+/* GSTATS writes as many values as the driver has now, whatever the buffer
+ * was sized for, so a buffer has room for this many counters more, added
+ * before the change is noticed. */
+#define VALUES_SLACK 64
+
+/* The counter names of a port, never changed once created, so a snapshot
+ * points at them instead of copying them.  The table and every snapshot
+ * with counters of the port hold a reference. */
+struct stat_names {
+    atomic_uint refcount;
+    uint32_t n_stats;
+    char names[];                 /* n_stats * STAT_NAME_LEN. */
+};
+
+struct stats_table {
+    struct stat_names *names;
+    uint64_t checked;             /* 'changes' when the count was checked. */
+    struct ethtool_stats *values; /* Followed by n_stats + VALUES_SLACK values. */
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct shash tables = SHASH_INITIALIZER(&tables);
+static int sockfd = -1;
+
+/* Counted up whenever the counters of some port may have changed, so every
+ * table checks its count once more.  0 is never current. */
+static _Atomic uint64_t changes = 1;
+
+/* Without notifications the count is checked before every dump. */
+static atomic_bool notified = false;
+
+/* Opens the shared socket if it is not yet.  The mutex has to be held. */
+static int open_socket()
+{
+    if (sockfd < 0) {
+        sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) {
+            return -errno;
+        }
+    }
+
+    return 0;
+}
+
+static int ethtool_ioctl(const char *port, void *data)
+{
+    struct ifreq ifr;
+    int rc;
+
+    rc = open_socket();
+    if (rc < 0) {
+        return rc;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, port, sizeof(ifr.ifr_name) - 1);
+    ifr.ifr_data = data;
+
+    return ioctl(sockfd, SIOCETHTOOL, &ifr) < 0 ? -errno : 0;
+}
+
+static struct stat_names *stat_names_ref(struct stat_names *names)
+{
+    atomic_fetch_add_explicit(&names->refcount, 1, memory_order_relaxed);
+    return names;
+}
+
+static void stat_names_unref(struct stat_names *names)
+{
+    if (atomic_fetch_sub_explicit(&names->refcount, 1, memory_order_acq_rel) == 1) {
+        free(names);
+    }
+}
+
+static void stats_table_destroy(struct stats_table *table)
+{
+    if (table == NULL) {
+        return;
+    }
+
+    stat_names_unref(table->names);
+    free(table->values);
+    free(table);
+}
+
+/* Returns the number of driver counters of 'port', 0 if it has none. */
+static uint32_t get_stats_count(const char *port)
+{
+    struct {
+        struct ethtool_sset_info info;
+        uint32_t count;
+    } sset = {0};
+
+    sset.info.cmd = ETHTOOL_GSSET_INFO;
+    sset.info.sset_mask = 1ull << ETH_SS_STATS;
+    if (ethtool_ioctl(port, &sset) < 0 || !(sset.info.sset_mask & (1ull << ETH_SS_STATS))) {
+        return 0;
+    }
+
+    return sset.count;
+}
+
+/* Some drivers report a counter name more than once.  The names are the keys
+ * of the list they are served in, so a repeated one gets a "_N" suffix. */
+static void unique_names(struct stat_names *names)
+{
+    struct sset seen = SSET_INITIALIZER(&seen);
+    char base[STAT_NAME_LEN], suffix[16];
+    char *name;
+    size_t len;
+
+    for (uint32_t i = 0; i < names->n_stats; i++) {
+        name = &names->names[i * STAT_NAME_LEN];
+        memcpy(base, name, STAT_NAME_LEN);
+        for (unsigned int n = 2; sset_contains(&seen, name); n++) {
+            len = snprintf(suffix, sizeof(suffix), "_%u", n);
+            snprintf(name, STAT_NAME_LEN, "%.*s%s",
+                     (int)MIN(strlen(base), STAT_NAME_LEN - 1 - len), base, suffix);
+        }
+        sset_add(&seen, name);
+    }
+
+    sset_destroy(&seen);
+}
+
+static struct stats_table *stats_table_create(const char *port, uint32_t n_stats,
+                                              uint64_t checked)
+{
+    struct ethtool_gstrings *strings = NULL;
+    struct stats_table *table = NULL;
+    struct stat_names *names;
+    int rc;
+
+    /* Like GSTATS, GSTRINGS writes as many names as the driver has now. */
+    strings = xmalloc(sizeof(*strings) + (n_stats + VALUES_SLACK) * ETH_GSTRING_LEN);
+    strings->cmd = ETHTOOL_GSTRINGS;
+    strings->string_set = ETH_SS_STATS;
+    strings->len = n_stats;
+    rc = ethtool_ioctl(port, strings);
+    if (rc < 0) {
+        log_error("Get driver statistics names of interface-%s failed: %s",
+                  port, strerror(-rc));
+        goto out;
+    }
+
+    if (strings->len != n_stats) {
+        /* Changed since the count was read; the next dump reads it again. */
+        goto out;
+    }
+
+    names = xmalloc(sizeof(*names) + n_stats * STAT_NAME_LEN);
+    atomic_init(&names->refcount, 1);
+    names->n_stats = n_stats;
+    for (uint32_t i = 0; i < n_stats; i++) {
+        memcpy(&names->names[i * STAT_NAME_LEN],
+               &strings->data[i * ETH_GSTRING_LEN], ETH_GSTRING_LEN);
+        names->names[i * STAT_NAME_LEN + ETH_GSTRING_LEN] = '\0';
+    }
+    unique_names(names);
+
+    table = xmalloc(sizeof(*table));
+    table->names = names;
+    table->checked = checked;
+    table->values = xmalloc(sizeof(*table->values) +
+                            (n_stats + VALUES_SLACK) * sizeof(uint64_t));
+
+out:
+    free(strings);
+    return table;
+}
+
+/* Fetches the current values of 'port' into 'table'.  Returns -EAGAIN if
+ * the driver has another count than 'table' now. */
+static int fetch_values(const char *port, struct stats_table *table)
+{
+    int rc;
+
+    table->values->cmd = ETHTOOL_GSTATS;
+    table->values->n_stats = table->names->n_stats;
+    rc = ethtool_ioctl(port, table->values);
+    if (rc < 0) {
+        log_error("Get driver statistics of interface-%s failed: %s", port, strerror(-rc));
+        return rc;
+    }
+
+    if (table->values->n_stats != table->names->n_stats) {
+        table->checked = 0;
+        return -EAGAIN;
+    }
+
+    return 0;
+}
+
+/* Returns the table 'port' needs: 'table', maybe NULL, if its count is
+ * still current, otherwise a new table, or NULL if the port has no
+ * counters.  The count is only asked for again after a change. */
+static struct stats_table *check_table(const char *port, struct stats_table *table)
+{
+    uint64_t generation = atomic_load(&changes);
+    uint32_t n_stats;
+
+    if (table != NULL && atomic_load(&notified) && table->checked == generation) {
+        return table;
+    }
+
+    /* The driver changes its counters e.g. when the number of queues is
+     * changed. */
+    n_stats = get_stats_count(port);
+    if (table != NULL && table->names->n_stats == n_stats) {
+        table->checked = generation;
+        return table;
+    }
+
+    return n_stats > 0 ? stats_table_create(port, n_stats, generation) : NULL;
+}
+
+/* Fetches the values of 'port', starting from its cached 'table', maybe
+ * NULL.  Sets '*tablep' to the table used, which is new if it is not
+ * 'table'; the caller then replaces the cached one with it. */
+static int dump_table(const char *port, struct stats_table *table,
+                      struct stats_table **tablep)
+{
+    struct stats_table *current = table, *next;
+    int rc = -EAGAIN;
+
+    /* A count that changed after it was checked shows in the reply; then
+     * it is checked again and the dump retried once. */
+    for (int i = 0; i < 2 && rc == -EAGAIN; i++) {
+        next = check_table(port, current);
+        if (current != table && current != next) {
+            stats_table_destroy(current);
+        }
+        current = next;
+        rc = current != NULL ? fetch_values(port, current) : -EOPNOTSUPP;
+    }
+
+    *tablep = current;
+    return rc;
+}
+
+/* Fetches the current values of 'port' into its table, creating the table
+ * on first use.  The mutex has to be held. */
+static int dump_locked(const char *port, struct stats_table **tablep)
+{
+    struct stats_table *cached = shash_find_data(&tables, port);
+    int rc;
+
+    rc = dump_table(port, cached, tablep);
+    if (*tablep != cached) {
+        stats_table_destroy(shash_find_and_delete(&tables, port));
+        if (*tablep != NULL) {
+            shash_add(&tables, port, *tablep);
+        }
+    }
+
+    return rc;
+}
+
+int ethtool_stats_foreach(const char *port, ethtool_stat_cb cb, void *aux)
+{
+    struct stats_table *table;
+    int rc;
+
+    pthread_mutex_lock(&mutex);
+
+    rc = dump_locked(port, &table);
+    if (rc == 0) {
+        for (uint32_t i = 0; i < table->names->n_stats; i++) {
+            cb(&table->names->names[i * STAT_NAME_LEN], table->values->data[i], aux);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+    return rc;
+}
+
+/* The counters of one port in a snapshot: the values, copied out of its
+ * table, and a reference to the names of the table. */
+struct port_counters {
+    struct stat_names *names;
+    uint64_t values[];            /* names->n_stats. */
+};
+
+static void snapshot_destroy(void *snapshot_)
+{
+    struct shash *snapshot = snapshot_;
+    struct port_counters *counters;
+    struct shash_node *node;
+
+    SHASH_FOR_EACH (node, snapshot) {
+        counters = node->data;
+        stat_names_unref(counters->names);
+        free(counters);
+    }
+    shash_destroy(snapshot);
+    free(snapshot);
+}
+
+static struct snapshot_slot slot = SNAPSHOT_SLOT_INITIALIZER(snapshot_destroy);
+
+static struct port_counters *port_counters_create(const struct stats_table *table)
+{
+    uint32_t n_stats = table->names->n_stats;
+    struct port_counters *counters;
+
+    counters = xmalloc(sizeof(*counters) + n_stats * sizeof(uint64_t));
+    counters->names = stat_names_ref(table->names);
+    memcpy(counters->values, table->values->data, n_stats * sizeof(uint64_t));
+
+    return counters;
+}
+
+/* One port of a refresh.  A worker only touches its own item; the tables it
+ * created are merged into 'tables' after the run. */
+struct port_dump {
+    const char *port;
+    struct stats_table *table;      /* Cached, or the one replacing it. */
+    bool replaced;                  /* 'table', maybe NULL, is new. */
+    struct port_counters *counters; /* NULL if the port has none. */
+};
+
+static void dump_port_cb(size_t idx, void *aux)
+{
+    struct port_dump *dump = &((struct port_dump*)aux)[idx];
+    struct stats_table *cached = dump->table;
+
+    if (dump_table(dump->port, cached, &dump->table) == 0) {
+        dump->counters = port_counters_create(dump->table);
+    }
+    dump->replaced = dump->table != cached;
+}
+
+void ethtool_stats_refresh(const struct sset *ports)
+{
+    struct port_dump *dumps, *dump;
+    struct shash *snapshot;
+    const char *port;
+    size_t n = 0;
+    int rc;
+
+    snapshot = xmalloc(sizeof(*snapshot));
+    shash_init(snapshot);
+    dumps = xmalloc(MAX(sset_count(ports), 1) * sizeof(*dumps));
+
+    /* The mutex keeps the tables to this refresh; the workers themselves
+     * take no lock. */
+    pthread_mutex_lock(&mutex);
+    rc = open_socket();
+    if (rc < 0) {
+        log_error("Open socket for driver statistics failed: %s", strerror(-rc));
+        goto out;
+    }
+
+    SSET_FOR_EACH (port, ports) {
+        dump = &dumps[n++];
+        dump->port = port;
+        dump->table = shash_find_data(&tables, port);
+        dump->replaced = false;
+        dump->counters = NULL;
+    }
+
+    worker_pool_run(n, dump_port_cb, dumps);
+
+    for (size_t i = 0; i < n; i++) {
+        dump = &dumps[i];
+        if (dump->replaced) {
+            stats_table_destroy(shash_find_and_delete(&tables, dump->port));
+            if (dump->table != NULL) {
+                shash_add(&tables, dump->port, dump->table);
+            }
+        }
+        if (dump->counters != NULL) {
+            shash_add(snapshot, dump->port, dump->counters);
+        }
+    }
+
+out:
+    pthread_mutex_unlock(&mutex);
+    free(dumps);
+
+    snapshot_publish(&slot, snapshot);
+}
+
+static int refresh_cb(void *ports)
+{
+    ethtool_stats_refresh(ports);
+    return 0;
+}
+
+static struct collector collector =
+    COLLECTOR_INITIALIZER("Driver statistics", refresh_cb, ETHTOOL_STATS_DEFAULT_PERIOD_MS);
+
+void ethtool_stats_set_period(unsigned int period_ms)
+{
+    collector_set_period(&collector, period_ms);
+}
+
+void ethtool_stats_collect(const struct sset *ports)
+{
+    collector_add(&collector, (void*)ports);
+}
+
+void ethtool_stats_note_read()
+{
+    collector_read(&collector);
+}
+
+bool ethtool_stats_snapshot_foreach(const char *port, ethtool_stat_cb cb, void *aux)
+{
+    const struct shash *snapshot = snapshot_get(&slot);
+    const struct port_counters *counters;
+
+    counters = snapshot != NULL ? shash_find_data(snapshot, port) : NULL;
+    if (counters == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < counters->names->n_stats; i++) {
+        cb(&counters->names->names[i * STAT_NAME_LEN], counters->values[i], aux);
+    }
+    return true;
+}
+
+void ethtool_stats_set_notified(bool notified_)
+{
+    atomic_store(&notified, notified_);
+}
+
+void ethtool_stats_counters_changed()
+{
+    atomic_fetch_add(&changes, 1);
+}
+
+void ethtool_stats_destroy()
+{
+    struct shash_node *node;
+
+    snapshot_slot_clear(&slot);
+
+    pthread_mutex_lock(&mutex);
+
+    SHASH_FOR_EACH (node, &tables) {
+        stats_table_destroy(node->data);
+    }
+    shash_clear(&tables);
+
+    if (sockfd >= 0) {
+        close(sockfd);
+        sockfd = -1;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
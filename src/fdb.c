@@ -0,0 +1,507 @@
+#include "fdb.h"
+
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/if_ether.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+
+#include "bridge.h"
+#include "hash.h"
+#include "hmap.h"
+#include "log.h"
+#include "nl_mirror.h"
+#include "oper_tree.h"
+#include "util.h"
+#include "utils.h"
+
+/* Kernel socket buffer of the notification socket, large enough for a burst
+ * of learning on a busy bridge. */
+#define FDB_EVENT_BUFFER_SIZE (4 * 1024 * 1024)
+
+/* VLAN-unaware bridges report no VLAN.  Their entries are served in the
+ * component named after the bridge, with this VID, as the model has no VID
+ * 0. */
+#define FDB_DEFAULT_VID 1
+
+enum fdb_type {
+    FDB_DYNAMIC,        /* Learned. */
+    FDB_STATIC,         /* Added by management. */
+    FDB_LOCAL,          /* An address of the bridge or of one of its ports. */
+};
+
+struct fdb_key {
+    uint8_t mac[ETH_ALEN];
+    uint16_t vid;
+    int port;           /* ifindex. */
+};
+
+/* Only the address and the VID are hashed, so that the ports an address is
+ * on are found together. */
+#define FDB_HASH_LEN offsetof(struct fdb_key, port)
+
+struct fdb_entry {
+    struct hmap_node node;
+    struct fdb_key key;
+    int bridge;         /* ifindex. */
+    enum fdb_type type;
+};
+
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static struct hmap entries = HMAP_INITIALIZER(&entries);
+
+static uint32_t key_hash(const struct fdb_key *key)
+{
+    return hash_bytes(key, FDB_HASH_LEN, 0);
+}
+
+static struct fdb_entry *find_entry(const struct hmap *map, const struct fdb_key *key,
+                                    uint32_t hash)
+{
+    struct fdb_entry *entry;
+
+    HMAP_FOR_EACH_WITH_HASH (entry, node, hash, map) {
+        if (memcmp(&entry->key, key, sizeof(*key)) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void clear_entries(struct hmap *map)
+{
+    struct fdb_entry *entry, *next;
+
+    HMAP_FOR_EACH_SAFE (entry, next, node, map) {
+        hmap_remove(map, &entry->node);
+        free(entry);
+    }
+}
+
+/* Parses an RTM_NEWNEIGH or RTM_DELNEIGH of a bridge port into 'entry'.
+ * Returns false for the neighbors of other families and for addresses that
+ * are not on a bridge. */
+static bool parse_neigh(struct nlmsghdr *hdr, struct fdb_entry *entry)
+{
+    struct nlattr *tb[NDA_MAX + 1];
+    struct ndmsg *ndm;
+
+    if (nlmsg_parse(hdr, sizeof(*ndm), tb, NDA_MAX, NULL) < 0) {
+        return false;
+    }
+
+    ndm = nlmsg_data(hdr);
+    if (ndm->ndm_family != AF_BRIDGE || tb[NDA_MASTER] == NULL ||
+        tb[NDA_LLADDR] == NULL || nla_len(tb[NDA_LLADDR]) != ETH_ALEN) {
+        return false;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->key.mac, nla_data(tb[NDA_LLADDR]), ETH_ALEN);
+    entry->key.vid = tb[NDA_VLAN] != NULL ? nla_get_u16(tb[NDA_VLAN]) : 0;
+    entry->key.port = ndm->ndm_ifindex;
+    entry->bridge = nla_get_u32(tb[NDA_MASTER]);
+
+    if (ndm->ndm_state & NUD_PERMANENT) {
+        entry->type = FDB_LOCAL;
+    } else if (ndm->ndm_state & NUD_NOARP) {
+        entry->type = FDB_STATIC;
+    } else {
+        entry->type = FDB_DYNAMIC;
+    }
+
+    return true;
+}
+
+/* Inserts or updates 'parsed' in 'map'. */
+static void update_entry(struct hmap *map, const struct fdb_entry *parsed)
+{
+    uint32_t hash = key_hash(&parsed->key);
+    struct fdb_entry *entry = find_entry(map, &parsed->key, hash);
+
+    if (entry == NULL) {
+        entry = xmalloc(sizeof(*entry));
+        entry->key = parsed->key;
+        hmap_insert(map, &entry->node, hash);
+    }
+    entry->bridge = parsed->bridge;
+    entry->type = parsed->type;
+}
+
+/* Applies an RTM_NEWNEIGH ('add') or an RTM_DELNEIGH to 'map'. */
+static void apply_neigh(struct nlmsghdr *hdr, struct hmap *map, bool add)
+{
+    struct fdb_entry parsed, *entry;
+
+    if (!parse_neigh(hdr, &parsed)) {
+        return;
+    }
+
+    if (add) {
+        update_entry(map, &parsed);
+    } else {
+        entry = find_entry(map, &parsed.key, key_hash(&parsed.key));
+        if (entry != NULL) {
+            hmap_remove(map, &entry->node);
+            free(entry);
+        }
+    }
+}
+
+static size_t count_entries(const struct hmap *map)
+{
+    return hmap_count(map);
+}
+
+static const struct ndmsg dump_hdr = { .ndm_family = AF_BRIDGE };
+
+static struct nl_mirror mirror = {
+    .name = "FDB",
+    .unit = "entries",
+    .group = RTNLGRP_NEIGH,
+    .buffer_size = FDB_EVENT_BUFFER_SIZE,
+    .dump_type = RTM_GETNEIGH,
+    .dump_hdr = &dump_hdr,
+    .dump_hdr_len = sizeof(dump_hdr),
+    .new_type = RTM_NEWNEIGH,
+    .del_type = RTM_DELNEIGH,
+    .table = &entries,
+    .rwlock = &rwlock,
+    .apply = apply_neigh,
+    .clear = clear_entries,
+    .count = count_entries,
+};
+
+int fdb_init()
+{
+    return nl_mirror_init(&mirror);
+}
+
+void fdb_destroy()
+{
+    nl_mirror_destroy(&mirror);
+}
+
+int fdb_get_fd()
+{
+    return nl_mirror_get_fd(&mirror);
+}
+
+void fdb_process()
+{
+    nl_mirror_process(&mirror);
+}
+
+size_t fdb_count()
+{
+    size_t count;
+
+    pthread_rwlock_rdlock(&rwlock);
+    count = hmap_count(&entries);
+    pthread_rwlock_unlock(&rwlock);
+
+    return count;
+}
+
+/* What a get asks for, -1 where it does not restrict.  'vid' is the VID as
+ * the kernel reports it, 0 for a VLAN-unaware bridge. */
+struct fdb_filter {
+    int bridge;
+    int vid;
+    bool by_address;
+    uint8_t mac[ETH_ALEN];
+};
+
+/* The bridges and components that the entries of one get were added to, so
+ * that each is only created once.  A bridge is cached with 'vid' -1. */
+struct fdb_component {
+    struct hmap_node node;
+    int bridge;
+    int vid;
+    struct lyd_node *dnode;
+};
+
+struct fdb_request {
+    const struct ly_ctx *ly_ctx;
+    struct lyd_node **parent;
+    struct lyd_node *fdb;       /* Set if sysrepo asks for one component. */
+    struct hmap components;
+};
+
+static int entry_vid(const struct fdb_entry *entry)
+{
+    return entry->key.vid != 0 ? entry->key.vid : FDB_DEFAULT_VID;
+}
+
+static bool parse_mac(const char *str, uint8_t mac[ETH_ALEN])
+{
+    unsigned int b[ETH_ALEN];
+    char sep[ETH_ALEN - 1];
+
+    if (sscanf(str, "%2x%c%2x%c%2x%c%2x%c%2x%c%2x",
+               &b[0], &sep[0], &b[1], &sep[1], &b[2], &sep[2],
+               &b[3], &sep[3], &b[4], &sep[4], &b[5]) != 11) {
+        return false;
+    }
+
+    for (int i = 0; i < ETH_ALEN; i++) {
+        mac[i] = b[i];
+    }
+    return true;
+}
+
+/* Fills 'filter' from the component sysrepo hands in as 'parent', or else
+ * from the keys in 'request_xpath'.  Returns false if nothing can match. */
+static bool build_filter(const char *request_xpath, const struct lyd_node *parent,
+                         struct fdb_filter *filter)
+{
+    char *bridge = NULL, *component = NULL, *address = NULL;
+    const char *key;
+    bool ok = true;
+
+    filter->bridge = -1;
+    filter->vid = -1;
+    filter->by_address = false;
+
+    for (; parent != NULL; parent = lyd_parent(parent)) {
+        if ((key = oper_tree_list_key(parent, "component")) != NULL) {
+            component = strdup(key);
+        } else if ((key = oper_tree_list_key(parent, "bridge")) != NULL) {
+            bridge = strdup(key);
+        }
+    }
+
+    if (bridge == NULL) {
+        bridge = get_xpath_key(request_xpath, "bridge", "name");
+    }
+    if (component == NULL) {
+        component = get_xpath_key(request_xpath, "component", "name");
+    }
+    address = get_xpath_key(request_xpath, "filtering-entry", "address");
+
+    if (bridge != NULL) {
+        filter->bridge = if_nametoindex(bridge);
+        ok = filter->bridge != 0;
+    }
+    if (ok && component != NULL) {
+        filter->vid = bridge_component_vid(component, bridge);
+        ok = filter->vid >= 0;
+    }
+    if (ok && address != NULL) {
+        filter->by_address = true;
+        ok = parse_mac(address, filter->mac);
+    }
+
+    free(bridge);
+    free(component);
+    free(address);
+    return ok;
+}
+
+static bool filter_match(const struct fdb_filter *filter, const struct fdb_entry *entry)
+{
+    return (filter->bridge < 0 || entry->bridge == filter->bridge) &&
+           (filter->vid < 0 || entry->key.vid == filter->vid) &&
+           (!filter->by_address || memcmp(entry->key.mac, filter->mac, ETH_ALEN) == 0);
+}
+
+static bool same_group(const struct fdb_entry *a, const struct fdb_entry *b)
+{
+    return a->bridge == b->bridge && a->key.vid == b->key.vid &&
+           memcmp(a->key.mac, b->key.mac, ETH_ALEN) == 0;
+}
+
+static struct lyd_node *cached_node(const struct fdb_request *req, int bridge, int vid)
+{
+    struct fdb_component *c;
+
+    HMAP_FOR_EACH_WITH_HASH (c, node, hash_int(vid, hash_int(bridge, 0)), &req->components) {
+        if (c->bridge == bridge && c->vid == vid) {
+            return c->dnode;
+        }
+    }
+    return NULL;
+}
+
+static void cache_node(struct fdb_request *req, int bridge, int vid, struct lyd_node *dnode)
+{
+    struct fdb_component *c = xmalloc(sizeof(*c));
+
+    c->bridge = bridge;
+    c->vid = vid;
+    c->dnode = dnode;
+    hmap_insert(&req->components, &c->node, hash_int(vid, hash_int(bridge, 0)));
+}
+
+/* Returns the filtering-database of the component of 'entry', creating the
+ * bridge, component and container on first use. */
+static struct lyd_node *component_fdb(struct fdb_request *req, const struct fdb_entry *entry)
+{
+    struct lyd_node *root, *bridge, *component = NULL, *fdb;
+    char name[IF_NAMESIZE], component_name[IF_NAMESIZE + 8];
+    int vid = entry->key.vid;
+
+    if (req->fdb != NULL) {
+        return req->fdb;
+    }
+
+    fdb = cached_node(req, entry->bridge, vid);
+    if (fdb != NULL) {
+        return fdb;
+    }
+
+    if (if_indextoname(entry->bridge, name) == NULL) {
+        return NULL;
+    }
+
+    bridge_component_name(component_name, sizeof(component_name), name, vid);
+
+    bridge = cached_node(req, entry->bridge, -1);
+    if (bridge == NULL) {
+        root = oper_tree_root(req->ly_ctx, "ieee802-dot1q-bridge", "bridges", req->parent);
+        if (root == NULL ||
+            lyd_new_list(root, NULL, "bridge", 0, &bridge, name) != LY_SUCCESS) {
+            log_error("Create bridge %s node failed", name);
+            return NULL;
+        }
+        cache_node(req, entry->bridge, -1, bridge);
+    }
+
+    if (lyd_new_list(bridge, NULL, "component", 0, &component,
+                     component_name) != LY_SUCCESS) {
+        log_error("Create component %s of bridge %s failed", component_name, name);
+        return NULL;
+    }
+
+    fdb = oper_tree_add_container(component, "filtering-database");
+    cache_node(req, entry->bridge, vid, fdb);
+
+    return fdb;
+}
+
+static void add_port_map(struct lyd_node *filtering_entry, const struct fdb_entry *entry)
+{
+    struct lyd_node *port_map = NULL, *map_type;
+    char port[16];
+
+    snprintf(port, sizeof(port), "%d", entry->key.port);
+    if (lyd_new_list(filtering_entry, NULL, "port-map", 0, &port_map, port) != LY_SUCCESS) {
+        log_error("Create port-map %s node failed", port);
+        return;
+    }
+
+    map_type = oper_tree_add_container(port_map, entry->type == FDB_DYNAMIC
+                                                 ? "dynamic-filtering-entries"
+                                                 : "static-filtering-entries");
+    oper_tree_add_str(map_type, "control-element", "forward");
+}
+
+/* Adds the filtering-entry of the address and VID of 'entry', with a port
+ * map for each of the ports it is on.  Only the first entry of the group in
+ * the hash chain adds it; the others are skipped when the walk gets to
+ * them. */
+static void add_filtering_entry(struct fdb_request *req, const struct fdb_entry *entry)
+{
+    static const char *status[] = {
+        [FDB_DYNAMIC] = "learned",
+        [FDB_STATIC] = "mgmt",
+        [FDB_LOCAL] = "self",
+    };
+    const struct fdb_entry *other;
+    struct lyd_node *fdb, *filtering_entry = NULL;
+    char address[18], vids[8];
+    const uint8_t *mac = entry->key.mac;
+
+    HMAP_FOR_EACH_WITH_HASH (other, node, entry->node.hash, &entries) {
+        if (same_group(entry, other)) {
+            if (other != entry) {
+                return;
+            }
+            break;
+        }
+    }
+
+    fdb = component_fdb(req, entry);
+    if (fdb == NULL) {
+        return;
+    }
+
+    snprintf(address, sizeof(address), "%02X-%02X-%02X-%02X-%02X-%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    snprintf(vids, sizeof(vids), "%d", entry_vid(entry));
+    if (lyd_new_list(fdb, NULL, "filtering-entry", 0, &filtering_entry,
+                     "1", vids, address) != LY_SUCCESS) {
+        log_error("Create filtering-entry %s/%s node failed", vids, address);
+        return;
+    }
+
+    oper_tree_add_str(filtering_entry, "entry-type",
+                      entry->type == FDB_DYNAMIC ? "dynamic" : "static");
+    oper_tree_add_str(filtering_entry, "status", status[entry->type]);
+
+    HMAP_FOR_EACH_WITH_HASH (other, node, entry->node.hash, &entries) {
+        if (same_group(entry, other)) {
+            add_port_map(filtering_entry, other);
+        }
+    }
+}
+
+void bridge_filtering_database_provider(sr_session_ctx_t *session,
+                                        const char *request_xpath,
+                                        struct lyd_node **parent)
+{
+    struct fdb_request req = {
+        .parent = parent,
+        .components = HMAP_INITIALIZER(&req.components),
+    };
+    struct fdb_component *c, *next;
+    struct fdb_filter filter;
+    const struct fdb_entry *entry;
+    struct fdb_key key;
+
+    if (!build_filter(request_xpath, *parent, &filter)) {
+        return;
+    }
+
+    req.ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+
+    if (*parent != NULL && strcmp(LYD_NAME(*parent), "component") == 0) {
+        req.fdb = oper_tree_add_container(*parent, "filtering-database");
+    }
+
+    pthread_rwlock_rdlock(&rwlock);
+
+    if (filter.by_address && filter.vid >= 0) {
+        /* A single address is looked up by its hash. */
+        memcpy(key.mac, filter.mac, ETH_ALEN);
+        key.vid = filter.vid;
+        HMAP_FOR_EACH_WITH_HASH (entry, node, hash_bytes(&key, FDB_HASH_LEN, 0), &entries) {
+            if (filter_match(&filter, entry)) {
+                add_filtering_entry(&req, entry);
+            }
+        }
+    } else {
+        HMAP_FOR_EACH (entry, node, &entries) {
+            if (filter_match(&filter, entry)) {
+                add_filtering_entry(&req, entry);
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&rwlock);
+
+    HMAP_FOR_EACH_SAFE (c, next, node, &req.components) {
+        hmap_remove(&req.components, &c->node);
+        free(c);
+    }
+    hmap_destroy(&req.components);
+
+    sr_release_context(sr_session_get_connection(session));
+}
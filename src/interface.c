@@ -24,41 +24,22 @@
 #include <netlink/route/link/bridge.h>
 #include <sysrepo.h>
 
+#include "ethtool.h"
+#include "ethtool_stats.h"
+#include "link_cache.h"
 #include "log.h"
+#include "oper_tree.h"
+#include "repo.h"
+#include "sampler.h"
+#include "snapshot.h"
+#include "stats_cache.h"
+#include "worker_pool.h"
 #include "dynamic-string.h"
 #include "sset.h"
 #include "utils.h"
 
 static struct sset *interface_names = NULL;
 
-inline struct interface *interface_create()
-{
-    struct interface *intf = (struct interface*)calloc(1, sizeof(struct interface));
-    memset(intf, 0, sizeof(struct interface));
-    return intf;
-}
-
-void interface_destroy(struct interface *intf)
-{
-    if (intf == NULL) {
-        return;
-    }
-
-    if (intf->name != NULL) {
-        free(intf->name);
-    }
-
-    if (intf->type != NULL) {
-        free(intf->type);
-    }
-
-    if (intf->master_name != NULL) {
-        free(intf->master_name);
-    }
-
-    free(intf);
-}
-
 struct ip *ip_create()
 {
     struct ip *ip = NULL;
@@ -72,7 +53,7 @@ void ip_destory(struct ip *ip)
 {
     struct address *addr, *addr_next;
 
-    if (NULL != ip) {
+    if (NULL == ip) {
         return;
     }
 
@@ -88,6 +69,36 @@ void ip_destory(struct ip *ip)
     free(ip);
 }
 
+inline struct interface *interface_create()
+{
+    struct interface *intf = (struct interface*)calloc(1, sizeof(struct interface));
+    memset(intf, 0, sizeof(struct interface));
+    return intf;
+}
+
+void interface_destroy(struct interface *intf)
+{
+    if (intf == NULL) {
+        return;
+    }
+
+    if (intf->name != NULL) {
+        free(intf->name);
+    }
+
+    if (intf->type != NULL) {
+        free(intf->type);
+    }
+
+    if (intf->master_name != NULL) {
+        free(intf->master_name);
+    }
+
+    ip_destory(intf->published.ip);
+
+    free(intf);
+}
+
 void get_interface_mtu_and_flags(char *name, int *mtu, int *flags)
 {
     int sockfd;
@@ -113,6 +124,7 @@ void get_interface_mtu_and_flags(char *name, int *mtu, int *flags)
     return;
 }
 
+/* The ioctl fallback for kernels without the ethtool netlink family. */
 static void get_interface_speed(char *interface_name, unsigned int *speed)
 {
     int sockfd;
@@ -133,6 +145,7 @@ static void get_interface_speed(char *interface_name, unsigned int *speed)
     edata.cmd = ETHTOOL_GSET;
 
     rc = ioctl(sockfd, SIOCETHTOOL, &ifr);
+    close(sockfd);
     if (rc < 0) {
         log_error("ioctl failed when get interface-%s's speed", interface_name);
         *speed =  -1;
@@ -140,36 +153,79 @@ static void get_interface_speed(char *interface_name, unsigned int *speed)
     }
 
     *speed = ethtool_cmd_speed(&edata);
-    close(sockfd);
 }
 
-void collect_interfaces(struct shash *interfaces)
+static void set_interface_speed(struct interface *intf, uint32_t speed)
 {
-    struct if_nameindex *if_ni, *idx_p;
-    struct nl_sock *sk = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *link = NULL;
-    int status;
-    unsigned int flags = 0, speed = 0;
+    if (speed != (uint32_t)SPEED_UNKNOWN) {
+        intf->speed = (uint64_t)speed * 1000000ul;
+    } else {
+        intf->speed = -1;
+    }
+}
 
-    if_ni = if_nameindex();
+static void set_speed_cb(const char *name, const struct ethtool_link *link, void *aux)
+{
+    struct interface *intf = shash_find_data((struct shash*)aux, name);
 
-    sk = nl_socket_alloc();
-    if (sk == NULL) {
-        log_error("Allocate nl socket failed");
-        return;
+    if (intf != NULL) {
+        set_interface_speed(intf, link->speed);
+    }
+}
+
+/* Returns the data of every node of 'sh' in an array, for the worker
+ * pool.  The caller frees it. */
+static void **shash_data_array(const struct shash *sh)
+{
+    struct shash_node *node;
+    void **array;
+    size_t i = 0;
+
+    array = xmalloc(MAX(shash_count(sh), 1) * sizeof(*array));
+    SHASH_FOR_EACH(node, sh) {
+        array[i++] = node->data;
     }
 
-    status = nl_connect(sk, NETLINK_ROUTE);
-    if (status != 0) {
-        log_error("Connect to nl failed");
-        nl_socket_free(sk);
+    return array;
+}
+
+static void speed_cb(size_t idx, void *aux)
+{
+    struct interface *intf = ((struct interface**)aux)[idx];
+    unsigned int speed;
+
+    get_interface_speed(intf->name, &speed);
+    set_interface_speed(intf, speed);
+}
+
+/* Reads the speed of every interface, with one ethtool dump if the kernel
+ * supports it, else with an ioctl per interface on the worker pool. */
+static void collect_interfaces_speed(struct shash *interfaces)
+{
+    void **intfs;
+
+    if (ethtool_dump_links(set_speed_cb, interfaces) >= 0) {
         return;
     }
 
-    status = rtnl_link_alloc_cache(sk, AF_UNSPEC, &cache);
-    if (status != 0) {
-        log_error("Alloc rtnl link cache failed");
+    intfs = shash_data_array(interfaces);
+    worker_pool_run(shash_count(interfaces), speed_cb, intfs);
+    free(intfs);
+}
+
+void collect_interfaces(struct shash *interfaces)
+{
+    struct if_nameindex *if_ni, *idx_p;
+    struct nl_cache *cache = NULL;
+    struct rtnl_link *link = NULL;
+    unsigned int flags = 0;
+
+    if_ni = if_nameindex();
+
+    link_cache_lock();
+    cache = link_cache_get();
+    if (cache == NULL) {
+        log_error("The rtnl link cache is not available");
         goto cleanup;
     }
 
@@ -203,12 +259,7 @@ void collect_interfaces(struct shash *interfaces)
                 intf->type = strdup(type);
             }
 
-            get_interface_speed(idx_p->if_name, &speed);
-            if (speed != -1) {
-                intf->speed = (uint64_t)speed * 1000000ul;
-            } else {
-                intf->speed = -1;
-            }
+            intf->speed = -1;
 
             int master = rtnl_link_get_master(link);
             if (master != 0) {
@@ -232,14 +283,22 @@ void collect_interfaces(struct shash *interfaces)
     }
 
 cleanup:
-    if (cache != NULL) {
-        nl_cache_free(cache);
-    }
+    link_cache_unlock();
 
-    if (sk != NULL) {
-        nl_close(sk);
-        nl_socket_free(sk);
+    if (if_ni != NULL) {
+        if_freenameindex(if_ni);
     }
+
+    collect_interfaces_speed(interfaces);
+}
+
+static void mtu_and_flags_cb(size_t idx, void *aux)
+{
+    struct ip *ip = ((struct ip**)aux)[idx];
+    int flags = 0;
+
+    get_interface_mtu_and_flags(ip->name, &ip->mtu, &flags);
+    ip->is_up = flags & IFF_UP;
 }
 
 bool collect_ips(struct shash *interfaces, struct shash *ips)
@@ -247,7 +306,7 @@ bool collect_ips(struct shash *interfaces, struct shash *ips)
     struct ifaddrs *addrs, *addr;
     struct ip  *ip = NULL;
     struct address *address = NULL;
-    int flags = 0;
+    void **array;
 
     if (getifaddrs(&addrs) != 0) {
         log_error("Get interface addresses failed");
@@ -265,9 +324,6 @@ bool collect_ips(struct shash *interfaces, struct shash *ips)
             if ((ip = (struct ip*)shash_find_data(ips, addr->ifa_name)) == NULL) {
                 ip = ip_create();
                 ip->name = strdup(addr->ifa_name);
-                flags = 0;
-                get_interface_mtu_and_flags(addr->ifa_name, &ip->mtu, &flags);
-                ip->is_up = flags & IFF_UP;
                 shash_add(ips, addr->ifa_name, (void*)ip);
             }
 
@@ -284,9 +340,6 @@ bool collect_ips(struct shash *interfaces, struct shash *ips)
             if ((ip = (struct ip*)shash_find_data(ips, addr->ifa_name)) == NULL) {
                 ip = ip_create();
                 ip->name = strdup(addr->ifa_name);
-                flags = 0;
-                get_interface_mtu_and_flags(addr->ifa_name, &ip->mtu, &flags);
-                ip->is_up = flags & IFF_UP;
                 shash_add(ips, addr->ifa_name, (void*)ip);
             }
 
@@ -304,90 +357,91 @@ bool collect_ips(struct shash *interfaces, struct shash *ips)
     }
 
     freeifaddrs(addrs);
+
+    /* Two ioctls per interface, the interfaces in parallel. */
+    array = shash_data_array(ips);
+    worker_pool_run(shash_count(ips), mtu_and_flags_cb, array);
+    free(array);
+
     return true;
 }
 
-void save_ips(struct shash *ips, sr_session_ctx_t *session)
+static struct address *ip_find_address(struct ip *ip, bool is_ipv4,
+                                       const char *addr)
 {
-    struct ip *ip = NULL;
-    struct shash_node *node;
-    struct address *address = NULL;
-    struct ds xpath = DS_EMPTY_INITIALIZER;
-    int rc = SR_ERR_OK;
-    sr_val_t val = { 0 };
+    struct address *address;
+
+    if (ip == NULL) {
+        return NULL;
+    }
 
-    //rc = sr_delete_item(session, "/ietf-interfaces:interfaces/interface/ietf-ip:ipv4", SR_EDIT_DEFAULT);
-    //if (rc != SR_ERR_OK) {
-    //    fprintf(stderr, "Delete all interface ipv4 from sysrepo failed: %s\n", sr_strerror(rc));
-    //}
+    LIST_FOR_EACH(address, node, &ip->addresses) {
+        if (address->is_ipv4 == is_ipv4 && strcmp(address->addr, addr) == 0) {
+            return address;
+        }
+    }
 
-    //rc = sr_delete_item(session, "/ietf-interfaces:interfaces/interface/ietf-ip:ipv6", SR_EDIT_DEFAULT);
-    //if (rc != SR_ERR_OK) {
-    //    fprintf(stderr, "Delete all interface ipv6 from sysrepo failed: %s\n", sr_strerror(rc));
-    //}
+    return NULL;
+}
 
-    //rc = sr_apply_changes(session, 0, 0);
-    //if (SR_ERR_OK != rc) {
-    //    fprintf(stderr, "delete ip failed: %s\n", sr_strerror(rc));
-    //}
+static void put_address_path(struct ds *path, const char *name,
+                             const struct address *address)
+{
+    ds_clear(path);
+    ds_put_format(path,
+                  "/ietf-interfaces:interfaces/interface[name='%s']/ietf-ip:%s/address[ip='%s']",
+                  name, address->is_ipv4 ? "ipv4" : "ipv6", address->addr);
+}
 
-    SHASH_FOR_EACH(node, ips) {
-        struct address *addr = NULL;
-        ip = (struct ip*)node->data;
+/* Publishes the difference between the addresses last written for 'intf' and
+ * the freshly collected 'ip', which may be NULL when the interface has no
+ * address left.  Takes ownership of 'ip', it becomes the new snapshot. */
+void save_ips(struct interface *intf, struct ip *ip, write_batch_t *batch)
+{
+    struct ip *old = intf->published.ip;
+    struct address *addr, *old_addr;
+    struct ds xpath = DS_EMPTY_INITIALIZER;
+    sr_val_t val = { 0 };
 
-        ds_clear(&xpath);
-        ds_put_format(&xpath, "/ietf-interfaces:interfaces/interface[name='%s']/ietf-ip:ipv4/mtu", ip->name);
-        val.xpath = ds_cstr(&xpath);
+    if (ip != NULL && ip->mtu != -1 && (old == NULL || old->mtu != ip->mtu)) {
+        ds_put_format(&xpath, "/ietf-interfaces:interfaces/interface[name='%s']/ietf-ip:ipv4/mtu", intf->name);
         val.type = SR_UINT16_T;
         val.data.uint16_val = ip->mtu;
-        rc = sr_set_item(session, ds_cstr(&xpath), &val, SR_EDIT_DEFAULT);
-        if (rc != SR_ERR_OK) {
-            fprintf(stderr, "set path-%s failed: %s\n", ds_cstr(&xpath), sr_strerror(rc));
-        }
-
+        write_batch_set(batch, ds_cstr(&xpath), &val);
+    }
 
+    if (ip != NULL) {
         LIST_FOR_EACH(addr, node, &ip->addresses) {
-            if (addr->is_ipv4) {
-                ds_clear(&xpath);
-                ds_put_format(&xpath,
-                              "/ietf-interfaces:interfaces/interface[name='%s']/ietf-ip:ipv4/address[ip='%s']/prefix-length",
-                              ip->name,
-                              addr->addr);
-                val.type = SR_UINT8_T;
-                val.data.uint8_val = addr->prefix;
-                rc = sr_set_item(session, ds_cstr(&xpath), &val, 0);
-                if (SR_ERR_OK != rc) {
-                    log_error("Set prefix-length failed: %s", sr_strerror(rc));
-                }
-            } else {
-                ds_clear(&xpath);
-                ds_put_format(&xpath,
-                              "/ietf-interfaces:interfaces/interface[name='%s']/ietf-ip:ipv6/address[ip='%s']/prefix-length",
-                              ip->name,
-                              addr->addr);
-                val.type = SR_UINT8_T;
-                val.data.uint8_val = addr->prefix;
-                rc = sr_set_item(session, ds_cstr(&xpath), &val, 0);
-                if (SR_ERR_OK != rc) {
-                    log_error("Set prefix-length failed: %s", sr_strerror(rc));
-                }
+            old_addr = ip_find_address(old, addr->is_ipv4, addr->addr);
+            if (old_addr != NULL && old_addr->prefix == addr->prefix) {
+                continue;
             }
 
-            /* commit the changes */
-            rc = sr_apply_changes(session, 0);
-            if (SR_ERR_OK != rc) {
-                log_error("Set prefix-length apply failed", sr_strerror(rc));
+            put_address_path(&xpath, intf->name, addr);
+            ds_put_cstr(&xpath, "/prefix-length");
+            val.type = SR_UINT8_T;
+            val.data.uint8_val = addr->prefix;
+            write_batch_set(batch, ds_cstr(&xpath), &val);
+        }
+    }
+
+    if (old != NULL) {
+        LIST_FOR_EACH(old_addr, node, &old->addresses) {
+            if (ip_find_address(ip, old_addr->is_ipv4, old_addr->addr) == NULL) {
+                put_address_path(&xpath, intf->name, old_addr);
+                write_batch_delete(batch, ds_cstr(&xpath));
             }
         }
     }
 
-cleanup:
-    return;
+    ip_destory(old);
+    intf->published.ip = ip;
+
+    ds_destroy(&xpath);
 }
 
-void save_interface_running(struct interface *intf, sr_session_ctx_t *session)
+void save_interface_running(struct interface *intf, write_batch_t *batch)
 {
-    int rc = SR_ERR_OK;
     struct ds path = DS_EMPTY_INITIALIZER;
     sr_val_t val = { 0 };
 
@@ -395,25 +449,34 @@ void save_interface_running(struct interface *intf, sr_session_ctx_t *session)
                   intf->name);
     val.type = SR_IDENTITYREF_T;
     val.data.string_val = "iana-if-type:ethernetCsmacd";
-    rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set %s=%s failed: %s", ds_cstr(&path), val.data.string_val,
-                  sr_strerror(rc));
-    }
+    write_batch_set(batch, ds_cstr(&path), &val);
 
-    rc = sr_apply_changes(session, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set interface's type, apply failed: %s", sr_strerror(rc));
-        sr_discard_changes(session);
+    ds_destroy(&path);
+}
+
+/* The operational state the link cache holds for 'name', which the first
+ * RTM_NEWLINK of the interface is compared with. */
+static uint8_t get_interface_oper_state(const char *name)
+{
+    struct nl_cache *cache;
+    struct rtnl_link *link;
+    uint8_t oper_state = IF_OPER_UNKNOWN;
+
+    link_cache_lock();
+    cache = link_cache_get();
+    link = cache != NULL ? rtnl_link_get_by_name(cache, name) : NULL;
+    if (link != NULL) {
+        oper_state = rtnl_link_get_operstate(link);
+        rtnl_link_put(link);
     }
+    link_cache_unlock();
 
-    ds_destroy(&path);
+    return oper_state;
 }
 
 void save_interface_operational(struct interface *interface,
-        sr_session_ctx_t *session)
+        write_batch_t *batch)
 {
-    int rc = SR_ERR_OK;
     struct ds path = DS_EMPTY_INITIALIZER;
     sr_val_t val = {0};
 
@@ -422,20 +485,13 @@ void save_interface_operational(struct interface *interface,
                   interface->name);
     val.type = SR_ENUM_T;
     val.data.enum_val = "up";
-    rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set %s=%s failed: %s", ds_cstr(&path), val.data.enum_val);
-    }
+    write_batch_set(batch, ds_cstr(&path), &val);
 
     ds_clear(&path);
     ds_put_format(&path,
                   "/ietf-interfaces:interfaces/interface[name='%s']/phys-address",
                   interface->name);
-    rc = sr_set_item_str(session, ds_cstr(&path), interface->hw_addr, 0, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set %s=%s failed: %s", ds_cstr(&path),
-                  interface->hw_addr, sr_strerror(rc));
-    }
+    write_batch_set_str(batch, ds_cstr(&path), interface->hw_addr);
 
     ds_clear(&path);
     ds_put_format(&path,
@@ -443,11 +499,7 @@ void save_interface_operational(struct interface *interface,
                   interface->name);
     val.type = SR_INT32_T;
     val.data.int32_val = interface->index;
-    rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set %s=%d failed: %s", ds_cstr(&path),
-                  interface->index, sr_strerror(rc));
-    }
+    write_batch_set(batch, ds_cstr(&path), &val);
 
     ds_clear(&path);
     ds_put_format(&path,
@@ -455,219 +507,286 @@ void save_interface_operational(struct interface *interface,
                   interface->name);
     val.type = SR_UINT64_T;
     val.data.uint64_val = interface->speed;
-    rc = sr_set_item(session, ds_cstr(&path), &val, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set %s=%s failed: %s", ds_cstr(&path), interface->speed, sr_strerror(rc));
-    }
+    write_batch_set(batch, ds_cstr(&path), &val);
 
-    rc = sr_apply_changes(session, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Set interface's speed apply failed: %s", sr_strerror(rc));
-        sr_discard_changes(session);
-    }
+    interface->published.speed = interface->speed;
+    interface->published.flags = interface->flags;
+    interface->published.oper_state = get_interface_oper_state(interface->name);
+    interface->published.valid = true;
 
     ds_destroy(&path);
 }
 
-static inline void add_new_path(
-        const char *format, const char *interface_name, const char *node_name,
-        struct lyd_node *parent, struct rtnl_link *link, rtnl_link_stat_id_t id)
+/* Returns the interfaces a provider has to build.  sysrepo may call the
+ * provider for a single interface entry, or a node below it, as 'parent',
+ * and a request may select one interface by its key; then 'one' is filled
+ * with just that name if it exists.  Otherwise every interface is built.
+ * The caller destroys 'one'. */
+static struct sset *select_interface_names(const char *request_xpath,
+                                           const struct lyd_node *parent,
+                                           struct sset *one)
 {
-    struct ds path = DS_EMPTY_INITIALIZER;
-    char value_str[24] = {0};
+    struct sset *names = get_interface_names();
+    const char *parent_name = NULL;
+    char *requested = NULL;
 
-    ds_put_format(&path, format, interface_name, node_name);
-    sprintf(value_str, "%lu", rtnl_link_get_stat(link, id));
-    lyd_new_path(parent, NULL, ds_cstr(&path), value_str, 0, 0);
+    for (; parent != NULL && parent_name == NULL; parent = lyd_parent(parent)) {
+        parent_name = oper_tree_list_key(parent, "interface");
+    }
 
-    ds_destroy(&path);
+    if (parent_name != NULL) {
+        requested = strdup(parent_name);
+    } else {
+        requested = get_xpath_key(request_xpath, "interface", "name");
+    }
+
+    if (requested == NULL) {
+        return names;
+    }
+
+    if (sset_contains(names, requested)) {
+        sset_add(one, requested);
+    }
+
+    free(requested);
+    return one;
 }
 
-void interface_statistics_provider(sr_session_ctx_t *session, struct lyd_node **parent)
+void interface_statistics_provider(sr_session_ctx_t *session, const char *request_xpath,
+                                   struct lyd_node **parent)
 {
+    struct sset one = SSET_INITIALIZER(&one);
     struct sset *names = NULL;
     const char *name = NULL;
-    struct nl_sock *sk = NULL;
-    struct nl_cache *cache = NULL;
-    struct rtnl_link *link = NULL;
-    int status;
-    struct ds path = DS_EMPTY_INITIALIZER;
-    const char *format = "/ietf-interfaces:interfaces/interface[name='%s']/statistics/%s";
+    const struct stats_snapshot *snapshot = NULL;
+    uint64_t sampled[IF_COUNTER_MAX];
+    const uint64_t *counters;
     char *current = NULL;
-    bool start = true;
     const struct ly_ctx *ly_ctx;
+    struct lyd_node *intf;
+    bool locked = false;
+    unsigned int idx = 0;
 
     ly_ctx = sr_acquire_context(sr_session_get_connection(session));
 
-    sk = nl_socket_alloc();
-    if (sk == NULL) {
-        log_error("Allocate nl socket failed");
-        return;
+    current = get_iso8601_time();
+    names = select_interface_names(request_xpath, *parent, &one);
+    SSET_FOR_EACH(name, names) {
+        /* Counters change without notifications.  The sampler already
+         * reads the ports it samples; the others come from the collector's
+         * last dump.  Neither waits for the kernel. */
+        counters = sampled;
+        if (!sampler_get_counters(name, sampled)) {
+            if (!locked) {
+                idx = snapshot_read_lock();
+                snapshot = stats_cache_current();
+                if (snapshot == NULL) {
+                    log_error("Get interface statistics failed");
+                }
+                locked = true;
+            }
+            counters = snapshot != NULL ? stats_snapshot_find(snapshot, name) : NULL;
+        }
+
+        if (counters != NULL) {
+            intf = oper_tree_interface(ly_ctx, parent, name);
+            oper_tree_interface_statistics(intf, current, counters);
+        }
     }
 
-    status = nl_connect(sk, NETLINK_ROUTE);
-    if (status != 0) {
-        log_error("Connect to nl failed");
-        nl_socket_free(sk);
-        return;
+    if (locked) {
+        snapshot_read_unlock(idx);
     }
+    free(current);
+    sset_destroy(&one);
 
-    status = rtnl_link_alloc_cache(sk, AF_UNSPEC, &cache);
-    if (status != 0) {
-        log_error("Alloc rtnl link cache failed");
-        goto cleanup;
+    sr_release_context(sr_session_get_connection(session));
+}
+
+static void add_driver_counter(const char *name, uint64_t value, void *aux)
+{
+    struct lyd_node *driver = (struct lyd_node*)aux;
+    struct lyd_node *counter = NULL;
+
+    if (lyd_new_list(driver, NULL, "counter", 0, &counter, name) != LY_SUCCESS) {
+        log_error("Create driver counter %s node failed", name);
+        return;
     }
 
-    names = get_interface_names();
+    oper_tree_add_uint64(counter, "value", value);
+}
+
+void interface_driver_statistics_provider(sr_session_ctx_t *session,
+                                          const char *request_xpath,
+                                          struct lyd_node **parent)
+{
+    struct sset one = SSET_INITIALIZER(&one);
+    struct sset *names = NULL;
+    const char *name = NULL;
+    struct lyd_node *intf, *statistics, *driver;
+    const struct ly_ctx *ly_ctx;
+    unsigned int idx;
+
+    ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+
+    ethtool_stats_note_read();
+    idx = snapshot_read_lock();
+
+    names = select_interface_names(request_xpath, *parent, &one);
     SSET_FOR_EACH(name, names) {
-        link = rtnl_link_get_by_name(cache, name);
-        ds_clear(&path);
-        ds_put_format(&path, format, name, "discontinuity-time");
-        current = get_iso8601_time();
-        if (link != NULL) {
-            if (start) {
-//                *parent = lyd_new_path(NULL, sr_get_context(sr_session_get_connection(session)),
-//                                       ds_cstr(&path), current, 0, 0);
-                lyd_new_path(NULL, ly_ctx, ds_cstr(&path), current, 0, parent);
-                start = false;
-            } else {
-                lyd_new_path(*parent, NULL, ds_cstr(&path), current, 0, NULL);
+        /* sysrepo hands in the statistics container of the interface when
+         * it already has one from the statistics provider. */
+        if (*parent != NULL && strcmp(LYD_NAME(*parent), "statistics") == 0) {
+            statistics = *parent;
+        } else {
+            intf = oper_tree_interface(ly_ctx, parent, name);
+            if (intf == NULL || lyd_find_path(intf, "statistics", 0, &statistics) != LY_SUCCESS) {
+                statistics = oper_tree_add_container(intf, "statistics");
             }
-            free(current);
-
-            add_new_path(format, name, "in-octets", *parent, link, RTNL_LINK_RX_BYTES);
-            add_new_path(format, name, "in-unicast-pkts", *parent, link, RTNL_LINK_RX_PACKETS);
-            add_new_path(format, name, "in-errors", *parent, link, RTNL_LINK_RX_ERRORS);
-            add_new_path(format, name, "in-discards", *parent, link, RTNL_LINK_RX_DROPPED);
-            add_new_path(format, name, "out-octets", *parent, link, RTNL_LINK_TX_BYTES);
-            add_new_path(format, name, "out-unicast-pkts", *parent, link, RTNL_LINK_TX_PACKETS);
-            add_new_path(format, name, "out-errors", *parent, link, RTNL_LINK_TX_ERRORS);
-            add_new_path(format, name, "out-discards", *parent, link, RTNL_LINK_TX_DROPPED);
         }
 
-        rtnl_link_put(link);
+        driver = oper_tree_add_augment(ly_ctx, statistics, "tsn-interface-driver-statistics",
+                                       "driver");
+        if (driver == NULL) {
+            continue;
+        }
+
+        if (!ethtool_stats_snapshot_foreach(name, add_driver_counter, driver)) {
+            lyd_free_tree(driver);
+        }
     }
 
-    ds_destroy(&path);
+    snapshot_read_unlock(idx);
+    sset_destroy(&one);
 
-cleanup:
     sr_release_context(sr_session_get_connection(session));
+}
+
+static void add_rate_counters(struct lyd_node *node, uint64_t in_bps, uint64_t in_pps,
+                              uint64_t out_bps, uint64_t out_pps)
+{
+    oper_tree_add_uint64(node, "in-bps", in_bps);
+    oper_tree_add_uint64(node, "in-pps", in_pps);
+    oper_tree_add_uint64(node, "out-bps", out_bps);
+    oper_tree_add_uint64(node, "out-pps", out_pps);
+}
 
-    if (cache != NULL) {
-        nl_cache_free(cache);
+void interface_rates_provider(sr_session_ctx_t *session, const char *request_xpath,
+                              struct lyd_node **parent)
+{
+    struct sset one = SSET_INITIALIZER(&one);
+    struct sset *names = NULL;
+    const char *name = NULL;
+    struct port_rates rates;
+    struct lyd_node *intf, *node;
+    const struct ly_ctx *ly_ctx;
+
+    ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+
+    names = select_interface_names(request_xpath, *parent, &one);
+    SSET_FOR_EACH(name, names) {
+        /* Only reads the sampler's ring, never waits for the kernel. */
+        if (!sampler_get_rates(name, &rates)) {
+            continue;
+        }
+
+        intf = oper_tree_interface(ly_ctx, parent, name);
+        node = oper_tree_add_augment(ly_ctx, intf, "tsn-interface-rates", "rates");
+        oper_tree_add_uint64(node, "sample-period", rates.period_ms);
+        oper_tree_add_uint64(node, "samples", rates.samples);
+        add_rate_counters(node, rates.in_bps, rates.in_pps, rates.out_bps, rates.out_pps);
+
+        node = oper_tree_add_container(node, "peak");
+        add_rate_counters(node, rates.in_peak_bps, rates.in_peak_pps,
+                          rates.out_peak_bps, rates.out_peak_pps);
     }
 
-    if (sk != NULL) {
-        nl_close(sk);
-        nl_socket_free(sk);
+    sset_destroy(&one);
+
+    sr_release_context(sr_session_get_connection(session));
+}
+
+static const char *oper_state_str(uint8_t oper_status)
+{
+    switch (oper_status) {
+        case IF_OPER_UP:
+            return "up";
+        case IF_OPER_DOWN:
+            return "down";
+        case IF_OPER_TESTING:
+            return "testing";
+        case IF_OPER_UNKNOWN:
+            return "unknown";
+        case IF_OPER_DORMANT:
+            return "dormant";
+        case IF_OPER_NOTPRESENT:
+            return "not-present";
+        case IF_OPER_LOWERLAYERDOWN:
+            return "lower-layer-down";
+        default:
+            log_error("Invalid interface's operational state");
+            return "";
     }
 }
 
-void interface_oper_status_provider(sr_session_ctx_t *session, struct lyd_node **parent)
+void interface_oper_status_provider(sr_session_ctx_t *session, const char *request_xpath,
+                                    struct lyd_node **parent)
 {
+    struct sset one = SSET_INITIALIZER(&one);
     struct sset *names = NULL;
     const char *name = NULL;
-    char *oper_state = "";
-    struct nl_sock *sk = NULL;
     struct nl_cache *cache = NULL;
     struct rtnl_link *link = NULL;
-    int status;
-    struct ds path = DS_EMPTY_INITIALIZER;
-    bool start = true;
+    struct lyd_node *intf;
     const struct ly_ctx *ly_ctx;
 
     ly_ctx = sr_acquire_context(sr_session_get_connection(session));
 
-    sk = nl_socket_alloc();
-    if (sk == NULL) {
-        log_error("Allocate nl socket failed");
-        return;
-    }
+    names = select_interface_names(request_xpath, *parent, &one);
 
-    status = nl_connect(sk, NETLINK_ROUTE);
-    if (status != 0) {
-        log_error("Connect to nl failed");
-        nl_socket_free(sk);
-        return;
-    }
-
-    status = rtnl_link_alloc_cache(sk, AF_UNSPEC, &cache);
-    if (status != 0) {
-        log_error("Alloc rtnl link cache failed");
+    link_cache_lock();
+    cache = link_cache_get();
+    if (cache == NULL) {
+        log_error("The rtnl link cache is not available");
         goto cleanup;
     }
 
-    names = get_interface_names();
     SSET_FOR_EACH(name, names) {
         link = rtnl_link_get_by_name(cache, name);
-        uint8_t oper_status = rtnl_link_get_operstate(link);
-        switch (oper_status) {
-            case IF_OPER_UP:
-                oper_state = "up";
-                break;
-            case IF_OPER_DOWN:
-                oper_state = "down";
-                break;
-            case IF_OPER_TESTING:
-                oper_state = "testing";
-                break;
-            case IF_OPER_UNKNOWN:
-                oper_state = "unknown";
-                break;
-            case IF_OPER_DORMANT:
-                oper_state = "dormant";
-                break;
-            case IF_OPER_NOTPRESENT:
-                oper_state = "not-present";
-                break;
-            case IF_OPER_LOWERLAYERDOWN:
-                oper_state = "lower-layer-down";
-                break;
-            default:
-                log_error("Invalid interface's operational state");
+        if (link == NULL) {
+            continue;
         }
 
-        ds_clear(&path);
-        ds_put_format(&path, "/ietf-interfaces:interfaces/interface[name='%s']/oper-status",
-                      name);
-
-        if (start) {
-//            *parent = lyd_new_path(NULL, sr_get_context(sr_session_get_connection(session)),
-//                                   ds_cstr(&path), oper_state, 0, 0);
-
-            lyd_new_path(NULL, ly_ctx, ds_cstr(&path), oper_state, 0, parent);
-            start = false;
-        } else {
-            lyd_new_path(*parent, NULL, ds_cstr(&path), oper_state, 0, NULL);
-        }
+        intf = oper_tree_interface(ly_ctx, parent, name);
+        oper_tree_add_str(intf, "oper-status", oper_state_str(rtnl_link_get_operstate(link)));
 
         rtnl_link_put(link);
     }
 
-    ds_destroy(&path);
-
 cleanup:
+    link_cache_unlock();
 
-    sr_release_context(sr_session_get_connection(session));
-
-    if (NULL != cache) {
-        nl_cache_free(cache);
-    }
+    sset_destroy(&one);
 
-    if (sk != NULL) {
-        nl_close(sk);
-        nl_socket_free(sk);
-    }
+    sr_release_context(sr_session_get_connection(session));
 }
 
-void update_ips(struct shash *interfaces, sr_session_ctx_t *session)
+void save_interfaces_ips(struct shash *interfaces, write_batch_t *batch)
 {
     struct shash ips;
     struct shash_node *node, *node_next;
+    struct interface *intf;
 
     shash_init(&ips);
-    collect_ips(interfaces, &ips);
-    save_ips(&ips, session);
+    if (!collect_ips(interfaces, &ips)) {
+        shash_destroy(&ips);
+        return;
+    }
+
+    SHASH_FOR_EACH(node, interfaces) {
+        intf = (struct interface*)node->data;
+        save_ips(intf, (struct ip*)shash_find_and_delete(&ips, intf->name), batch);
+    }
 
     SHASH_FOR_EACH_SAFE(node, node_next, &ips) {
         ip_destory((struct ip*)node->data);
@@ -676,63 +795,197 @@ void update_ips(struct shash *interfaces, sr_session_ctx_t *session)
     shash_destroy(&ips);
 }
 
-void update_interfaces_speed(struct shash *interfaces, sr_session_ctx_t *session)
+void update_ips(struct shash *interfaces, oper_actions_t *queue)
 {
-    struct ifaddrs *addrs, *addr;
+    write_batch_t batch;
+
+    write_batch_begin_queued(&batch, queue, "ips");
+    save_interfaces_ips(interfaces, &batch);
+    write_batch_end(&batch);
+}
+
+static void refresh_interface_speed(struct interface *intf)
+{
+    struct ethtool_link link;
     unsigned int speed = 0;
-    uint64_t speed_bps = 0;
-    int rc = SR_ERR_OK;
+
+    if (ethtool_get_link(intf->name, &link) >= 0) {
+        set_interface_speed(intf, link.speed);
+        return;
+    }
+
+    get_interface_speed(intf->name, &speed);
+    set_interface_speed(intf, speed);
+}
+
+static void save_interface_speed(struct interface *intf, write_batch_t *batch)
+{
     struct ds path = DS_EMPTY_INITIALIZER;
     sr_val_t val = {0};
-    sr_datastore_t ds;
 
-    if (getifaddrs(&addrs) != 0) {
-        log_error("Get interface addresses failed");
+    if (intf->published.valid && intf->published.speed == intf->speed) {
         return;
     }
 
-    ds = sr_session_get_ds(session);
-    sr_session_switch_ds(session, SR_DS_OPERATIONAL);
+    ds_put_format(&path,
+                  "/ietf-interfaces:interfaces/interface[name='%s']/speed",
+                  intf->name);
+    val.type = SR_UINT64_T;
+    val.data.uint64_val = intf->speed;
+    write_batch_set(batch, ds_cstr(&path), &val);
 
-    addr = addrs;
-    while (addr) {
-        if (shash_find(interfaces, addr->ifa_name) == NULL) {
-            addr = addr->ifa_next;
-            continue;
-        }
+    intf->published.speed = intf->speed;
+    intf->published.valid = true;
 
-        get_interface_speed(addr->ifa_name, &speed);
-        if (speed != -1) {
-            speed_bps = (uint64_t)speed * 1000000ul;
-        } else {
-            speed_bps = -1;
-        }
+    ds_destroy(&path);
+}
 
-        ds_clear(&path);
-        ds_put_format(&path,
-                      "/ietf-interfaces:interfaces/interface[name='%s']/speed",
-                      addr->ifa_name);
-        val.xpath = ds_cstr(&path);
-        val.type = SR_UINT64_T;
-        val.data.uint64_val = speed_bps;
-        rc = sr_set_item(session, ds_cstr(&path), &val, SR_EDIT_DEFAULT);
-        if (rc != SR_ERR_OK) {
-            log_error("Set %s=%s failed: %s", ds_cstr(&path), speed_bps, sr_strerror(rc));
-        }
+void update_interfaces_speed(struct shash *interfaces, oper_actions_t *queue)
+{
+    struct shash_node *node;
+    struct interface *intf;
+    write_batch_t batch;
 
-        rc = sr_apply_changes(session, 0);
-        if (rc != SR_ERR_OK) {
-            log_error("Set interface's speed apply failed: %s", sr_strerror(rc));
-            sr_discard_changes(session);
-        }
+    write_batch_begin_queued(&batch, queue, "speed");
+    write_batch_switch_ds(&batch, SR_DS_OPERATIONAL);
 
-        addr = addr->ifa_next;
+    collect_interfaces_speed(interfaces);
+    SHASH_FOR_EACH(node, interfaces) {
+        intf = (struct interface*)node->data;
+        save_interface_speed(intf, &batch);
     }
 
+    write_batch_end(&batch);
+}
+
+
+static void publish_interface_speed(struct interface *intf, oper_actions_t *queue)
+{
+    write_batch_t batch;
+
+    if (intf->published.valid && intf->published.speed == intf->speed) {
+        return;
+    }
+
+    write_batch_begin_queued(&batch, queue, intf->name);
+    write_batch_switch_ds(&batch, SR_DS_OPERATIONAL);
+    save_interface_speed(intf, &batch);
+    write_batch_end(&batch);
+}
+
+/* Publishes 'mtu' if it differs from the one last written for 'intf', in
+ * the same leaf as save_ips(). */
+static void publish_interface_mtu(struct interface *intf, int mtu,
+                                  oper_actions_t *queue)
+{
+    struct ip *ip = intf->published.ip;
+    struct ds path = DS_EMPTY_INITIALIZER;
+    sr_val_t val = {0};
+    write_batch_t batch;
+
+    if (mtu <= 0 || (ip != NULL && ip->mtu == mtu)) {
+        return;
+    }
+
+    if (ip == NULL) {
+        ip = ip_create();
+        ip->name = strdup(intf->name);
+        intf->published.ip = ip;
+    }
+    ip->mtu = mtu;
+
+    write_batch_begin_queued(&batch, queue, intf->name);
+
+    ds_put_format(&path, "/ietf-interfaces:interfaces/interface[name='%s']/ietf-ip:ipv4/mtu",
+                  intf->name);
+    val.type = SR_UINT16_T;
+    val.data.uint16_val = mtu;
+    write_batch_set(&batch, ds_cstr(&path), &val);
+
+    write_batch_end(&batch);
+
     ds_destroy(&path);
-    freeifaddrs(addrs);
+}
+
+void update_interface_link(struct interface *intf, unsigned int flags,
+                           uint8_t oper_state, int mtu, oper_actions_t *queue)
+{
+    intf->flags = flags;
+
+    publish_interface_mtu(intf, mtu, queue);
+
+    /* RTM_NEWLINK is sent for many reasons; the speed can only have changed
+     * if the administrative or operational state did. */
+    if (intf->published.valid && intf->published.flags == flags &&
+        intf->published.oper_state == oper_state) {
+        return;
+    }
+
+    intf->published.flags = flags;
+    intf->published.oper_state = oper_state;
 
-    sr_session_switch_ds(session, ds);
+    /* Autonegotiation is not announced on the ethtool monitor group, the
+     * new speed has to be asked for. */
+    refresh_interface_speed(intf);
+    publish_interface_speed(intf, queue);
+}
+
+void update_interface_speed(struct interface *intf, uint32_t speed,
+                            oper_actions_t *queue)
+{
+    set_interface_speed(intf, speed);
+    publish_interface_speed(intf, queue);
+}
+
+void update_interface_address(struct interface *intf, bool is_ipv4,
+                              const char *addr, uint8_t prefix, bool deleted,
+                              oper_actions_t *queue)
+{
+    struct ip *ip = intf->published.ip;
+    struct address *address;
+    struct ds path = DS_EMPTY_INITIALIZER;
+    sr_val_t val = {0};
+    write_batch_t batch;
+
+    address = ip_find_address(ip, is_ipv4, addr);
+    if (deleted ? address == NULL : address != NULL && address->prefix == prefix) {
+        /* Already published, e.g. a lifetime refresh of an IPv6 address. */
+        return;
+    }
+
+    if (ip == NULL) {
+        ip = ip_create();
+        ip->name = strdup(intf->name);
+        intf->published.ip = ip;
+    }
+
+    write_batch_begin_queued(&batch, queue, intf->name);
+
+    if (deleted) {
+        put_address_path(&path, intf->name, address);
+        write_batch_delete(&batch, ds_cstr(&path));
+
+        list_remove(&address->node);
+        free(address);
+    } else {
+        if (address == NULL) {
+            address = (struct address *)calloc(1, sizeof(struct address));
+            address->is_ipv4 = is_ipv4;
+            strncpy(address->addr, addr, sizeof(address->addr) - 1);
+            list_push_back(&ip->addresses, &address->node);
+        }
+        address->prefix = prefix;
+
+        put_address_path(&path, intf->name, address);
+        ds_put_cstr(&path, "/prefix-length");
+        val.type = SR_UINT8_T;
+        val.data.uint8_val = prefix;
+        write_batch_set(&batch, ds_cstr(&path), &val);
+    }
+
+    write_batch_end(&batch);
+
+    ds_destroy(&path);
 }
 
 
@@ -743,33 +996,20 @@ struct sset *get_interface_names()
     }
 
     struct if_nameindex *if_ni, *idx_p;
-    struct nl_sock *sk = NULL;
     struct nl_cache *cache = NULL;
     struct rtnl_link *link = NULL;
-    int status;
 
     interface_names = malloc(sizeof(struct sset));
     sset_init(interface_names);
 
-    sk = nl_socket_alloc();
-    if (sk == NULL) {
-        log_fatal("Allocate nl socket failed when get interfaces name");
-        exit(-1);
-    }
-
-    status = nl_connect(sk, NETLINK_ROUTE);
-    if (status != 0) {
-        log_fatal("Connect to nl failed whe get interfaces name");
-        nl_socket_free(sk);
+    link_cache_lock();
+    cache = link_cache_get();
+    if (cache == NULL) {
+        log_fatal("The rtnl link cache is not available when get interfaces name");
+        link_cache_unlock();
         exit(-1);
     }
 
-    status = rtnl_link_alloc_cache(sk, AF_UNSPEC, &cache);
-    if (status != 0) {
-        log_fatal("Alloc rtnl link cache failed when get interfaces name");
-        goto cleanup;
-    }
-
     if_ni = if_nameindex();
     for (idx_p = if_ni;
          idx_p != NULL && idx_p->if_index != 0 && idx_p->if_name != NULL;
@@ -782,6 +1022,10 @@ struct sset *get_interface_names()
         }
 
         link = rtnl_link_get_by_name(cache, idx_p->if_name);
+        if (link == NULL) {
+            continue;
+        }
+
         unsigned int arptype = rtnl_link_get_arptype(link);
         if (arptype != 772 && arptype != 280 && arptype != 776) {
             // arptype 772-loopback  280-can 776-site
@@ -791,14 +1035,10 @@ struct sset *get_interface_names()
         rtnl_link_put(link);
     }
 
-cleanup:
-    if (cache != NULL) {
-        nl_cache_free(cache);
-    }
+    link_cache_unlock();
 
-    if (sk != NULL) {
-        nl_close(sk);
-        nl_socket_free(sk);
+    if (if_ni != NULL) {
+        if_freenameindex(if_ni);
     }
 
     return interface_names;
@@ -0,0 +1,151 @@
+#include "link_cache.h"
+
+#include <pthread.h>
+
+#include <netlink/netlink.h>
+
+#include "log.h"
+
+static struct nl_cache_mngr *mngr = NULL;
+static struct nl_cache *cache = NULL;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct nl_sock *query_sk = NULL;
+static pthread_mutex_t query_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int link_cache_init()
+{
+    int rc;
+
+    rc = nl_cache_mngr_alloc(NULL, NETLINK_ROUTE, NL_AUTO_PROVIDE, &mngr);
+    if (rc < 0) {
+        log_error("Allocate nl cache manager failed: %s", nl_geterror(rc));
+        return rc;
+    }
+
+    rc = nl_cache_mngr_add(mngr, "route/link", NULL, NULL, &cache);
+    if (rc < 0) {
+        log_error("Add rtnl link cache to manager failed: %s", nl_geterror(rc));
+        goto error;
+    }
+
+    query_sk = nl_socket_alloc();
+    if (query_sk == NULL) {
+        log_error("Allocate nl socket failed");
+        rc = -NLE_NOMEM;
+        goto error;
+    }
+
+    rc = nl_connect(query_sk, NETLINK_ROUTE);
+    if (rc != 0) {
+        log_error("Connect to nl failed: %s", nl_geterror(rc));
+        nl_socket_free(query_sk);
+        query_sk = NULL;
+        goto error;
+    }
+
+    return 0;
+
+error:
+    nl_cache_mngr_free(mngr);
+    mngr = NULL;
+    cache = NULL;
+    return rc;
+}
+
+void link_cache_destroy()
+{
+    pthread_mutex_lock(&cache_mutex);
+    if (mngr != NULL) {
+        /* The manager owns the caches added to it. */
+        nl_cache_mngr_free(mngr);
+        mngr = NULL;
+        cache = NULL;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    pthread_mutex_lock(&query_mutex);
+    if (query_sk != NULL) {
+        nl_close(query_sk);
+        nl_socket_free(query_sk);
+        query_sk = NULL;
+    }
+    pthread_mutex_unlock(&query_mutex);
+}
+
+void link_cache_lock()
+{
+    pthread_mutex_lock(&cache_mutex);
+}
+
+void link_cache_unlock()
+{
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+struct nl_cache *link_cache_get()
+{
+    return cache;
+}
+
+int link_cache_get_fd()
+{
+    return mngr != NULL ? nl_cache_mngr_get_fd(mngr) : -1;
+}
+
+void link_cache_process()
+{
+    int rc;
+
+    pthread_mutex_lock(&cache_mutex);
+    rc = nl_cache_mngr_data_ready(mngr);
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (rc < 0) {
+        log_error("Update rtnl link cache failed: %s", nl_geterror(rc));
+    }
+}
+
+struct rtnl_link *link_cache_query(const char *name)
+{
+    struct rtnl_link *link = NULL;
+    int rc;
+
+    pthread_mutex_lock(&query_mutex);
+    if (query_sk == NULL) {
+        pthread_mutex_unlock(&query_mutex);
+        return NULL;
+    }
+
+    rc = rtnl_link_get_kernel(query_sk, 0, name, &link);
+    pthread_mutex_unlock(&query_mutex);
+
+    if (rc < 0) {
+        log_error("Query link-%s from kernel failed: %s", name, nl_geterror(rc));
+        return NULL;
+    }
+
+    return link;
+}
+
+struct nl_cache *link_cache_dump()
+{
+    struct nl_cache *links = NULL;
+    int rc;
+
+    pthread_mutex_lock(&query_mutex);
+    if (query_sk == NULL) {
+        pthread_mutex_unlock(&query_mutex);
+        return NULL;
+    }
+
+    rc = rtnl_link_alloc_cache(query_sk, AF_UNSPEC, &links);
+    pthread_mutex_unlock(&query_mutex);
+
+    if (rc < 0) {
+        log_error("Dump links from kernel failed: %s", nl_geterror(rc));
+        return NULL;
+    }
+
+    return links;
+}
@@ -4,13 +4,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <pthread.h>
 
+#include <libxml/xmlreader.h>
+
+#include "arena.h"
+#include "collector.h"
 #include "log.h"
+#ifdef HAVE_LLDPCTL
+#include "lldp_ctl.h"
+#endif
+#include "lldp_table.h"
+#include "oper_tree.h"
 #include "dynamic-string.h"
 #include "utils.h"
 #include "shash.h"
+#include "snapshot.h"
+#include "util.h"
 
-#define BUFFER_LENGTH 1024
 
 
 struct capability *capability_init()
@@ -19,22 +30,6 @@ struct capability *capability_init()
     return capability;
 }
 
-struct capability *get_capability_from_node(xmlNodePtr node)
-{
-    struct capability *capability = NULL;
-    xmlChar *value = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "capability")) {
-        return NULL;
-    }
-
-    capability = capability_init();
-    capability->type = get_node_prop_str(node, "type");
-    get_node_prop_enabled(node, "enabled", &capability->enabled);
-
-    return capability;
-}
-
 void capability_destroy(struct capability *capability)
 {
     free(capability);
@@ -48,47 +43,6 @@ inline struct chassis *chassis_init()
     return chassis;
 }
 
-struct chassis *get_chassis_from_node(xmlNodePtr node)
-{
-    struct chassis *chassis = NULL;
-    xmlNodePtr current;
-    xmlChar *value = NULL;
-    const xmlChar *name = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "chassis")) {
-        return NULL;
-    }
-
-    chassis = chassis_init();
-
-    current = node->children;
-    while (current != NULL) {
-        name = current->name;
-        if (xmlStrEqual(name, BAD_CAST "id")) {
-            chassis->id_type = get_node_prop_str(current, "type");
-            chassis->id = get_node_content_str(current);
-        } else if (xmlStrEqual(name, BAD_CAST "name")) {
-            chassis->name = get_node_content_str(current);
-        } else if (xmlStrEqual(name, BAD_CAST "descr")) {
-            chassis->description = get_node_content_str(current);
-        } else if (xmlStrEqual(name, BAD_CAST "ttl")) {
-            value = xmlNodeGetContent(current);
-            chassis->ttl = atoi(value);
-            xmlFree(value);
-        } else if (xmlStrEqual(name, BAD_CAST "mgmt-ip")) {
-            char *ip = get_node_content_str(current);
-            svec_add_nocopy(&chassis->mgmt_ip, ip);
-        } else if (xmlStrEqual(name, BAD_CAST "capability")) {
-            struct capability *capability = get_capability_from_node(current);
-            list_push_back(&chassis->capabilities, &capability->node);
-        }
-
-        current = current->next;
-    }
-
-    return chassis;
-}
-
 void chassis_destroy(struct chassis* chassis)
 {
     struct capability *capa, *capa_next;
@@ -127,23 +81,6 @@ inline struct advertised *advertised_init()
     return ad;
 }
 
-struct advertised *get_advertised_from_node(xmlNodePtr node)
-{
-    struct advertised *ad = NULL;
-    xmlChar *value = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "advertised")) {
-        return NULL;
-    }
-
-    ad = advertised_init();
-    ad->type = get_node_prop_str(node, "type");
-    get_node_prop_bool(node, "hd", &ad->hd);
-    get_node_prop_bool(node, "fd", &ad->fd);
-
-    return ad;
-}
-
 void advertised_destroy(struct advertised *ad)
 {
     if (!ad) {
@@ -165,35 +102,6 @@ struct negotiation *negotiation_init()
     return negotiation;
 }
 
-struct negotiation *get_negotiation_from_node(xmlNodePtr node)
-{
-    struct negotiation *negotiation = NULL;
-    xmlNodePtr current;
-    xmlChar *value = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "auto-negotiation")) {
-        return NULL;
-    }
-
-    negotiation = negotiation_init();
-    get_node_prop_bool(node, "supported", &negotiation->supported);
-    get_node_prop_bool(node, "enabled", &negotiation->enabled);
-
-    current = node->children;
-    while (current != NULL) {
-        if (xmlStrEqual(current->name, BAD_CAST "advertised")) {
-            struct advertised *ad = get_advertised_from_node(current);
-            list_push_back(&negotiation->advertise, &ad->node);
-        } else if (xmlStrEqual(current->name, BAD_CAST "current")) {
-            negotiation->current = get_node_content_str(current);
-        }
-
-        current = current->next;
-    }
-
-    return negotiation;
-}
-
 void negotiation_destroy(struct negotiation* negotiation)
 {
     struct advertised *ad, *ad_next;
@@ -220,45 +128,6 @@ inline struct port *port_init()
     return port;
 }
 
-struct port *get_port_from_node(xmlNodePtr node)
-{
-    struct port *port = NULL;
-    xmlNodePtr current;
-    const xmlChar *name = NULL;
-    xmlChar *value = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name,BAD_CAST "port")) {
-        return NULL;
-    }
-
-    port = port_init();
-
-    current = node->children;
-    while (current != NULL) {
-        name = current->name;
-        if (xmlStrEqual(name, BAD_CAST "id")) {
-            port->id_type = get_node_prop_str(current, "type");
-            port->id = get_node_content_str(current);
-        } else if (xmlStrEqual(name, BAD_CAST "descr")) {
-            port->description = get_node_content_str(current);
-        } else if (xmlStrEqual(name, BAD_CAST "ttl")) {
-            value = xmlNodeGetContent(current);
-            port->ttl = atoi(value);
-            xmlFree(value);
-        } else if (xmlStrEqual(name, BAD_CAST "mfs")) {
-            value = xmlNodeGetContent(current);
-            port->mfs = atoi(value);
-            xmlFree(value);
-        } else if (xmlStrEqual(name, BAD_CAST "auto-negotiation")) {
-            port->negotiation = get_negotiation_from_node(current);
-        }
-
-        current = current->next;
-    }
-
-    return port;
-}
-
 void port_destroy(struct port *port)
 {
     if (!port) {
@@ -290,23 +159,6 @@ inline struct vlan *vlan_init()
     return vlan;
 }
 
-struct vlan *get_vlan_from_node(xmlNodePtr node)
-{
-    struct vlan *vlan = NULL;
-    xmlChar *value = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "vlan")) {
-        return NULL;
-    }
-
-    vlan = vlan_init();
-    vlan->id = get_node_prop_str(node, "vlan-id");
-    get_node_prop_bool(node, "pvid", &vlan->pvid);
-    vlan->value = get_node_content_str(node);
-
-    return vlan;
-}
-
 void vlan_destroy(struct vlan *vlan)
 {
     if (!vlan) {
@@ -330,23 +182,6 @@ struct ppvid *ppvid_init()
     return ppvid;
 }
 
-struct ppvid *get_ppvid_from_node(xmlNodePtr node)
-{
-    struct ppvid *ppvid = NULL;
-    xmlChar *value = NULL;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "ppvid")) {
-        return NULL;
-    }
-
-    ppvid = ppvid_init();
-
-    get_node_prop_bool(node, "supported", &ppvid->supported);
-    get_node_prop_bool(node, "enabled", &ppvid->enabled);
-
-    return ppvid;
-}
-
 void ppvid_destroy(struct ppvid *ppvid)
 {
     if (!ppvid) {
@@ -363,41 +198,6 @@ lldp_t *lldp_init()
     return lldp;
 }
 
-lldp_t *get_lldp_from_node(xmlNodePtr node)
-{
-    lldp_t *lldp = NULL;
-    xmlNodePtr current;
-    const xmlChar *name;
-    xmlChar *value;
-
-    if (node == NULL || !xmlStrEqual(node->name, BAD_CAST "interface")) {
-        return NULL;
-    }
-
-    lldp = lldp_init();
-
-    current = node->children;
-    while (current != NULL) {
-        name = current->name;
-        if (xmlStrEqual(name, "pi")) {
-            char *pi = get_node_content_str(current);
-            svec_add_nocopy(&lldp->pi, pi);
-        } else if (xmlStrEqual(name, BAD_CAST "vlan")) {
-            lldp->vlan = get_vlan_from_node(current);
-        } else if (xmlStrEqual(name, BAD_CAST "ppvid")) {
-            lldp->ppvid = get_ppvid_from_node(current);
-        } else if (xmlStrEqual(name, BAD_CAST "chassis")) {
-            lldp->chassis = get_chassis_from_node(current);
-        } else if (xmlStrEqual(name, BAD_CAST "port")) {
-            lldp->port = get_port_from_node(current);
-        }
-
-        current = current->next;
-    }
-
-    return lldp;
-}
-
 void lldp_destroy(lldp_t *lldp)
 {
     if (!lldp) {
@@ -436,63 +236,6 @@ void lldp_destroy(lldp_t *lldp)
     free(lldp);
 }
 
-char *get_node_content_str(xmlNodePtr node)
-{
-    char *value = NULL;
-    xmlChar *content =NULL;
-
-    if (node == NULL) {
-        return NULL;
-    }
-
-    content = xmlNodeGetContent(node);
-    value = strdup(content);
-    xmlFree(content);
-    return value;
-}
-
-char *get_node_prop_str(xmlNodePtr node, const char *attrib_name)
-{
-    char *value = NULL;
-    xmlChar *attrib_value = NULL;
-
-    if (node == NULL || !xmlHasProp(node, BAD_CAST attrib_name)) {
-        return NULL;
-    }
-
-    attrib_value = xmlGetProp(node, BAD_CAST attrib_name);
-    value = strdup(attrib_value);
-    xmlFree(attrib_value);
-
-    return value;
-}
-
-void get_node_prop_bool(xmlNodePtr node, const char *attrib_name, bool *value)
-{
-    xmlChar *attrib_value = NULL;
-
-    if (node == NULL || !xmlHasProp(node, BAD_CAST attrib_name)) {
-        return;
-    }
-
-    attrib_value = xmlGetProp(node, BAD_CAST attrib_name);
-    *value = xmlStrEqual(attrib_value, BAD_CAST "true") ? true : false;
-    xmlFree(attrib_value);
-}
-
-void get_node_prop_enabled(xmlNodePtr node, const char *attrib_name, bool *value)
-{
-    xmlChar *attrib_value = NULL;
-
-    if (node == NULL || !xmlHasProp(node, BAD_CAST attrib_name)) {
-        return;
-    }
-
-    attrib_value = xmlGetProp(node, BAD_CAST attrib_name);
-    *value = xmlStrEqual(attrib_value, BAD_CAST "on") ? true : false;
-    xmlFree(attrib_value);
-}
-
 static inline void swp_str(char **s1, char **s2)
 {
     char *tmp;
@@ -537,117 +280,451 @@ void lldp_node_destroy(lldp_node_t *lldp_node)
     free(lldp_node);
 }
 
-static inline void add_new_string_path(
-        const char *format, const char *name, const char *port_mac, uint64_t age,
-        int index, char *node_name, struct lyd_node **parent, char *value)
+/* Returns the port entry 'name' with 'mac' under the lldp container, reusing
+ * an entry an earlier neighbor on the same port already created. */
+static struct lyd_node *lldp_tree_port(struct lyd_node *root, const char *name,
+                                       const char *mac)
 {
-    struct ds path = DS_EMPTY_INITIALIZER;
+    struct lyd_node *port = NULL, *key;
+
+    LY_LIST_FOR(lyd_child(root), port) {
+        key = lyd_child(port);
+        if (oper_tree_list_key(port, "port") != NULL &&
+            strcmp(lyd_get_value(key), name) == 0 &&
+            key->next != NULL && strcmp(lyd_get_value(key->next), mac) == 0)
+        {
+            return port;
+        }
+    }
+
+    port = NULL;
+    if (lyd_new_list(root, NULL, "port", 0, &port, name, mac) != LY_SUCCESS) {
+        log_error("Create lldp port-%s node failed", name);
+        return NULL;
+    }
 
-    ds_put_format(&path, format, name, port_mac, age, index, node_name);
-    lyd_new_path(*parent, NULL, ds_cstr(&path), value, 0, 0);
-    ds_destroy(&path);
+    return port;
 }
 
-void lldp_port_provider(sr_session_ctx_t *session, struct lyd_node **parent)
+static void lldp_tree_remote(struct lyd_node *root, const lldp_t *lldp)
 {
-    FILE* fp = NULL;
-    char buffer[BUFFER_LENGTH] = {0};
-    struct ds s = DS_EMPTY_INITIALIZER;
-    struct ds path = DS_EMPTY_INITIALIZER;
-    xmlDocPtr doc;
-    xmlNodePtr current;
-    const char *format = "/ieee802-dot1ab-lldp:lldp/port[name='%s'][dest-mac-address='%s']/remote-systems-data[time-mark='%" PRIu64 "'][remote-index='%d']/%s";
-    bool start = true;
-    const struct ly_ctx *ly_ctx;
+    struct lyd_node *port, *remote = NULL;
+    char time_mark[24];
 
-    ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+    port = lldp_tree_port(root, lldp->name, lldp->port->id);
+    if (port == NULL) {
+        return;
+    }
+
+    snprintf(time_mark, sizeof(time_mark), "%" PRIu64, lldp->age);
+    if (lyd_new_list(port, NULL, "remote-systems-data", 0, &remote,
+                     time_mark, lldp->rid) != LY_SUCCESS) {
+        log_error("Create lldp remote-%s node of port-%s failed", lldp->rid, lldp->name);
+        return;
+    }
+
+    oper_tree_add_str(remote, "system-name", lldp->chassis->name);
+    oper_tree_add_str(remote, "system-description", lldp->chassis->description);
+
+    // TODO(sgk):
+    oper_tree_add_str(remote, "chassis-id-subtype", "mac-address");
+    oper_tree_add_str(remote, "chassis-id", lldp->chassis->id);
+
+    // TODO(sgk):
+    oper_tree_add_str(remote, "port-id-subtype", "mac-address");
+    oper_tree_add_str(remote, "port-id",
+                      strlen(lldp->port->id) > 9 ? lldp->port->id + 9 : lldp->port->id);
+
+    oper_tree_add_str(remote, "port-desc", lldp->port->description);
+}
+
+static int read_pipe(void *context, char *buffer, int len)
+{
+    FILE *fp = (FILE*)context;
+    size_t n = fread(buffer, 1, len, fp);
+
+    return n > 0 || !ferror(fp) ? (int)n : -1;
+}
+
+/* Returns a copy in 'arena' of attribute 'name' of the current element. */
+static char *reader_attr(xmlTextReaderPtr reader, const char *name, struct arena *arena)
+{
+    char *value = NULL;
+
+    if (xmlTextReaderMoveToAttribute(reader, BAD_CAST name) == 1) {
+        value = arena_strdup(arena, (const char*)xmlTextReaderConstValue(reader));
+        xmlTextReaderMoveToElement(reader);
+    }
+
+    return value;
+}
+
+/* Returns a copy in 'arena' of the text content of the current element,
+ * which must not have child elements. */
+static char *reader_text(xmlTextReaderPtr reader, struct arena *arena)
+{
+    int type;
+
+    if (xmlTextReaderIsEmptyElement(reader) || xmlTextReaderRead(reader) != 1) {
+        return NULL;
+    }
+
+    type = xmlTextReaderNodeType(reader);
+    if (type != XML_READER_TYPE_TEXT && type != XML_READER_TYPE_CDATA) {
+        return NULL;
+    }
+
+    return arena_strdup(arena, (const char*)xmlTextReaderConstValue(reader));
+}
 
-    fp = popen("lldpcli show neighbors -f xml" ,"r");
+static lldp_t *reader_interface(xmlTextReaderPtr reader, struct arena *arena)
+{
+    lldp_t *lldp = arena_zalloc(arena, sizeof(lldp_t));
+    char *age;
+
+    lldp->name = reader_attr(reader, "name", arena);
+    lldp->via = reader_attr(reader, "via", arena);
+    lldp->rid = reader_attr(reader, "rid", arena);
+    age = reader_attr(reader, "age", arena);
+    if (age != NULL) {
+        lldp->age = get_age(age);
+    }
+
+    lldp->chassis = arena_zalloc(arena, sizeof(struct chassis));
+    list_init(&lldp->chassis->capabilities);
+    lldp->port = arena_zalloc(arena, sizeof(struct port));
+
+    return lldp;
+}
+
+/* Appends the neighbors of every port to 'neighbors' from the XML output of
+ * lldpcli.  The output is parsed as it is read from the pipe, and only what
+ * is published is kept; the records are allocated from 'arena' and must not
+ * be passed to lldp_destroy(). */
+static bool collect_neighbors_xml(struct list_node *neighbors, struct arena *arena)
+{
+    FILE* fp = NULL;
+    xmlTextReaderPtr reader = NULL;
+    const char *name;
+    lldp_t *lldp = NULL;
+    enum { IN_NONE, IN_CHASSIS, IN_PORT } section = IN_NONE;
+    bool skip = false;
+    int depth, rc;
+
+    fp = popen("lldpcli show neighbors -f xml", "r");
     if (fp == NULL) {
         log_error("Execute lldpctl command failed");
-        return;
+        return false;
     }
 
-    while (fgets(buffer, BUFFER_LENGTH, fp) != NULL) {
-        ds_put_cstr(&s, buffer);
+    reader = xmlReaderForIO(read_pipe, NULL, fp, NULL, NULL, XML_PARSE_NOBLANKS);
+    if (reader == NULL) {
+        log_error("Create reader for lldp's xml failed");
+        pclose(fp);
+        return false;
     }
 
-    pclose(fp);
+    for (rc = xmlTextReaderRead(reader); rc == 1;
+         rc = skip ? xmlTextReaderNext(reader) : xmlTextReaderRead(reader))
+    {
+        skip = false;
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+            continue;
+        }
+
+        name = (const char*)xmlTextReaderConstLocalName(reader);
+        depth = xmlTextReaderDepth(reader);
 
-    doc = xmlParseDoc((xmlChar*)ds_cstr(&s));
-    if (doc == NULL) {
+        if (depth == 0) {
+            if (strcmp(name, "lldp") != 0) {
+                log_warn("There is no lldp node in lldp's xml");
+                break;
+            }
+        } else if (depth == 1) {
+            lldp = NULL;
+            if (strcmp(name, "interface") != 0) {
+                continue;
+            }
+
+            lldp = reader_interface(reader, arena);
+            if (lldp->name == NULL) {
+                /* Cannot be published, skip its subtree. */
+                lldp = NULL;
+                skip = true;
+                continue;
+            }
+            list_push_back(neighbors, &lldp->node);
+        } else if (depth == 2 && lldp != NULL) {
+            section = strcmp(name, "chassis") == 0 ? IN_CHASSIS
+                      : strcmp(name, "port") == 0 ? IN_PORT : IN_NONE;
+        } else if (depth == 3 && lldp != NULL && section == IN_CHASSIS) {
+            if (strcmp(name, "id") == 0) {
+                lldp->chassis->id_type = reader_attr(reader, "type", arena);
+                lldp->chassis->id = reader_text(reader, arena);
+            } else if (strcmp(name, "name") == 0) {
+                lldp->chassis->name = reader_text(reader, arena);
+            } else if (strcmp(name, "descr") == 0) {
+                lldp->chassis->description = reader_text(reader, arena);
+            }
+        } else if (depth == 3 && lldp != NULL && section == IN_PORT) {
+            if (strcmp(name, "id") == 0) {
+                lldp->port->id_type = reader_attr(reader, "type", arena);
+                lldp->port->id = reader_text(reader, arena);
+            } else if (strcmp(name, "descr") == 0) {
+                lldp->port->description = reader_text(reader, arena);
+            }
+        }
+    }
+
+    if (rc < 0) {
         log_error("Parse lldp's xml failed");
-        goto end;
     }
 
-    current = xmlDocGetRootElement(doc);
-    if (current == NULL) {
-        log_warn("The root of lldp's xml is empty");
-        goto end;
+    xmlFreeTextReader(reader);
+    pclose(fp);
+
+    return rc == 0;
+}
+
+/* The tree of all neighbors as last built from the neighbor table, reused
+ * as long as the table's generation does not change.
+ *
+ * It is built in a context of its own: sysrepo replaces and destroys the
+ * context of the connection when modules change, and a tree must be freed
+ * before its context is.  A get copies it into the context it holds. */
+static pthread_mutex_t tree_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ly_ctx *cached_ctx = NULL;
+static struct lyd_node *cached_tree = NULL;
+static uint64_t cached_generation = 0;
+static bool cached_ctx_failed = false;
+
+static void add_table_neighbor(const lldp_t *lldp, void *root)
+{
+    lldp_tree_remote((struct lyd_node*)root, lldp);
+}
+
+static void add_table_neighbors(const struct ly_ctx *ly_ctx, const char *port_name,
+                                struct lyd_node **parent)
+{
+    struct lyd_node *root;
+
+    root = oper_tree_root(ly_ctx, "ieee802-dot1ab-lldp", "lldp", parent);
+    if (root != NULL) {
+        lldp_table_foreach(port_name, add_table_neighbor, root);
+    }
+}
+
+/* Loads the lldp module from the modules sysrepo keeps, once.  Without it
+ * every get builds its tree from the table. */
+static bool cached_ctx_init()
+{
+    struct ds dir = DS_EMPTY_INITIALIZER;
+
+    if (cached_ctx != NULL || cached_ctx_failed) {
+        return cached_ctx != NULL;
     }
 
-    if (xmlStrcmp(current->name, BAD_CAST "lldp")) {
-        log_warn("There is no lldp node in lldp's xml");
-        goto end;
+    ds_put_format(&dir, "%s/yang", sr_get_repo_path());
+    if (ly_ctx_new(ds_cstr(&dir), 0, &cached_ctx) != LY_SUCCESS) {
+        cached_ctx = NULL;
+    } else if (ly_ctx_load_module(cached_ctx, "ieee802-dot1ab-lldp", NULL, NULL) == NULL) {
+        ly_ctx_destroy(cached_ctx);
+        cached_ctx = NULL;
     }
+    ds_destroy(&dir);
 
-    current = current->children;
+    if (cached_ctx == NULL) {
+        log_warn("Load ieee802-dot1ab-lldp for the neighbor tree cache failed");
+        cached_ctx_failed = true;
+    }
+    return cached_ctx != NULL;
+}
 
-    while (current != NULL) {
-        if (xmlStrEqual(current->name, BAD_CAST "interface")) {
-            lldp_t *lldp = get_lldp_from_node(current);
+/* Answers from the neighbor table.  Returns false if it is not in sync with
+ * lldpd, then lldpd has to be asked. */
+static bool provide_from_table(const struct ly_ctx *ly_ctx, const char *port_name,
+                               struct lyd_node **parent)
+{
+    struct lyd_node *root;
+    uint64_t generation;
 
-            lldp->name = get_node_prop_str(current, "name");
-            lldp->via = get_node_prop_str(current, "via");
-            lldp->rid = get_node_prop_str(current, "rid");
-            char *age = get_node_prop_str(current, "age");
-            lldp->age = get_age(age);
-            free(age);
+    if (!lldp_table_read_lock(&generation)) {
+        return false;
+    }
 
-            to_ieee_mac_addr(lldp->port->id);
-            int index = atoi(lldp->rid);
-            ds_clear(&path);
-            ds_put_format(&path, format, lldp->name, lldp->port->id, lldp->age, index, "system-name");
-            if (start) {
-//                *parent = lyd_new_path(NULL, sr_get_context(sr_session_get_connection(session)),
-//                                       ds_cstr(&path), lldp->chassis->name, 0, 0);
-		lyd_new_path(NULL, ly_ctx, ds_cstr(&path), lldp->chassis->name, 0, parent);
-                start = false;
-            } else {
-                lyd_new_path(*parent, NULL, ds_cstr(&path), lldp->chassis->name, 0, NULL);
-            }
+    pthread_mutex_lock(&tree_mutex);
+    if (port_name != NULL || !cached_ctx_init()) {
+        pthread_mutex_unlock(&tree_mutex);
+        add_table_neighbors(ly_ctx, port_name, parent);
+        lldp_table_unlock();
+        return true;
+    }
 
-            add_new_string_path(format, lldp->name, lldp->port->id, lldp->age, index,
-                                "system-description", parent, lldp->chassis->description);
+    if (cached_tree == NULL || cached_generation != generation) {
+        lyd_free_all(cached_tree);
+        cached_tree = NULL;
+        add_table_neighbors(cached_ctx, NULL, &cached_tree);
+        cached_generation = generation;
+    }
+    lldp_table_unlock();
 
-            // TODO(sgk):
-            add_new_string_path(format, lldp->name, lldp->port->id, lldp->age, index,
-                                "chassis-id-subtype", parent, "mac-address");
-            add_new_string_path(format, lldp->name, lldp->port->id, lldp->age, index,
-                                "chassis-id", parent, lldp->chassis->id);
+    if (cached_tree != NULL && lyd_child(cached_tree) != NULL) {
+        root = oper_tree_root(ly_ctx, "ieee802-dot1ab-lldp", "lldp", parent);
+        if (root != NULL &&
+            lyd_dup_siblings_to_ctx(lyd_child(cached_tree), ly_ctx,
+                                    (struct lyd_node_inner*)root,
+                                    LYD_DUP_RECURSIVE, NULL) != LY_SUCCESS) {
+            log_error("Copy cached lldp neighbors failed");
+        }
+    }
+    pthread_mutex_unlock(&tree_mutex);
+
+    return true;
+}
 
-            // TODO(sgk):
-            add_new_string_path(format, lldp->name, lldp->port->id, lldp->age, index,
-                                "port-id-subtype", parent, "mac-address");
-            add_new_string_path(format, lldp->name, lldp->port->id, lldp->age, index,
-                                "port-id", parent, lldp->port->id + 9);
+/* How often the collector asks lldpd while the neighbors are read. */
+#define LLDP_NEIGHBORS_PERIOD_MS 1000
 
-            add_new_string_path(format, lldp->name, lldp->port->id, lldp->age, index,
-                                "port-desc", parent, lldp->port->description);
+/* The neighbors asked from lldpd while the neighbor table is not in sync,
+ * complete and with IEEE MAC port IDs. */
+struct lldp_snapshot {
+    struct list_node neighbors;
+    struct arena arena;
+    bool from_arena;            /* Records in 'arena', else lldp_destroy(). */
+};
 
+static void lldp_snapshot_destroy(void *snapshot_)
+{
+    struct lldp_snapshot *snapshot = snapshot_;
+    lldp_t *lldp, *next;
 
+    if (!snapshot->from_arena) {
+        LIST_FOR_EACH_SAFE (lldp, next, node, &snapshot->neighbors) {
+            list_remove(&lldp->node);
             lldp_destroy(lldp);
         }
+    }
+    arena_destroy(&snapshot->arena);
+    free(snapshot);
+}
+
+static struct snapshot_slot neighbors_slot = SNAPSHOT_SLOT_INITIALIZER(lldp_snapshot_destroy);
+
+/* Asks lldpd for the neighbors of every port and publishes them. */
+static int refresh_neighbors(void *aux)
+{
+    struct lldp_snapshot *snapshot;
+    uint64_t generation;
+    lldp_t *lldp, *next;
 
-        current = current->next;
+    /* The table answers while it is in sync, lldpd is not asked. */
+    if (lldp_table_read_lock(&generation)) {
+        lldp_table_unlock();
+        snapshot_publish(&neighbors_slot, NULL);
+        return 0;
     }
 
-end:
-    sr_release_context(sr_session_get_connection(session));
+    snapshot = xmalloc(sizeof(*snapshot));
+    list_init(&snapshot->neighbors);
+    arena_init(&snapshot->arena);
+    snapshot->from_arena = false;
 
-    if (doc) {
-        xmlFreeDoc(doc);
+#ifdef HAVE_LLDPCTL
+    if (!lldp_ctl_collect_neighbors(&snapshot->neighbors))
+#endif
+    {
+        collect_neighbors_xml(&snapshot->neighbors, &snapshot->arena);
+        snapshot->from_arena = true;
     }
-    ds_destroy(&s);
-    ds_destroy(&path);
+
+    LIST_FOR_EACH_SAFE (lldp, next, node, &snapshot->neighbors) {
+        if (lldp->name != NULL && lldp->rid != NULL && lldp->chassis != NULL &&
+            lldp->port != NULL && lldp->port->id != NULL) {
+            to_ieee_mac_addr(lldp->port->id);
+            continue;
+        }
+
+        list_remove(&lldp->node);
+        if (!snapshot->from_arena) {
+            lldp_destroy(lldp);
+        }
+    }
+
+    snapshot_publish(&neighbors_slot, snapshot);
+    return 0;
+}
+
+static struct collector neighbors_collector =
+    COLLECTOR_INITIALIZER("Lldp neighbors", refresh_neighbors, LLDP_NEIGHBORS_PERIOD_MS);
+
+void lldp_neighbors_collect()
+{
+    collector_add(&neighbors_collector, NULL);
+}
+
+/* Answers from the neighbors the collector last asked lldpd for. */
+static void provide_from_snapshot(const struct ly_ctx *ly_ctx, const char *port_name,
+                                  struct lyd_node **parent)
+{
+    const struct lldp_snapshot *snapshot;
+    struct lyd_node *root = NULL;
+    unsigned int idx;
+    lldp_t *lldp;
+
+    collector_read(&neighbors_collector);
+    idx = snapshot_read_lock();
+
+    snapshot = snapshot_get(&neighbors_slot);
+    if (snapshot != NULL) {
+        LIST_FOR_EACH (lldp, node, &snapshot->neighbors) {
+            if (port_name != NULL && strcmp(lldp->name, port_name) != 0) {
+                continue;
+            }
+            if (root == NULL) {
+                root = oper_tree_root(ly_ctx, "ieee802-dot1ab-lldp", "lldp", parent);
+                if (root == NULL) {
+                    break;
+                }
+            }
+            lldp_tree_remote(root, lldp);
+        }
+    }
+
+    snapshot_read_unlock(idx);
+}
+
+void lldp_provider_destroy()
+{
+    pthread_mutex_lock(&tree_mutex);
+    lyd_free_all(cached_tree);
+    cached_tree = NULL;
+    ly_ctx_destroy(cached_ctx);
+    cached_ctx = NULL;
+    cached_ctx_failed = false;
+    pthread_mutex_unlock(&tree_mutex);
+
+    snapshot_slot_clear(&neighbors_slot);
+}
+
+void lldp_port_provider(sr_session_ctx_t *session, const char *request_xpath,
+                        struct lyd_node **parent)
+{
+    char *port_name = NULL;
+    const struct ly_ctx *ly_ctx;
+
+    /* lldpd is always asked for every port, by the lldpd watch or the
+     * collector; a request for one port only filters the tree it gets. */
+    port_name = get_xpath_key(request_xpath, "port", "name");
+
+    ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+
+    /* Neither answer waits for lldpd: the table is kept by the lldpd watch,
+     * the snapshot by the collector. */
+    if (!provide_from_table(ly_ctx, port_name, parent)) {
+        provide_from_snapshot(ly_ctx, port_name, parent);
+    }
+
+    sr_release_context(sr_session_get_connection(session));
+
+    free(port_name);
 }
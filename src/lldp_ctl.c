@@ -0,0 +1,313 @@
+#include "lldp_ctl.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lldpctl.h>
+
+#include "lldp.h"
+#include "lldp_table.h"
+#include "log.h"
+
+/* Seconds between attempts to subscribe to lldpd again. */
+#define WATCH_RETRY_INTERVAL 5
+
+/* A synchronous connection is not thread safe, and sysrepo may call the
+ * providers from several threads. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static lldpctl_conn_t *conn = NULL;
+static char *ctlname = NULL;
+
+static pthread_t watch_thread;
+static volatile bool watching = false;
+
+void lldp_ctl_set_socket(const char *path)
+{
+    pthread_mutex_lock(&mutex);
+    free(ctlname);
+    ctlname = path != NULL ? strdup(path) : NULL;
+    pthread_mutex_unlock(&mutex);
+}
+
+static lldpctl_conn_t *new_conn()
+{
+    lldpctl_conn_t *new;
+
+    new = lldpctl_new_name(ctlname != NULL ? ctlname : lldpctl_get_default_transport(),
+                           NULL, NULL, NULL);
+    if (new == NULL) {
+        log_error("Create lldpctl connection failed");
+    }
+
+    return new;
+}
+
+static lldpctl_conn_t *get_conn()
+{
+    if (conn == NULL) {
+        conn = new_conn();
+    }
+
+    return conn;
+}
+
+/* Logs the last error and drops the connection, the next query opens a new
+ * one, e.g. after lldpd was restarted. */
+static void conn_failed(const char *what)
+{
+    log_error("%s from lldpd failed: %s", what, lldpctl_strerror(lldpctl_last_error(conn)));
+    lldpctl_release(conn);
+    conn = NULL;
+}
+
+static char *atom_strdup(lldpctl_atom_t *atom, lldpctl_key_t key)
+{
+    const char *value = lldpctl_atom_get_str(atom, key);
+
+    return value != NULL ? strdup(value) : NULL;
+}
+
+static lldp_t *lldp_from_neighbor(const char *port_name, lldpctl_atom_t *neighbor)
+{
+    lldp_t *lldp = lldp_init();
+    char rid[24];
+
+    lldp->name = strdup(port_name);
+    lldp->via = atom_strdup(neighbor, lldpctl_k_port_protocol);
+    snprintf(rid, sizeof(rid), "%ld", lldpctl_atom_get_int(neighbor, lldpctl_k_chassis_index));
+    lldp->rid = strdup(rid);
+    /* The time of the last change, as get_age() computes it from the XML. */
+    lldp->age = lldpctl_atom_get_int(neighbor, lldpctl_k_port_age);
+
+    lldp->chassis = chassis_init();
+    lldp->chassis->id_type = atom_strdup(neighbor, lldpctl_k_chassis_id_subtype);
+    lldp->chassis->id = atom_strdup(neighbor, lldpctl_k_chassis_id);
+    lldp->chassis->name = atom_strdup(neighbor, lldpctl_k_chassis_name);
+    lldp->chassis->description = atom_strdup(neighbor, lldpctl_k_chassis_descr);
+
+    lldp->port = port_init();
+    lldp->port->id_type = atom_strdup(neighbor, lldpctl_k_port_id_subtype);
+    lldp->port->id = atom_strdup(neighbor, lldpctl_k_port_id);
+    lldp->port->description = atom_strdup(neighbor, lldpctl_k_port_descr);
+    lldp->port->ttl = lldpctl_atom_get_int(neighbor, lldpctl_k_port_ttl);
+
+    return lldp;
+}
+
+static void collect_port(lldpctl_atom_t *iface, const char *name, struct list_node *neighbors)
+{
+    lldpctl_atom_t *port, *list, *neighbor;
+
+    port = lldpctl_get_port(iface);
+    if (port == NULL) {
+        return;
+    }
+
+    list = lldpctl_atom_get(port, lldpctl_k_port_neighbors);
+    if (list != NULL) {
+        lldpctl_atom_foreach(list, neighbor) {
+            lldp_t *lldp = lldp_from_neighbor(name, neighbor);
+            list_push_back(neighbors, &lldp->node);
+        }
+        lldpctl_atom_dec_ref(list);
+    }
+
+    lldpctl_atom_dec_ref(port);
+}
+
+bool lldp_ctl_collect_neighbors(struct list_node *neighbors)
+{
+    lldpctl_atom_t *ifaces, *iface;
+    struct list_node collected;
+    const char *name;
+
+    list_init(&collected);
+
+    pthread_mutex_lock(&mutex);
+    if (get_conn() == NULL) {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    ifaces = lldpctl_get_interfaces(conn);
+    if (ifaces == NULL) {
+        conn_failed("Get interfaces");
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    lldpctl_atom_foreach(ifaces, iface) {
+        name = lldpctl_atom_get_str(iface, lldpctl_k_interface_name);
+        if (name == NULL) {
+            continue;
+        }
+
+        collect_port(iface, name, &collected);
+    }
+    lldpctl_atom_dec_ref(ifaces);
+
+    pthread_mutex_unlock(&mutex);
+
+    if (!list_is_empty(&collected)) {
+        list_splice(neighbors, list_front(&collected), &collected);
+    }
+
+    return true;
+}
+
+char *lldp_ctl_get_chassis_id()
+{
+    lldpctl_atom_t *chassis;
+    const char *subtype;
+    char *id = NULL;
+
+    pthread_mutex_lock(&mutex);
+    if (get_conn() == NULL) {
+        goto out;
+    }
+
+    chassis = lldpctl_get_local_chassis(conn);
+    if (chassis == NULL) {
+        conn_failed("Get local chassis");
+        goto out;
+    }
+
+    subtype = lldpctl_atom_get_str(chassis, lldpctl_k_chassis_id_subtype);
+    if (subtype != NULL && strcmp(subtype, "mac") == 0) {
+        id = atom_strdup(chassis, lldpctl_k_chassis_id);
+    }
+    lldpctl_atom_dec_ref(chassis);
+
+out:
+    pthread_mutex_unlock(&mutex);
+    return id;
+}
+
+static void watch_cb(lldpctl_conn_t *watch_conn, lldpctl_change_t type,
+                     lldpctl_atom_t *iface, lldpctl_atom_t *neighbor, void *aux)
+{
+    const char *name = lldpctl_atom_get_str(iface, lldpctl_k_interface_name);
+    char rid[24];
+    int state;
+
+    if (name == NULL) {
+        return;
+    }
+
+    /* Not cancelled while the table is locked. */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+    switch (type) {
+    case lldpctl_c_deleted:
+        snprintf(rid, sizeof(rid), "%ld",
+                 lldpctl_atom_get_int(neighbor, lldpctl_k_chassis_index));
+        lldp_table_remove(name, lldpctl_atom_get_str(neighbor, lldpctl_k_chassis_id), rid,
+                          lldpctl_atom_get_int(neighbor, lldpctl_k_port_ttl));
+        break;
+    case lldpctl_c_updated:
+    case lldpctl_c_added:
+        lldp_table_set(lldp_from_neighbor(name, neighbor));
+        break;
+    }
+
+    pthread_setcancelstate(state, NULL);
+}
+
+static void release_conn(void *arg)
+{
+    lldpctl_conn_t **watch_conn = (lldpctl_conn_t**)arg;
+
+    if (*watch_conn != NULL) {
+        lldpctl_release(*watch_conn);
+        *watch_conn = NULL;
+    }
+}
+
+/* The thread can only be cancelled while it waits for lldpd or sleeps;
+ * lldpctl_watch() has no other way to be interrupted. */
+static void *watch_main(void *arg)
+{
+    lldpctl_conn_t *watch_conn = NULL;
+    struct list_node neighbors;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_cleanup_push(release_conn, &watch_conn);
+
+    while (watching) {
+        pthread_mutex_lock(&mutex);
+        watch_conn = new_conn();
+        pthread_mutex_unlock(&mutex);
+
+        /* Subscribe before the full read, so that no change between the
+         * two is lost; replaying one twice is harmless. */
+        if (watch_conn != NULL && lldpctl_watch_callback(watch_conn, watch_cb, NULL) == 0) {
+            list_init(&neighbors);
+            if (lldp_ctl_collect_neighbors(&neighbors)) {
+                lldp_table_reset(&neighbors);
+
+                pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+                while (watching && lldpctl_watch(watch_conn) == 0) {
+                    continue;
+                }
+                pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            }
+        }
+
+        if (watching) {
+            log_warn("Not subscribed to lldpd changes: %s, retry in %d seconds",
+                     watch_conn != NULL ? lldpctl_strerror(lldpctl_last_error(watch_conn))
+                                        : "no connection",
+                     WATCH_RETRY_INTERVAL);
+        }
+
+        lldp_table_invalidate();
+        release_conn(&watch_conn);
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        sleep(WATCH_RETRY_INTERVAL);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    }
+
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+int lldp_ctl_watch_start()
+{
+    watching = true;
+    if (pthread_create(&watch_thread, NULL, watch_main, NULL) != 0) {
+        log_error("Create lldpd watch thread failed");
+        watching = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+void lldp_ctl_watch_stop()
+{
+    if (!watching) {
+        return;
+    }
+
+    watching = false;
+    pthread_cancel(watch_thread);
+    pthread_join(watch_thread, NULL);
+
+    lldp_table_invalidate();
+}
+
+void lldp_ctl_destroy()
+{
+    pthread_mutex_lock(&mutex);
+    if (conn != NULL) {
+        lldpctl_release(conn);
+        conn = NULL;
+    }
+    free(ctlname);
+    ctlname = NULL;
+    pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,375 @@
+#include "lldp_notify.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "hmap.h"
+#include "log.h"
+#include "oper_tree.h"
+#include "reactor.h"
+#include "util.h"
+#include "utils.h"
+
+/* The last change of one neighbor within the window. */
+struct pending_change {
+    struct hmap_node node;
+    char *port;
+    char *chassis_id;
+    char *rid;
+    enum lldp_change change;
+};
+
+/* Everything that changed since the window opened. */
+struct change_batch {
+    struct hmap changes;
+    uint32_t inserts;
+    uint32_t updates;
+    uint32_t deletes;
+    uint32_t ageouts;
+    bool truncated;
+};
+
+static const char *change_names[] = {
+    [LLDP_CHANGE_INSERTED] = "inserted",
+    [LLDP_CHANGE_UPDATED] = "updated",
+    [LLDP_CHANGE_DELETED] = "deleted",
+    [LLDP_CHANGE_AGED_OUT] = "aged-out",
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int window_ms = LLDP_NOTIFY_DEFAULT_WINDOW_MS;
+
+/* The remote-statistics since startup.  As in the LLDP-MIB, age-outs are
+ * deletes as well. */
+static uint32_t total_inserts = 0;
+static uint32_t total_deletes = 0;
+static uint32_t total_ageouts = 0;
+static uint64_t last_change_us = 0;
+
+static struct change_batch pending = {
+    .changes = HMAP_INITIALIZER(&pending.changes),
+};
+static bool window_open = false;
+
+/* Closes the window on the event loop. */
+static struct reactor_timer *window_timer = NULL;
+
+static sr_session_ctx_t *notify_session = NULL;
+static bool running = false;
+
+void lldp_notify_set_window(unsigned int window)
+{
+    window_ms = window;
+}
+
+static uint32_t key_hash(const char *port, const char *chassis_id, const char *rid)
+{
+    return hash_string(rid, hash_string(chassis_id, hash_string(port, 0)));
+}
+
+static struct pending_change *find_pending(const char *port, const char *chassis_id,
+                                           const char *rid, uint32_t hash)
+{
+    struct pending_change *pc;
+
+    HMAP_FOR_EACH_WITH_HASH (pc, node, hash, &pending.changes) {
+        if (strcmp(pc->port, port) == 0 && strcmp(pc->chassis_id, chassis_id) == 0 &&
+            strcmp(pc->rid, rid) == 0) {
+            return pc;
+        }
+    }
+
+    return NULL;
+}
+
+static void free_changes(struct hmap *changes)
+{
+    struct pending_change *pc, *next;
+
+    HMAP_FOR_EACH_SAFE (pc, next, node, changes) {
+        hmap_remove(changes, &pc->node);
+        free(pc->port);
+        free(pc->chassis_id);
+        free(pc->rid);
+        free(pc);
+    }
+}
+
+static void count_change(struct change_batch *batch, enum lldp_change change)
+{
+    switch (change) {
+    case LLDP_CHANGE_INSERTED:
+        batch->inserts++;
+        break;
+    case LLDP_CHANGE_UPDATED:
+        batch->updates++;
+        break;
+    case LLDP_CHANGE_AGED_OUT:
+        batch->ageouts++;
+        /* fall through */
+    case LLDP_CHANGE_DELETED:
+        batch->deletes++;
+        break;
+    }
+}
+
+/* Folds 'change' into the earlier change 'pc' of the same neighbor.  Returns
+ * false if the two cancel out, i.e. the neighbor came and went within the
+ * window. */
+static bool merge_change(struct pending_change *pc, enum lldp_change change)
+{
+    bool was_inserted = pc->change == LLDP_CHANGE_INSERTED;
+    bool was_removed = pc->change == LLDP_CHANGE_DELETED ||
+                       pc->change == LLDP_CHANGE_AGED_OUT;
+
+    switch (change) {
+    case LLDP_CHANGE_INSERTED:
+    case LLDP_CHANGE_UPDATED:
+        if (was_removed) {
+            pc->change = LLDP_CHANGE_UPDATED;
+        } else if (!was_inserted) {
+            pc->change = change;
+        }
+        return true;
+    case LLDP_CHANGE_DELETED:
+    case LLDP_CHANGE_AGED_OUT:
+        if (was_inserted) {
+            return false;
+        }
+        pc->change = change;
+        return true;
+    }
+
+    return true;
+}
+
+static void open_window_locked()
+{
+    /* A timer armed with 0 would be disarmed. */
+    reactor_timer_arm(window_timer, window_ms > 0 ? window_ms : 1, 0);
+    window_open = true;
+}
+
+static void queue_change_locked(const char *port, const char *chassis_id, const char *rid,
+                                enum lldp_change change)
+{
+    struct pending_change *pc;
+    uint32_t hash;
+
+    if (!window_open) {
+        open_window_locked();
+    }
+    count_change(&pending, change);
+
+    hash = key_hash(port, chassis_id, rid);
+    pc = find_pending(port, chassis_id, rid, hash);
+    if (pc != NULL) {
+        if (!merge_change(pc, change)) {
+            hmap_remove(&pending.changes, &pc->node);
+            free(pc->port);
+            free(pc->chassis_id);
+            free(pc->rid);
+            free(pc);
+        }
+        return;
+    }
+
+    if (hmap_count(&pending.changes) >= LLDP_NOTIFY_MAX_CHANGES) {
+        pending.truncated = true;
+        return;
+    }
+
+    pc = xmalloc(sizeof(*pc));
+    pc->port = strdup(port);
+    pc->chassis_id = strdup(chassis_id);
+    pc->rid = strdup(rid);
+    pc->change = change;
+    hmap_insert(&pending.changes, &pc->node, hash);
+}
+
+void lldp_notify_change(const char *port, const char *chassis_id, const char *rid,
+                        enum lldp_change change)
+{
+    if (chassis_id == NULL) {
+        chassis_id = "";
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    switch (change) {
+    case LLDP_CHANGE_INSERTED:
+        total_inserts++;
+        break;
+    case LLDP_CHANGE_UPDATED:
+        break;
+    case LLDP_CHANGE_AGED_OUT:
+        total_ageouts++;
+        /* fall through */
+    case LLDP_CHANGE_DELETED:
+        total_deletes++;
+        break;
+    }
+    last_change_us = get_monotonic_us();
+
+    if (running) {
+        queue_change_locked(port, chassis_id, rid, change);
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+static void send_batch(const struct change_batch *batch)
+{
+    sr_conn_ctx_t *connection = sr_session_get_connection(notify_session);
+    const struct ly_ctx *ly_ctx;
+    struct lyd_node *notif = NULL, *entry;
+    struct pending_change *pc;
+    int rc;
+
+    ly_ctx = sr_acquire_context(connection);
+
+    if (oper_tree_root(ly_ctx, "tsn-lldp-notifications", "remote-table-change",
+                       &notif) == NULL) {
+        goto cleanup;
+    }
+
+    oper_tree_add_uint64(notif, "remote-inserts", batch->inserts);
+    oper_tree_add_uint64(notif, "remote-updates", batch->updates);
+    oper_tree_add_uint64(notif, "remote-deletes", batch->deletes);
+    oper_tree_add_uint64(notif, "remote-ageouts", batch->ageouts);
+    oper_tree_add_str(notif, "truncated", batch->truncated ? "true" : "false");
+
+    HMAP_FOR_EACH (pc, node, &batch->changes) {
+        entry = NULL;
+        if (lyd_new_list(notif, NULL, "neighbor", 0, &entry,
+                         pc->port, pc->chassis_id, pc->rid) != LY_SUCCESS) {
+            log_error("Create neighbor %s/%s/%s node failed",
+                      pc->port, pc->chassis_id, pc->rid);
+            continue;
+        }
+        oper_tree_add_str(entry, "change", change_names[pc->change]);
+    }
+
+    rc = sr_notif_send_tree(notify_session, notif, 0, 0);
+    if (rc != SR_ERR_OK) {
+        log_error("Send LLDP remote table change failed: %s", sr_strerror(rc));
+    }
+
+cleanup:
+    lyd_free_all(notif);
+    sr_release_context(connection);
+}
+
+static void window_cb(void *aux)
+{
+    struct change_batch batch = {
+        .changes = HMAP_INITIALIZER(&batch.changes),
+    };
+
+    /* Take the window over, so that changes are recorded into the next one
+     * while this one is sent. */
+    pthread_mutex_lock(&mutex);
+    if (!window_open) {
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+    hmap_swap(&batch.changes, &pending.changes);
+    batch.inserts = pending.inserts;
+    batch.updates = pending.updates;
+    batch.deletes = pending.deletes;
+    batch.ageouts = pending.ageouts;
+    batch.truncated = pending.truncated;
+    pending.inserts = pending.updates = pending.deletes = pending.ageouts = 0;
+    pending.truncated = false;
+    window_open = false;
+    pthread_mutex_unlock(&mutex);
+
+    send_batch(&batch);
+    free_changes(&batch.changes);
+    hmap_destroy(&batch.changes);
+}
+
+int lldp_notify_start(sr_conn_ctx_t *connection)
+{
+    int rc;
+
+    rc = sr_session_start(connection, SR_DS_OPERATIONAL, &notify_session);
+    if (rc != SR_ERR_OK) {
+        log_error("Start session for LLDP notifications failed: %s", sr_strerror(rc));
+        return -1;
+    }
+
+    window_timer = reactor_timer_create(window_cb, NULL);
+    if (window_timer == NULL) {
+        log_error("Create LLDP notification timer failed");
+        sr_session_stop(notify_session);
+        notify_session = NULL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&mutex);
+    running = true;
+    pthread_mutex_unlock(&mutex);
+
+    log_info("Coalesce LLDP remote table changes within %u ms", window_ms);
+    return 0;
+}
+
+void lldp_notify_stop()
+{
+    pthread_mutex_lock(&mutex);
+    if (!running) {
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+    running = false;
+
+    /* Whatever is still in the window is dropped, the counters keep it. */
+    free_changes(&pending.changes);
+    hmap_destroy(&pending.changes);
+    hmap_init(&pending.changes);
+    window_open = false;
+    pthread_mutex_unlock(&mutex);
+
+    reactor_timer_destroy(window_timer);
+    window_timer = NULL;
+
+    sr_session_stop(notify_session);
+    notify_session = NULL;
+}
+void lldp_remote_statistics_provider(sr_session_ctx_t *session, const char *request_xpath,
+                                     struct lyd_node **parent)
+{
+    const struct ly_ctx *ly_ctx;
+    struct lyd_node *root, *statistics;
+    uint32_t inserts, deletes, ageouts;
+    uint64_t changed_us;
+
+    pthread_mutex_lock(&mutex);
+    inserts = total_inserts;
+    deletes = total_deletes;
+    ageouts = total_ageouts;
+    changed_us = last_change_us;
+    pthread_mutex_unlock(&mutex);
+
+    ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+
+    root = oper_tree_root(ly_ctx, "ieee802-dot1ab-lldp", "lldp", parent);
+    statistics = oper_tree_add_container(root, "remote-statistics");
+    if (statistics != NULL) {
+        /* Timeticks of the monotonic clock, which like sysUpTime starts at
+         * boot. */
+        oper_tree_add_uint64(statistics, "last-change-time",
+                             (uint32_t)(changed_us / 10000));
+        oper_tree_add_uint64(statistics, "remote-inserts", inserts);
+        oper_tree_add_uint64(statistics, "remote-deletes", deletes);
+        /* lldpd does not tell when it drops a neighbor for lack of room. */
+        oper_tree_add_uint64(statistics, "remote-drops", 0);
+        oper_tree_add_uint64(statistics, "remote-ageouts", ageouts);
+    }
+
+    sr_release_context(sr_session_get_connection(session));
+}
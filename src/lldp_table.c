@@ -0,0 +1,300 @@
+#include "lldp_table.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <net/if.h>
+
+#include "hash.h"
+#include "hmap.h"
+#include "link_cache.h"
+#include "lldp_notify.h"
+#include "log.h"
+#include "util.h"
+#include "utils.h"
+
+struct lldp_entry {
+    struct hmap_node node;
+    lldp_t *lldp;
+};
+
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static struct hmap neighbors = HMAP_INITIALIZER(&neighbors);
+static uint64_t generation = 0;
+static bool synced = false;
+/* Whether the table was ever synchronized, i.e. whether the neighbors of the
+ * next sync can be compared with what is in it. */
+static bool primed = false;
+
+static const char *chassis_id(const lldp_t *lldp)
+{
+    return lldp->chassis != NULL && lldp->chassis->id != NULL ? lldp->chassis->id : "";
+}
+
+static uint32_t key_hash(const char *port, const char *chassis, const char *rid)
+{
+    return hash_string(rid, hash_string(chassis, hash_string(port, 0)));
+}
+
+static struct lldp_entry *find_entry(const struct hmap *map, const char *port,
+                                     const char *chassis, const char *rid, uint32_t hash)
+{
+    struct lldp_entry *entry;
+
+    HMAP_FOR_EACH_WITH_HASH (entry, node, hash, map) {
+        if (strcmp(entry->lldp->name, port) == 0 &&
+            strcmp(chassis_id(entry->lldp), chassis) == 0 &&
+            strcmp(entry->lldp->rid, rid) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void clear(struct hmap *map)
+{
+    struct lldp_entry *entry, *next;
+
+    HMAP_FOR_EACH_SAFE (entry, next, node, map) {
+        hmap_remove(map, &entry->node);
+        lldp_destroy(entry->lldp);
+        free(entry);
+    }
+}
+
+/* Whether local port 'name' still has a carrier.  Asked from the kernel, the
+ * link cache may not have seen the link go down yet. */
+static bool port_is_running(const char *name)
+{
+    struct rtnl_link *link = link_cache_query(name);
+    bool running;
+
+    if (link == NULL) {
+        return false;
+    }
+    running = (rtnl_link_get_flags(link) & IFF_RUNNING) != 0;
+    rtnl_link_put(link);
+
+    return running;
+}
+
+/* lldpd reports an age-out and a neighbor that went away the same way, and
+ * does not report the LLDPDUs that changed nothing, so when it last heard
+ * from the neighbor is not known.  A removal is only counted as an age-out
+ * if it can be one:
+ * - the neighbor's last TTL, 'ttl', is not 0, as it is in a shutdown
+ *   LLDPDU,
+ * - the local port is still up, 'running', lldpd flushes the neighbors of
+ *   a port whose link went down,
+ * - the TTL has passed since the neighbor last changed, which is no later
+ *   than its last LLDPDU. */
+static enum lldp_change removal(const lldp_t *lldp, uint32_t ttl, bool running)
+{
+    if (ttl != 0 && running && (uint64_t)time(NULL) >= lldp->age + ttl) {
+        return LLDP_CHANGE_AGED_OUT;
+    }
+
+    return LLDP_CHANGE_DELETED;
+}
+
+static uint32_t last_ttl(const lldp_t *lldp)
+{
+    return lldp->port != NULL ? lldp->port->ttl : 0;
+}
+
+/* Records without a key cannot be told apart and are not published. */
+static bool is_valid(const lldp_t *lldp)
+{
+    return lldp->name != NULL && lldp->rid != NULL && lldp->chassis != NULL &&
+           lldp->port != NULL && lldp->port->id != NULL;
+}
+
+/* Inserts 'lldp' into 'map', replacing the record with the same key, and
+ * returns whether it was inserted or replaced one. */
+static enum lldp_change set_locked(struct hmap *map, lldp_t *lldp)
+{
+    struct lldp_entry *entry;
+    enum lldp_change change;
+    uint32_t hash;
+
+    /* Converted once here, readers only hold the read lock. */
+    to_ieee_mac_addr(lldp->port->id);
+
+    hash = key_hash(lldp->name, chassis_id(lldp), lldp->rid);
+    entry = find_entry(map, lldp->name, chassis_id(lldp), lldp->rid, hash);
+    if (entry != NULL) {
+        lldp_destroy(entry->lldp);
+        change = LLDP_CHANGE_UPDATED;
+    } else {
+        entry = xmalloc(sizeof(*entry));
+        hmap_insert(map, &entry->node, hash);
+        change = LLDP_CHANGE_INSERTED;
+    }
+    entry->lldp = lldp;
+
+    return change;
+}
+
+/* Reports the differences between the neighbors that were in the table
+ * before a sync, 'previous', and the ones that are in it now.  Whatever
+ * matched is taken out of 'previous'. */
+static void notify_sync_locked(struct hmap *previous)
+{
+    struct lldp_entry *entry, *old;
+    const lldp_t *lldp;
+
+    HMAP_FOR_EACH (entry, node, &neighbors) {
+        lldp = entry->lldp;
+        old = find_entry(previous, lldp->name, chassis_id(lldp), lldp->rid,
+                         hmap_node_hash(&entry->node));
+        if (old == NULL) {
+            lldp_notify_change(lldp->name, chassis_id(lldp), lldp->rid,
+                               LLDP_CHANGE_INSERTED);
+            continue;
+        }
+
+        if (old->lldp->age != lldp->age) {
+            lldp_notify_change(lldp->name, chassis_id(lldp), lldp->rid,
+                               LLDP_CHANGE_UPDATED);
+        }
+        hmap_remove(previous, &old->node);
+        lldp_destroy(old->lldp);
+        free(old);
+    }
+
+    HMAP_FOR_EACH (entry, node, previous) {
+        lldp = entry->lldp;
+        lldp_notify_change(lldp->name, chassis_id(lldp), lldp->rid,
+                           removal(lldp, last_ttl(lldp), port_is_running(lldp->name)));
+    }
+}
+
+void lldp_table_reset(struct list_node *list)
+{
+    struct hmap previous = HMAP_INITIALIZER(&previous);
+    lldp_t *lldp, *next;
+
+    pthread_rwlock_wrlock(&rwlock);
+
+    hmap_swap(&previous, &neighbors);
+    LIST_FOR_EACH_SAFE (lldp, next, node, list) {
+        list_remove(&lldp->node);
+        if (is_valid(lldp)) {
+            set_locked(&neighbors, lldp);
+        } else {
+            lldp_destroy(lldp);
+        }
+    }
+
+    /* The first sync only fills the table.  Later ones, after the
+     * connection to lldpd was lost, report what changed in between. */
+    if (primed) {
+        notify_sync_locked(&previous);
+    }
+    clear(&previous);
+    hmap_destroy(&previous);
+
+    generation++;
+    synced = true;
+    primed = true;
+
+    pthread_rwlock_unlock(&rwlock);
+
+    log_info("LLDP neighbor table synchronized, %lu neighbors",
+             (unsigned long)hmap_count(&neighbors));
+}
+
+void lldp_table_invalidate()
+{
+    /* The records are kept for the next sync to compare with. */
+    pthread_rwlock_wrlock(&rwlock);
+    generation++;
+    synced = false;
+    pthread_rwlock_unlock(&rwlock);
+}
+
+void lldp_table_set(lldp_t *lldp)
+{
+    enum lldp_change change;
+
+    if (!is_valid(lldp)) {
+        lldp_destroy(lldp);
+        return;
+    }
+
+    pthread_rwlock_wrlock(&rwlock);
+    change = set_locked(&neighbors, lldp);
+    lldp_notify_change(lldp->name, chassis_id(lldp), lldp->rid, change);
+    generation++;
+    pthread_rwlock_unlock(&rwlock);
+}
+
+void lldp_table_remove(const char *port, const char *chassis, const char *rid,
+                       int ttl)
+{
+    struct lldp_entry *entry;
+    bool running;
+
+    if (port == NULL || rid == NULL) {
+        return;
+    }
+    if (chassis == NULL) {
+        chassis = "";
+    }
+
+    /* Asked before the table is locked, readers do not wait for the
+     * kernel. */
+    running = port_is_running(port);
+
+    pthread_rwlock_wrlock(&rwlock);
+    entry = find_entry(&neighbors, port, chassis, rid, key_hash(port, chassis, rid));
+    if (entry != NULL) {
+        lldp_notify_change(port, chassis, rid,
+                           removal(entry->lldp, ttl >= 0 ? (uint32_t)ttl : last_ttl(entry->lldp),
+                                   running));
+        hmap_remove(&neighbors, &entry->node);
+        lldp_destroy(entry->lldp);
+        free(entry);
+        generation++;
+    }
+    pthread_rwlock_unlock(&rwlock);
+}
+
+bool lldp_table_read_lock(uint64_t *gen)
+{
+    pthread_rwlock_rdlock(&rwlock);
+    if (!synced) {
+        pthread_rwlock_unlock(&rwlock);
+        return false;
+    }
+
+    *gen = generation;
+    return true;
+}
+
+void lldp_table_unlock()
+{
+    pthread_rwlock_unlock(&rwlock);
+}
+
+void lldp_table_foreach(const char *port, void (*cb)(const lldp_t *, void *), void *aux)
+{
+    struct lldp_entry *entry;
+
+    HMAP_FOR_EACH (entry, node, &neighbors) {
+        if (port == NULL || strcmp(entry->lldp->name, port) == 0) {
+            cb(entry->lldp, aux);
+        }
+    }
+}
+
+void lldp_table_destroy()
+{
+    pthread_rwlock_wrlock(&rwlock);
+    clear(&neighbors);
+    hmap_destroy(&neighbors);
+    synced = false;
+    pthread_rwlock_unlock(&rwlock);
+}
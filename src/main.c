@@ -1,5 +1,10 @@
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/signalfd.h>
 #include "sysrepo.h"
 #include "sysrepo/xpath.h"
 
@@ -8,83 +13,334 @@
 
 #include "dynamic-string.h"
 #include "lldp.h"
+#include "lldp_notify.h"
+#include "lldp_table.h"
+#ifdef HAVE_LLDPCTL
+#include "lldp_ctl.h"
+#endif
 #include "interface.h"
 #include "bridge.h"
+#include "collector.h"
 #include "hardware.h"
 #include "dbus_util.h"
+#include "ethtool.h"
+#include "ethtool_stats.h"
+#include "fdb.h"
+#include "link_cache.h"
+#include "mdb.h"
+#include "monitor.h"
+#include "os_info.h"
+#include "reactor.h"
+#include "repo.h"
+#include "sampler.h"
+#include "stats_cache.h"
+#include "worker_pool.h"
 
-volatile int exit_application = 0;
 struct shash interfaces;
+static oper_actions_t oper_actions;
+static unsigned int n_workers = WORKER_POOL_DEFAULT_WORKERS;
+
+#ifdef HAVE_LLDPCTL
+#define LLDPD_SOCKET_USAGE \
+    "  -l, --lldpd-socket=PATH talk to lldpd on the control socket PATH\n"
+#else
+#define LLDPD_SOCKET_USAGE ""
+#endif
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [options]\n"
+           "  -s, --stats-period=MS   collect interface counters and driver statistics\n"
+           "                          every MS milliseconds while they are read\n"
+           "                          (default %d)\n"
+           "  -p, --sample-period=MS  sample interface counters for rates every\n"
+           "                          MS milliseconds, 0 disables (default %d)\n"
+           "  -j, --workers=N         collect per-port data on N worker threads,\n"
+           "                          0 on the main thread only (default %d)\n"
+           LLDPD_SOCKET_USAGE
+           "  -w, --lldp-notify-window=MS\n"
+           "                          coalesce lldp neighbor changes within MS\n"
+           "                          milliseconds into one notification (default %d)\n"
+           "  -h, --help              show this help\n",
+           program, STATS_CACHE_DEFAULT_PERIOD_MS, SAMPLER_DEFAULT_PERIOD_MS,
+           WORKER_POOL_DEFAULT_WORKERS,
+           LLDP_NOTIFY_DEFAULT_WINDOW_MS);
+}
+
+static int parse_options(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        {"stats-period",  required_argument, NULL, 's'},
+        {"sample-period", required_argument, NULL, 'p'},
+        {"workers",       required_argument, NULL, 'j'},
+        {"lldpd-socket",  required_argument, NULL, 'l'},
+        {"lldp-notify-window", required_argument, NULL, 'w'},
+        {"help",          no_argument,       NULL, 'h'},
+        {NULL,            0,                 NULL, 0},
+    };
+    char *end;
+    long value;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "s:p:j:l:w:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            value = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || value < 1 || value > 60000) {
+                fprintf(stderr, "Invalid statistics period: %s\n", optarg);
+                return -1;
+            }
+            stats_cache_set_period(value);
+            ethtool_stats_set_period(value);
+            break;
+        case 'p':
+            value = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || value < 0 || value > 60000) {
+                fprintf(stderr, "Invalid sample period: %s\n", optarg);
+                return -1;
+            }
+            sampler_set_period(value);
+            break;
+        case 'j':
+            value = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || value < 0 ||
+                value > WORKER_POOL_MAX_WORKERS - 1) {
+                fprintf(stderr, "Invalid number of workers: %s\n", optarg);
+                return -1;
+            }
+            n_workers = value;
+            break;
+        case 'l':
+#ifdef HAVE_LLDPCTL
+            lldp_ctl_set_socket(optarg);
+#else
+            fprintf(stderr, "Built without liblldpctl, ignore lldpd socket %s\n", optarg);
+#endif
+            break;
+        case 'w':
+            value = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || value < 0 || value > 60000) {
+                fprintf(stderr, "Invalid lldp notification window: %s\n", optarg);
+                return -1;
+            }
+            lldp_notify_set_window(value);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
 
 static int provider_cb(
     sr_session_ctx_t *session, uint32_t sub_id, const char *module_name, const char *xpath,
     const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data)
 {
-    log_info("Get request path: %s\n", xpath);
+    log_info("Get request path: %s, request xpath: %s\n", xpath, request_xpath);
     if (strcmp(module_name, "ietf-interfaces") == 0) {
         if (strcmp(xpath, "/ietf-interfaces:interfaces/interface/statistics") == 0) {
-            interface_statistics_provider(session, parent);
+            interface_statistics_provider(session, request_xpath, parent);
         } else if (strcmp(xpath, "/ietf-interfaces:interfaces/interface/oper-status") == 0) {
-            interface_oper_status_provider(session, parent);
+            interface_oper_status_provider(session, request_xpath, parent);
+        } else if (strcmp(xpath, "/ietf-interfaces:interfaces/interface/statistics/tsn-interface-driver-statistics:driver") == 0) {
+            interface_driver_statistics_provider(session, request_xpath, parent);
+        } else if (strcmp(xpath, "/ietf-interfaces:interfaces/interface/tsn-interface-rates:rates") == 0) {
+            interface_rates_provider(session, request_xpath, parent);
         }
     } else if (strcmp(module_name, "ieee802-dot1ab-lldp") == 0) {
         if (strcmp(xpath, "/ieee802-dot1ab-lldp:lldp/port") == 0) {
-            lldp_port_provider(session, parent);
+            lldp_port_provider(session, request_xpath, parent);
+        } else if (strcmp(xpath, "/ieee802-dot1ab-lldp:lldp/remote-statistics") == 0) {
+            lldp_remote_statistics_provider(session, request_xpath, parent);
+        }
+    } else if (strcmp(module_name, "ieee802-dot1q-bridge") == 0) {
+        if (strcmp(xpath, "/ieee802-dot1q-bridge:bridges/bridge/component/filtering-database") == 0) {
+            bridge_filtering_database_provider(session, request_xpath, parent);
+        } else if (strcmp(xpath, "/ieee802-dot1q-bridge:bridges/bridge/component/tsn-bridge-mdb:multicast-database") == 0) {
+            bridge_multicast_database_provider(session, request_xpath, parent);
         }
     }
 
     return SR_ERR_OK;
 }
 
-static int data_provider(sr_session_ctx_t *session)
+static void subscription_cb(int fd, uint32_t events, void *aux)
 {
-    sr_subscription_ctx_t *statistics_subscription = NULL;
-    sr_subscription_ctx_t *oper_status_subscription = NULL;
-    sr_subscription_ctx_t *lldp_subscription = NULL;
+    int rc = sr_subscription_process_events((sr_subscription_ctx_t*)aux, NULL, NULL);
+
+    if (rc != SR_ERR_OK) {
+        log_error("Process sysrepo events failed: %s", sr_strerror(rc));
+    }
+}
+
+static void signal_cb(int fd, uint32_t events, void *aux)
+{
+    struct signalfd_siginfo info;
+
+    if (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        log_info("Received signal %u, exit", info.ssi_signo);
+        reactor_stop();
+    }
+}
+
+static int data_provider(sr_session_ctx_t *session, const sigset_t *signals)
+{
+    /* All the subscriptions share one context without a thread of its own;
+     * its events are processed on the event loop. */
+    sr_subscription_ctx_t *subscription = NULL;
+    int event_pipe = -1, signal_fd = -1;
     int rc = SR_ERR_OK;
 
+    /* Data without notifications is collected off the event loop, so no
+     * get callback waits for the kernel or lldpd. */
+    stats_cache_collect();
+    ethtool_stats_collect(get_interface_names());
+    lldp_neighbors_collect();
+    if (collector_start() != 0) {
+        log_error("Start collector failed, statistics are not refreshed");
+    }
+
     rc = sr_oper_get_subscribe(session, "ietf-interfaces", "/ietf-interfaces:interfaces/interface/statistics",
-                               provider_cb, NULL, SR_SUBSCR_DEFAULT, &statistics_subscription);
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
+
+    rc = sr_oper_get_subscribe(session, "ietf-interfaces", "/ietf-interfaces:interfaces/interface/statistics/tsn-interface-driver-statistics:driver",
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
 
     rc = sr_oper_get_subscribe(session, "ietf-interfaces", "/ietf-interfaces:interfaces/interface/oper-status",
-                               provider_cb, NULL, SR_SUBSCR_DEFAULT, &oper_status_subscription);
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
+
+    if (sampler_start(get_interface_names()) != 0) {
+        log_error("Start counter sampler failed, interface rates are not available");
+    }
+
+    rc = sr_oper_get_subscribe(session, "ietf-interfaces", "/ietf-interfaces:interfaces/interface/tsn-interface-rates:rates",
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
 
     rc = sr_oper_get_subscribe(session, "ieee802-dot1ab-lldp", "/ieee802-dot1ab-lldp:lldp/port",
-                               provider_cb, NULL, SR_SUBSCR_DEFAULT, &lldp_subscription);
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
+
+    rc = sr_oper_get_subscribe(session, "ieee802-dot1ab-lldp", "/ieee802-dot1ab-lldp:lldp/remote-statistics",
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
+
+    rc = sr_oper_get_subscribe(session, "ieee802-dot1q-bridge", "/ieee802-dot1q-bridge:bridges/bridge/component/filtering-database",
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
 
-    while (!exit_application) {
-        sleep(1);
-        update_ips(&interfaces, session);
-        update_interfaces_speed(&interfaces, session);
+    rc = sr_oper_get_subscribe(session, "ieee802-dot1q-bridge", "/ieee802-dot1q-bridge:bridges/bridge/component/tsn-bridge-mdb:multicast-database",
+                               provider_cb, NULL, SR_SUBSCR_NO_THREAD, &subscription);
+
+    if (NULL == subscription) {
+        log_error("Subscribe to sysrepo failed: %s", sr_strerror(rc));
+        goto cleanup;
     }
 
-cleanup:
-    if (NULL != statistics_subscription) {
-        sr_unsubscribe(statistics_subscription);
+    rc = sr_get_event_pipe(subscription, &event_pipe);
+    if (rc != SR_ERR_OK) {
+        log_error("Get sysrepo event pipe failed: %s", sr_strerror(rc));
+        goto cleanup;
+    }
+    if (reactor_add_fd(event_pipe, EPOLLIN, subscription_cb, subscription) != 0) {
+        rc = SR_ERR_INTERNAL;
+        goto cleanup;
     }
 
-    if (NULL != oper_status_subscription) {
-        sr_unsubscribe(oper_status_subscription);
+    if (lldp_notify_start(sr_session_get_connection(session)) != 0) {
+        log_error("Start lldp notifications failed, neighbor changes are only counted");
     }
 
-    if (NULL != lldp_subscription) {
-        sr_unsubscribe(lldp_subscription);
+#ifdef HAVE_LLDPCTL
+    if (lldp_ctl_watch_start() != 0) {
+        log_error("Start lldpd watch failed, lldp neighbors are read on every get");
     }
+#endif
+
+    if (monitor_start(&interfaces, &oper_actions) != 0) {
+        log_error("Start netlink monitor failed, link and address changes will not be tracked");
+    }
+
+    signal_fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0 || reactor_add_fd(signal_fd, EPOLLIN, signal_cb, NULL) != 0) {
+        log_error("Watch for signals failed, stop with SIGKILL");
+    }
+
+    if (reactor_run() != 0) {
+        rc = SR_ERR_INTERNAL;
+    }
+
+    monitor_stop();
+
+    if (signal_fd >= 0) {
+        reactor_del_fd(signal_fd);
+        close(signal_fd);
+    }
+
+cleanup:
+    if (event_pipe >= 0) {
+        reactor_del_fd(event_pipe);
+    }
+
+    if (NULL != subscription) {
+        sr_unsubscribe(subscription);
+    }
+
+    sampler_stop();
+    collector_stop();
+
+#ifdef HAVE_LLDPCTL
+    lldp_ctl_watch_stop();
+#endif
+    lldp_notify_stop();
 
     return rc;
 }
 
+/* The subtrees of the running datastore the daemon writes at startup. */
+static const char *const owned_subtrees[] = {
+    "/ietf-interfaces:interfaces",
+    "/ieee802-dot1q-bridge:bridges",
+    "/ieee802-dot1ab-lldp:lldp",
+    NULL,
+};
+
 int main(int argc, char *argv[])
 {
     struct shash_node *node, *node_next;
     struct interface *intf;
+    struct shash bridges;
     sr_conn_ctx_t *connection = NULL;
     sr_session_ctx_t *session = NULL;
+    write_batch_t batch;
+    sigset_t signals;
     int rc = SR_ERR_OK;
 
+    if (parse_options(argc, argv) != 0) {
+        return 1;
+    }
+
     log_set_level(LOG_INFO);
 
+    /* Blocked before any thread starts, so that they are only read from the
+     * signalfd of the event loop. */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (reactor_init() != 0) {
+        log_fatal("Initialize event loop failed");
+        return 1;
+    }
+
+    if (worker_pool_init(n_workers) != 0) {
+        log_warn("Start worker threads failed, collect per-port data on the main thread");
+    }
+
     shash_init(&interfaces);
+    oper_actions_init(&oper_actions);
 
     // set sysrepo's log level
     sr_log_stderr(SR_LL_WRN);
@@ -101,57 +357,71 @@ int main(int argc, char *argv[])
         goto cleanup;
     }
 
-    rc = sr_delete_item(session, "/ieee802-dot1ab-lldp:lldp", SR_EDIT_DEFAULT);
-    if (rc != SR_ERR_OK) {
-        log_error("Delete lldp from sysrepo failed: %s", sr_strerror(rc));
+    /* Edits of the event handlers are written behind, on a thread and a
+     * session of their own. */
+    if (oper_actions_start(&oper_actions, connection) != 0) {
+        log_fatal("Start sysrepo writer failed");
+        goto cleanup;
     }
 
-    rc = sr_apply_changes(session, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Delete lldp from sysrepo apply failed: %s", sr_strerror(rc));
+    rc = link_cache_init();
+    if (rc != 0) {
+        log_fatal("Initialize rtnl link cache failed");
+        goto cleanup;
     }
 
-    // delete all interfaces in sysrepo
-    rc = sr_delete_item(session, "/ietf-interfaces:interfaces", SR_EDIT_DEFAULT);
-    if (rc != SR_ERR_OK) {
-        log_error("Delete interface from sysrepo failed: %s", sr_strerror(rc));
+    if (ethtool_init() != 0) {
+        log_warn("Ethtool netlink is not available, read link speed with ioctl");
     }
-    rc = sr_apply_changes(session, 0);
-    if (rc != SR_ERR_OK) {
-        log_error("Delete interface from sysrepo apply failed: %s", sr_strerror(rc));
+
+    if (fdb_init() != 0) {
+        log_warn("Initialize bridge forwarding database mirror failed");
+    }
+
+    if (mdb_init() != 0) {
+        log_warn("Initialize bridge multicast database mirror failed");
     }
 
     // collect interfaces' info
     collect_interfaces(&interfaces);
+    shash_init(&bridges);
+    collect_bridges(&bridges);
+
+    /* The running content left by a previous run is brought in line with
+     * the kernel rather than deleted and written again, so an unchanged
+     * restart raises no change event. */
+    write_batch_begin_reconcile(&batch, session, "startup", owned_subtrees);
     SHASH_FOR_EACH(node, &interfaces) {
         intf = (struct interface*)node->data;
-        save_interface_running(intf, session);
+        save_interface_running(intf, &batch);
     }
-
-
-    sr_session_switch_ds(session, SR_DS_OPERATIONAL);
+    save_interfaces_ips(&interfaces, &batch);
+    save_bridges_running(&bridges, &batch);
+    write_batch_end(&batch);
+
+    /* Pushed operational data belongs to the session that pushed it, and
+     * the writer's session keeps it current, so it pushes the startup
+     * values as well. */
+    write_batch_begin_queued(&batch, &oper_actions, "interfaces");
+    write_batch_switch_ds(&batch, SR_DS_OPERATIONAL);
     SHASH_FOR_EACH(node, &interfaces) {
         intf = (struct interface*)node->data;
-        save_interface_operational(intf, session);
+        save_interface_operational(intf, &batch);
+    }
+    save_bridges_operational(&bridges, &batch);
+    write_batch_switch_ds(&batch, SR_DS_RUNNING);
+    save_hardware_chassis(&batch);
+    write_batch_end(&batch);
+    destroy_bridges(&bridges);
+
+    if (dbus_util_init() == 0) {
+        dbus_query("test");
     }
-    sr_session_switch_ds(session, SR_DS_RUNNING);
-
-    save_hardware_chassis(session);
-    update_ips(&interfaces, session);
-
-
-    dbus_query("test");
-
-    struct shash bridges;
-    struct shash_node *br_node = NULL;
-    shash_init(&bridges);
-    collect_bridges(&bridges);
-    save_bridges(&bridges, session);
-    shash_destroy_free_data(&bridges);
 
-    rc = data_provider(session);
+    rc = data_provider(session, &signals);
 
 cleanup:
+    oper_actions_destroy(&oper_actions);
     sr_disconnect(connection);
 
     SHASH_FOR_EACH_SAFE(node, node_next, &interfaces) {
@@ -160,6 +430,22 @@ cleanup:
     shash_destroy(&interfaces);
 
     destroy_interface_names();
+    os_info_destroy();
+
+    stats_cache_destroy();
+    ethtool_stats_destroy();
+    ethtool_destroy();
+#ifdef HAVE_LLDPCTL
+    lldp_ctl_destroy();
+#endif
+    lldp_provider_destroy();
+    lldp_table_destroy();
+    fdb_destroy();
+    mdb_destroy();
+    link_cache_destroy();
+    dbus_util_destroy();
+    worker_pool_destroy();
+    reactor_destroy();
 
     return 0;
 }
@@ -0,0 +1,510 @@
+#include "mdb.h"
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/if_bridge.h>
+#include <linux/if_ether.h>
+#include <linux/rtnetlink.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+
+#include "bridge.h"
+#include "hash.h"
+#include "hmap.h"
+#include "log.h"
+#include "nl_mirror.h"
+#include "oper_tree.h"
+#include "util.h"
+#include "utils.h"
+
+/* Kernel socket buffer of the notification socket.  Joins and leaves are
+ * far rarer than learning, a general query answered by many hosts is the
+ * burst to absorb. */
+#define MDB_EVENT_BUFFER_SIZE (1024 * 1024)
+
+struct mdb_group_key {
+    uint8_t addr[16];   /* IPv4, IPv6 or MAC address, zero padded. */
+    uint16_t proto;     /* ETH_P_IP, ETH_P_IPV6 or 0 for a MAC address. */
+    uint16_t vid;       /* 0 on a VLAN-unaware bridge. */
+};
+
+struct mdb_port {
+    struct hmap_node node;      /* By ifindex. */
+    int ifindex;                /* The bridge itself if the host joined. */
+    bool permanent;             /* Added by management, never times out. */
+};
+
+struct mdb_group {
+    struct hmap_node node;      /* By key. */
+    struct mdb_group_key key;
+    struct hmap ports;
+};
+
+struct mdb_bridge {
+    struct hmap_node node;      /* By ifindex. */
+    int ifindex;
+    struct hmap groups;
+};
+
+/* One port of one group, as a notification or a dump reports it. */
+struct mdb_record {
+    int bridge;
+    struct mdb_group_key key;
+    int port;
+    bool permanent;
+};
+
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static struct hmap bridges = HMAP_INITIALIZER(&bridges);
+
+static struct mdb_bridge *find_bridge(const struct hmap *map, int ifindex)
+{
+    struct mdb_bridge *br;
+
+    HMAP_FOR_EACH_WITH_HASH (br, node, hash_int(ifindex, 0), map) {
+        if (br->ifindex == ifindex) {
+            return br;
+        }
+    }
+
+    return NULL;
+}
+
+static struct mdb_group *find_group(const struct mdb_bridge *br,
+                                    const struct mdb_group_key *key)
+{
+    struct mdb_group *group;
+
+    HMAP_FOR_EACH_WITH_HASH (group, node, hash_bytes(key, sizeof(*key), 0), &br->groups) {
+        if (memcmp(&group->key, key, sizeof(*key)) == 0) {
+            return group;
+        }
+    }
+
+    return NULL;
+}
+
+static struct mdb_port *find_port(const struct mdb_group *group, int ifindex)
+{
+    struct mdb_port *port;
+
+    HMAP_FOR_EACH_WITH_HASH (port, node, hash_int(ifindex, 0), &group->ports) {
+        if (port->ifindex == ifindex) {
+            return port;
+        }
+    }
+
+    return NULL;
+}
+
+static void free_group(struct mdb_group *group)
+{
+    struct mdb_port *port, *next;
+
+    HMAP_FOR_EACH_SAFE (port, next, node, &group->ports) {
+        hmap_remove(&group->ports, &port->node);
+        free(port);
+    }
+    hmap_destroy(&group->ports);
+    free(group);
+}
+
+static void free_bridge(struct mdb_bridge *br)
+{
+    struct mdb_group *group, *next;
+
+    HMAP_FOR_EACH_SAFE (group, next, node, &br->groups) {
+        hmap_remove(&br->groups, &group->node);
+        free_group(group);
+    }
+    hmap_destroy(&br->groups);
+    free(br);
+}
+
+static void clear_bridges(struct hmap *map)
+{
+    struct mdb_bridge *br, *next;
+
+    HMAP_FOR_EACH_SAFE (br, next, node, map) {
+        hmap_remove(map, &br->node);
+        free_bridge(br);
+    }
+}
+
+static void add_record(struct hmap *map, const struct mdb_record *record)
+{
+    struct mdb_bridge *br;
+    struct mdb_group *group;
+    struct mdb_port *port;
+
+    br = find_bridge(map, record->bridge);
+    if (br == NULL) {
+        br = xmalloc(sizeof(*br));
+        br->ifindex = record->bridge;
+        hmap_init(&br->groups);
+        hmap_insert(map, &br->node, hash_int(br->ifindex, 0));
+    }
+
+    group = find_group(br, &record->key);
+    if (group == NULL) {
+        group = xmalloc(sizeof(*group));
+        group->key = record->key;
+        hmap_init(&group->ports);
+        hmap_insert(&br->groups, &group->node, hash_bytes(&group->key, sizeof(group->key), 0));
+    }
+
+    port = find_port(group, record->port);
+    if (port == NULL) {
+        port = xmalloc(sizeof(*port));
+        port->ifindex = record->port;
+        hmap_insert(&group->ports, &port->node, hash_int(port->ifindex, 0));
+    }
+    port->permanent = record->permanent;
+}
+
+/* Removes the port of 'record', and the group and the bridge with it once
+ * they are empty. */
+static void del_record(struct hmap *map, const struct mdb_record *record)
+{
+    struct mdb_bridge *br;
+    struct mdb_group *group;
+    struct mdb_port *port;
+
+    br = find_bridge(map, record->bridge);
+    group = br != NULL ? find_group(br, &record->key) : NULL;
+    port = group != NULL ? find_port(group, record->port) : NULL;
+    if (port == NULL) {
+        return;
+    }
+
+    hmap_remove(&group->ports, &port->node);
+    free(port);
+
+    if (hmap_is_empty(&group->ports)) {
+        hmap_remove(&br->groups, &group->node);
+        free_group(group);
+    }
+    if (hmap_is_empty(&br->groups)) {
+        hmap_remove(map, &br->node);
+        free_bridge(br);
+    }
+}
+
+/* Parses one MDBA_MDB_ENTRY_INFO of 'bridge'.  Returns false for the
+ * source-specific entries of IGMPv3 and MLDv2, which are kept by the kernel
+ * next to their group, and for unknown protocols. */
+static bool parse_entry_info(int bridge, struct nlattr *info, struct mdb_record *record)
+{
+    struct nlattr *tb[MDBA_MDB_EATTR_MAX + 1];
+    const struct br_mdb_entry *e;
+    int len = nla_len(info) - NLA_ALIGN(sizeof(*e));
+
+    if (len < 0) {
+        return false;
+    }
+
+    e = nla_data(info);
+    if (len > 0 &&
+        nla_parse(tb, MDBA_MDB_EATTR_MAX,
+                  (struct nlattr *)((char *)e + NLA_ALIGN(sizeof(*e))), len, NULL) == 0 &&
+        tb[MDBA_MDB_EATTR_SOURCE] != NULL) {
+        return false;
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->key.proto = ntohs(e->addr.proto);
+    switch (record->key.proto) {
+        case ETH_P_IP:
+            memcpy(record->key.addr, &e->addr.u.ip4, sizeof(e->addr.u.ip4));
+            break;
+        case ETH_P_IPV6:
+            memcpy(record->key.addr, &e->addr.u.ip6, sizeof(e->addr.u.ip6));
+            break;
+        case 0:
+            memcpy(record->key.addr, e->addr.u.mac_addr, ETH_ALEN);
+            break;
+        default:
+            return false;
+    }
+    record->key.vid = e->vid;
+    record->bridge = bridge;
+    record->port = e->ifindex;
+    record->permanent = e->state == MDB_PERMANENT;
+
+    return true;
+}
+
+/* Applies every entry of an RTM_NEWMDB or RTM_DELMDB to 'map'. */
+static void parse_mdb(struct nlmsghdr *hdr, struct hmap *map, bool add)
+{
+    struct nlattr *tb[MDBA_MAX + 1], *entry, *info;
+    struct br_port_msg *bpm;
+    struct mdb_record record;
+    int rem_entry, rem_info;
+
+    if (nlmsg_parse(hdr, sizeof(*bpm), tb, MDBA_MAX, NULL) < 0 || tb[MDBA_MDB] == NULL) {
+        return;
+    }
+
+    bpm = nlmsg_data(hdr);
+    if (bpm->family != AF_BRIDGE) {
+        return;
+    }
+
+    nla_for_each_nested(entry, tb[MDBA_MDB], rem_entry) {
+        if (nla_type(entry) != MDBA_MDB_ENTRY) {
+            continue;
+        }
+        nla_for_each_nested(info, entry, rem_info) {
+            if (nla_type(info) != MDBA_MDB_ENTRY_INFO ||
+                !parse_entry_info(bpm->ifindex, info, &record)) {
+                continue;
+            }
+            if (add) {
+                add_record(map, &record);
+            } else {
+                del_record(map, &record);
+            }
+        }
+    }
+}
+
+static size_t count_groups(const struct hmap *map)
+{
+    const struct mdb_bridge *br;
+    size_t count = 0;
+
+    HMAP_FOR_EACH (br, node, map) {
+        count += hmap_count(&br->groups);
+    }
+
+    return count;
+}
+
+static const struct br_port_msg dump_hdr = { .family = AF_BRIDGE };
+
+static struct nl_mirror mirror = {
+    .name = "MDB",
+    .unit = "groups",
+    .group = RTNLGRP_MDB,
+    .buffer_size = MDB_EVENT_BUFFER_SIZE,
+    .dump_type = RTM_GETMDB,
+    .dump_hdr = &dump_hdr,
+    .dump_hdr_len = sizeof(dump_hdr),
+    .new_type = RTM_NEWMDB,
+    .del_type = RTM_DELMDB,
+    .table = &bridges,
+    .rwlock = &rwlock,
+    .apply = parse_mdb,
+    .clear = clear_bridges,
+    .count = count_groups,
+};
+
+int mdb_init()
+{
+    return nl_mirror_init(&mirror);
+}
+
+void mdb_destroy()
+{
+    nl_mirror_destroy(&mirror);
+}
+
+int mdb_get_fd()
+{
+    return nl_mirror_get_fd(&mirror);
+}
+
+void mdb_process()
+{
+    nl_mirror_process(&mirror);
+}
+
+size_t mdb_count()
+{
+    size_t count;
+
+    pthread_rwlock_rdlock(&rwlock);
+    count = count_groups(&bridges);
+    pthread_rwlock_unlock(&rwlock);
+
+    return count;
+}
+
+static void format_group(const struct mdb_group_key *key, char *buf, size_t size)
+{
+    const uint8_t *a = key->addr;
+
+    switch (key->proto) {
+        case ETH_P_IP:
+            inet_ntop(AF_INET, a, buf, size);
+            break;
+        case ETH_P_IPV6:
+            inet_ntop(AF_INET6, a, buf, size);
+            break;
+        default:
+            snprintf(buf, size, "%02X-%02X-%02X-%02X-%02X-%02X",
+                     a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+    }
+}
+
+static void add_group(struct lyd_node *mcast_db, const struct mdb_group *group)
+{
+    struct lyd_node *group_node = NULL, *port_node;
+    const struct mdb_port *port;
+    char address[INET6_ADDRSTRLEN], name[IF_NAMESIZE];
+
+    format_group(&group->key, address, sizeof(address));
+    if (lyd_new_list(mcast_db, NULL, "group", 0, &group_node, address) != LY_SUCCESS) {
+        log_error("Create multicast group %s node failed", address);
+        return;
+    }
+
+    HMAP_FOR_EACH (port, node, &group->ports) {
+        if (if_indextoname(port->ifindex, name) == NULL) {
+            continue;
+        }
+        port_node = NULL;
+        if (lyd_new_list(group_node, NULL, "port", 0, &port_node, name) != LY_SUCCESS) {
+            log_error("Create multicast port %s node failed", name);
+            continue;
+        }
+        oper_tree_add_str(port_node, "state", port->permanent ? "permanent" : "temporary");
+    }
+}
+
+struct mdb_request {
+    const struct ly_ctx *ly_ctx;
+    struct lyd_node **parent;
+    struct lyd_node *component;     /* Set if sysrepo asks for one component. */
+    struct lyd_node **mcast_dbs;    /* By VID, of the bridge being added. */
+};
+
+/* Returns the multicast-database of the component of 'vid' of bridge 'name',
+ * creating the bridge, the component and the container on first use. */
+static struct lyd_node *component_mdb(struct mdb_request *req, struct lyd_node **bridge_node,
+                                      const char *name, int vid)
+{
+    struct lyd_node *root, *component = req->component;
+    char component_name[IF_NAMESIZE + 8];
+
+    if (req->mcast_dbs[vid] != NULL) {
+        return req->mcast_dbs[vid];
+    }
+
+    if (component == NULL) {
+        if (*bridge_node == NULL) {
+            root = oper_tree_root(req->ly_ctx, "ieee802-dot1q-bridge", "bridges", req->parent);
+            if (root == NULL ||
+                lyd_new_list(root, NULL, "bridge", 0, bridge_node, name) != LY_SUCCESS) {
+                log_error("Create bridge %s node failed", name);
+                return NULL;
+            }
+        }
+
+        bridge_component_name(component_name, sizeof(component_name), name, vid);
+        if (lyd_new_list(*bridge_node, NULL, "component", 0, &component,
+                         component_name) != LY_SUCCESS) {
+            log_error("Create component %s of bridge %s failed", component_name, name);
+            return NULL;
+        }
+    }
+
+    req->mcast_dbs[vid] = oper_tree_add_augment(req->ly_ctx, component, "tsn-bridge-mdb",
+                                                "multicast-database");
+    return req->mcast_dbs[vid];
+}
+
+/* Adds the groups of 'br' whose VID is 'vid', or of every VID if 'vid' is
+ * -1. */
+static void add_bridge(struct mdb_request *req, const struct mdb_bridge *br, int vid)
+{
+    struct lyd_node *bridge_node = NULL, *mcast_db;
+    const struct mdb_group *group;
+    char name[IF_NAMESIZE];
+
+    /* The groups of a bridge that is gone are not flushed with
+     * notifications. */
+    if (if_indextoname(br->ifindex, name) == NULL) {
+        return;
+    }
+
+    memset(req->mcast_dbs, 0, VLAN_N_IDS * sizeof(*req->mcast_dbs));
+
+    HMAP_FOR_EACH (group, node, &br->groups) {
+        if (vid >= 0 && group->key.vid != vid) {
+            continue;
+        }
+
+        mcast_db = component_mdb(req, &bridge_node, name, group->key.vid);
+        if (mcast_db != NULL) {
+            add_group(mcast_db, group);
+        }
+    }
+}
+
+void bridge_multicast_database_provider(sr_session_ctx_t *session,
+                                        const char *request_xpath,
+                                        struct lyd_node **parent)
+{
+    struct mdb_request req = { .parent = parent };
+    char *bridge_name = NULL, *component_name = NULL;
+    const struct lyd_node *dnode;
+    const struct mdb_bridge *br;
+    const char *key;
+    int ifindex = 0, vid = -1;
+
+    for (dnode = *parent; dnode != NULL; dnode = lyd_parent(dnode)) {
+        if ((key = oper_tree_list_key(dnode, "component")) != NULL) {
+            component_name = strdup(key);
+        } else if ((key = oper_tree_list_key(dnode, "bridge")) != NULL) {
+            bridge_name = strdup(key);
+        }
+    }
+    if (bridge_name == NULL) {
+        bridge_name = get_xpath_key(request_xpath, "bridge", "name");
+    }
+    if (component_name == NULL) {
+        component_name = get_xpath_key(request_xpath, "component", "name");
+    }
+
+    if (bridge_name != NULL && (ifindex = if_nametoindex(bridge_name)) == 0) {
+        goto cleanup;
+    }
+    if (component_name != NULL &&
+        (vid = bridge_component_vid(component_name, bridge_name)) < 0) {
+        goto cleanup;
+    }
+
+    req.ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+    if (*parent != NULL && strcmp(LYD_NAME(*parent), "component") == 0) {
+        req.component = *parent;
+    }
+    req.mcast_dbs = xmalloc(VLAN_N_IDS * sizeof(*req.mcast_dbs));
+
+    pthread_rwlock_rdlock(&rwlock);
+    if (ifindex != 0) {
+        br = find_bridge(&bridges, ifindex);
+        if (br != NULL) {
+            add_bridge(&req, br, vid);
+        }
+    } else {
+        HMAP_FOR_EACH (br, node, &bridges) {
+            add_bridge(&req, br, vid);
+        }
+    }
+    pthread_rwlock_unlock(&rwlock);
+
+    free(req.mcast_dbs);
+    sr_release_context(sr_session_get_connection(session));
+
+cleanup:
+    free(bridge_name);
+    free(component_name);
+}
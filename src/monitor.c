@@ -0,0 +1,269 @@
+#include "monitor.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include <linux/rtnetlink.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/route/link.h>
+#include <netlink/route/addr.h>
+
+#include "ethtool.h"
+#include "ethtool_stats.h"
+#include "fdb.h"
+#include "hash.h"
+#include "interface.h"
+#include "link_cache.h"
+#include "mdb.h"
+#include "log.h"
+#include "reactor.h"
+
+static struct nl_sock *sk = NULL;
+static bool running = false;
+
+/* The descriptors registered with the event loop. */
+static int watched[5];
+static int n_watched = 0;
+
+static struct shash *monitored = NULL;
+static oper_actions_t *monitor_queue = NULL;
+
+/* 'monitored' by ifindex, for the address events.  The interfaces and their
+ * indexes are collected once at startup, so it is built in monitor_start(). */
+static struct hmap by_index = HMAP_INITIALIZER(&by_index);
+
+static struct interface *find_interface_by_index(int ifindex)
+{
+    struct interface *intf;
+
+    HMAP_FOR_EACH_WITH_HASH (intf, index_node, hash_int(ifindex, 0), &by_index) {
+        if (intf->index == ifindex) {
+            return intf;
+        }
+    }
+
+    return NULL;
+}
+
+static void index_interfaces()
+{
+    struct shash_node *node;
+    struct interface *intf;
+
+    hmap_clear(&by_index);
+    SHASH_FOR_EACH(node, monitored) {
+        intf = (struct interface*)node->data;
+        hmap_insert(&by_index, &intf->index_node, hash_int(intf->index, 0));
+    }
+}
+
+static void handle_link(struct rtnl_link *link, int msgtype)
+{
+    struct interface *intf;
+    const char *name = rtnl_link_get_name(link);
+
+    if (name == NULL || (intf = shash_find_data(monitored, name)) == NULL) {
+        return;
+    }
+
+    if (msgtype == RTM_DELLINK) {
+        log_warn("Interface-%s was removed from the kernel", name);
+        ethtool_stats_counters_changed();
+        return;
+    }
+
+    update_interface_link(intf, rtnl_link_get_flags(link),
+                          rtnl_link_get_operstate(link), rtnl_link_get_mtu(link),
+                          monitor_queue);
+}
+
+static void handle_addr(struct rtnl_addr *rtnl_addr, int msgtype)
+{
+    struct interface *intf;
+    struct nl_addr *local;
+    char addr[INET6_ADDRSTRLEN] = {0};
+    int family;
+
+    intf = find_interface_by_index(rtnl_addr_get_ifindex(rtnl_addr));
+    if (intf == NULL) {
+        return;
+    }
+
+    family = rtnl_addr_get_family(rtnl_addr);
+    local = rtnl_addr_get_local(rtnl_addr);
+    if (local == NULL || (family != AF_INET && family != AF_INET6)) {
+        return;
+    }
+
+    if (inet_ntop(family, nl_addr_get_binary_addr(local), addr, sizeof(addr)) == NULL) {
+        log_error("Convert address of interface-%s failed", intf->name);
+        return;
+    }
+
+    update_interface_address(intf, family == AF_INET, addr,
+                             rtnl_addr_get_prefixlen(rtnl_addr),
+                             msgtype == RTM_DELADDR, monitor_queue);
+}
+
+static void handle_link_modes(const char *name, const struct ethtool_link *link, void *aux)
+{
+    struct interface *intf = shash_find_data(monitored, name);
+
+    if (intf != NULL) {
+        update_interface_speed(intf, link->speed, monitor_queue);
+    }
+}
+
+static void handle_stats_change(const char *name, void *aux)
+{
+    if (shash_find_data(monitored, name) != NULL) {
+        ethtool_stats_counters_changed();
+    }
+}
+
+static void object_cb(struct nl_object *obj, void *arg)
+{
+    const char *type = nl_object_get_type(obj);
+    int msgtype = nl_object_get_msgtype(obj);
+
+    if (strcmp(type, "route/link") == 0) {
+        handle_link((struct rtnl_link*)obj, msgtype);
+    } else if (strcmp(type, "route/addr") == 0) {
+        handle_addr((struct rtnl_addr*)obj, msgtype);
+    }
+}
+
+static int event_cb(struct nl_msg *msg, void *arg)
+{
+    nl_msg_parse(msg, object_cb, arg);
+    return NL_OK;
+}
+
+/* Rewrites everything from a full kernel walk.  Used once the subscription is
+ * in place, so nothing that changed during startup is missed, and whenever
+ * the socket overflowed and notifications were lost. */
+static void resync()
+{
+    update_ips(monitored, monitor_queue);
+    update_interfaces_speed(monitored, monitor_queue);
+    ethtool_stats_counters_changed();
+}
+
+static void rtnl_cb(int fd, uint32_t events, void *aux)
+{
+    int rc = nl_recvmsgs_default(sk);
+
+    if (rc == -NLE_NOMEM) {
+        log_warn("Netlink monitor overflowed, resynchronize with the kernel");
+        resync();
+    } else if (rc < 0 && rc != -NLE_AGAIN) {
+        log_error("Receive netlink notification failed: %s", nl_geterror(rc));
+    }
+}
+
+static void link_cache_cb(int fd, uint32_t events, void *aux)
+{
+    link_cache_process();
+}
+
+static void ethtool_cb(int fd, uint32_t events, void *aux)
+{
+    if (ethtool_monitor_process(handle_link_modes, handle_stats_change, NULL) == -NLE_NOMEM) {
+        ethtool_stats_counters_changed();
+    }
+}
+
+static void fdb_cb(int fd, uint32_t events, void *aux)
+{
+    fdb_process();
+}
+
+static void mdb_cb(int fd, uint32_t events, void *aux)
+{
+    mdb_process();
+}
+
+/* The shared link cache, the ethtool monitor and the FDB and MDB mirrors are
+ * served with the monitor; a negative fd means one is not available. */
+static bool watch_fd(int fd, reactor_fd_cb cb)
+{
+    if (fd >= 0 && reactor_add_fd(fd, EPOLLIN, cb, NULL) == 0) {
+        watched[n_watched++] = fd;
+        return true;
+    }
+    return false;
+}
+
+int monitor_start(struct shash *interfaces, oper_actions_t *queue)
+{
+    int rc;
+
+    monitored = interfaces;
+    monitor_queue = queue;
+    index_interfaces();
+
+    sk = nl_socket_alloc();
+    if (sk == NULL) {
+        log_error("Allocate nl socket failed");
+        return -1;
+    }
+
+    nl_socket_disable_seq_check(sk);
+    nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, event_cb, NULL);
+
+    rc = nl_connect(sk, NETLINK_ROUTE);
+    if (rc != 0) {
+        log_error("Connect to nl failed: %s", nl_geterror(rc));
+        goto error;
+    }
+
+    rc = nl_socket_add_memberships(sk, RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR,
+                                   RTNLGRP_IPV6_IFADDR, 0);
+    if (rc != 0) {
+        log_error("Join rtnl multicast groups failed: %s", nl_geterror(rc));
+        goto error;
+    }
+
+    nl_socket_set_nonblocking(sk);
+
+    resync();
+
+    n_watched = 0;
+    watch_fd(nl_socket_get_fd(sk), rtnl_cb);
+    watch_fd(link_cache_get_fd(), link_cache_cb);
+    ethtool_stats_set_notified(watch_fd(ethtool_monitor_fd(), ethtool_cb));
+    watch_fd(fdb_get_fd(), fdb_cb);
+    watch_fd(mdb_get_fd(), mdb_cb);
+    running = true;
+
+    return 0;
+
+error:
+    nl_close(sk);
+    nl_socket_free(sk);
+    sk = NULL;
+    hmap_clear(&by_index);
+    return -1;
+}
+
+void monitor_stop()
+{
+    if (!running) {
+        return;
+    }
+
+    running = false;
+    ethtool_stats_set_notified(false);
+    for (int i = 0; i < n_watched; i++) {
+        reactor_del_fd(watched[i]);
+    }
+    n_watched = 0;
+
+    nl_close(sk);
+    nl_socket_free(sk);
+    sk = NULL;
+
+    hmap_destroy(&by_index);
+    hmap_init(&by_index);
+}
@@ -0,0 +1,208 @@
+#include "nl_mirror.h"
+
+#include <stdlib.h>
+
+#include <linux/rtnetlink.h>
+#include <netlink/msg.h>
+
+#include "log.h"
+
+struct dump_request {
+    const struct nl_mirror *mirror;
+    struct hmap *table;
+};
+
+static int dump_cb(struct nl_msg *msg, void *arg)
+{
+    struct dump_request *req = arg;
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+
+    if (hdr->nlmsg_type == req->mirror->new_type) {
+        req->mirror->apply(hdr, req->table, true);
+    }
+
+    return NL_OK;
+}
+
+/* Dumps the kernel table into 'table'.  Entries are added as the dump is
+ * received. */
+static int dump(const struct nl_mirror *mirror, struct hmap *table)
+{
+    struct dump_request req = { mirror, table };
+    struct nl_sock *sk;
+    struct nl_msg *msg = NULL;
+    int rc;
+
+    sk = nl_socket_alloc();
+    if (sk == NULL) {
+        log_error("Allocate nl socket failed");
+        return -NLE_NOMEM;
+    }
+
+    rc = nl_connect(sk, NETLINK_ROUTE);
+    if (rc != 0) {
+        log_error("Connect to nl failed: %s", nl_geterror(rc));
+        goto cleanup;
+    }
+
+    msg = nlmsg_alloc_simple(mirror->dump_type, NLM_F_DUMP);
+    if (msg == NULL ||
+        nlmsg_append(msg, (void *)mirror->dump_hdr, mirror->dump_hdr_len, NLMSG_ALIGNTO) < 0) {
+        log_error("Build %s dump request failed", mirror->name);
+        rc = -NLE_NOMEM;
+        goto cleanup;
+    }
+
+    nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, dump_cb, &req);
+
+    rc = nl_send_auto(sk, msg);
+    if (rc < 0) {
+        log_error("Request %s failed: %s", mirror->name, nl_geterror(rc));
+        goto cleanup;
+    }
+
+    rc = nl_recvmsgs_default(sk);
+    if (rc < 0) {
+        log_error("Receive %s failed: %s", mirror->name, nl_geterror(rc));
+        goto cleanup;
+    }
+    rc = 0;
+
+cleanup:
+    nlmsg_free(msg);
+    nl_close(sk);
+    nl_socket_free(sk);
+    return rc;
+}
+
+/* Replaces the mirror with a new dump. */
+static int resync(struct nl_mirror *mirror)
+{
+    struct hmap fresh = HMAP_INITIALIZER(&fresh);
+    size_t count;
+    int rc;
+
+    rc = dump(mirror, &fresh);
+    if (rc != 0) {
+        mirror->clear(&fresh);
+        hmap_destroy(&fresh);
+        return rc;
+    }
+
+    pthread_rwlock_wrlock(mirror->rwlock);
+    hmap_swap(&fresh, mirror->table);
+    count = mirror->count(mirror->table);
+    pthread_rwlock_unlock(mirror->rwlock);
+
+    log_info("%s mirror synchronized, %lu %s", mirror->name, (unsigned long)count,
+             mirror->unit);
+
+    mirror->clear(&fresh);
+    hmap_destroy(&fresh);
+    return 0;
+}
+
+static int event_cb(struct nl_msg *msg, void *arg)
+{
+    struct nl_mirror *mirror = arg;
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+
+    if (mirror->discarding ||
+        (hdr->nlmsg_type != mirror->new_type && hdr->nlmsg_type != mirror->del_type)) {
+        return NL_OK;
+    }
+
+    pthread_rwlock_wrlock(mirror->rwlock);
+    mirror->apply(hdr, mirror->table, hdr->nlmsg_type == mirror->new_type);
+    pthread_rwlock_unlock(mirror->rwlock);
+
+    return NL_OK;
+}
+
+int nl_mirror_init(struct nl_mirror *mirror)
+{
+    int rc;
+
+    mirror->discarding = false;
+    mirror->event_sk = nl_socket_alloc();
+    if (mirror->event_sk == NULL) {
+        log_error("Allocate nl socket failed");
+        return -1;
+    }
+
+    nl_socket_disable_seq_check(mirror->event_sk);
+    nl_socket_modify_cb(mirror->event_sk, NL_CB_VALID, NL_CB_CUSTOM, event_cb, mirror);
+
+    rc = nl_connect(mirror->event_sk, NETLINK_ROUTE);
+    if (rc != 0) {
+        log_error("Connect to nl failed: %s", nl_geterror(rc));
+        goto error;
+    }
+
+    rc = nl_socket_set_buffer_size(mirror->event_sk, mirror->buffer_size, 0);
+    if (rc != 0) {
+        log_warn("Set %s notification buffer size failed: %s", mirror->name,
+                 nl_geterror(rc));
+    }
+
+    rc = nl_socket_add_memberships(mirror->event_sk, mirror->group, 0);
+    if (rc != 0) {
+        log_error("Join rtnl %s group failed: %s", mirror->name, nl_geterror(rc));
+        goto error;
+    }
+
+    nl_socket_set_nonblocking(mirror->event_sk);
+
+    if (resync(mirror) != 0) {
+        goto error;
+    }
+
+    return 0;
+
+error:
+    nl_close(mirror->event_sk);
+    nl_socket_free(mirror->event_sk);
+    mirror->event_sk = NULL;
+    return -1;
+}
+
+void nl_mirror_destroy(struct nl_mirror *mirror)
+{
+    if (mirror->event_sk != NULL) {
+        nl_close(mirror->event_sk);
+        nl_socket_free(mirror->event_sk);
+        mirror->event_sk = NULL;
+    }
+
+    pthread_rwlock_wrlock(mirror->rwlock);
+    mirror->clear(mirror->table);
+    hmap_destroy(mirror->table);
+    hmap_init(mirror->table);
+    pthread_rwlock_unlock(mirror->rwlock);
+}
+
+int nl_mirror_get_fd(const struct nl_mirror *mirror)
+{
+    return mirror->event_sk != NULL ? nl_socket_get_fd(mirror->event_sk) : -1;
+}
+
+void nl_mirror_process(struct nl_mirror *mirror)
+{
+    int rc = nl_recvmsgs_default(mirror->event_sk);
+
+    if (rc == -NLE_NOMEM) {
+        log_warn("%s notifications overflowed, dump the %s again", mirror->name,
+                 mirror->name);
+
+        mirror->discarding = true;
+        while ((rc = nl_recvmsgs_default(mirror->event_sk)) != -NLE_AGAIN &&
+               rc != -NLE_BAD_SOCK) {
+            continue;
+        }
+        mirror->discarding = false;
+
+        resync(mirror);
+    } else if (rc < 0 && rc != -NLE_AGAIN) {
+        log_error("Receive %s notification failed: %s", mirror->name, nl_geterror(rc));
+    }
+}
@@ -0,0 +1,162 @@
+#include "oper_tree.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+struct lyd_node *oper_tree_root(const struct ly_ctx *ctx, const char *module,
+                                const char *name, struct lyd_node **parent)
+{
+    const struct lys_module *mod;
+    LY_ERR err;
+
+    if (*parent != NULL && (*parent)->parent == NULL && (*parent)->schema != NULL &&
+        strcmp((*parent)->schema->name, name) == 0)
+    {
+        return *parent;
+    }
+
+    mod = ly_ctx_get_module_implemented(ctx, module);
+    if (mod == NULL) {
+        log_error("Module %s is not implemented", module);
+        return NULL;
+    }
+
+    err = lyd_new_inner(NULL, mod, name, 0, parent);
+    if (err != LY_SUCCESS) {
+        log_error("Create /%s:%s failed: %d", module, name, err);
+        return NULL;
+    }
+
+    return *parent;
+}
+
+const char *oper_tree_list_key(const struct lyd_node *node, const char *list)
+{
+    struct lyd_node *key;
+
+    if (node == NULL || node->schema == NULL || node->schema->nodetype != LYS_LIST ||
+        strcmp(node->schema->name, list) != 0)
+    {
+        return NULL;
+    }
+
+    key = lyd_child(node);
+    return key != NULL ? lyd_get_value(key) : NULL;
+}
+
+struct lyd_node *oper_tree_interface(const struct ly_ctx *ctx,
+                                     struct lyd_node **parent,
+                                     const char *name)
+{
+    struct lyd_node *root, *intf = NULL;
+    const char *key;
+
+    key = oper_tree_list_key(*parent, "interface");
+    if (key != NULL && strcmp(key, name) == 0) {
+        return *parent;
+    }
+
+    root = oper_tree_root(ctx, "ietf-interfaces", "interfaces", parent);
+    if (root == NULL) {
+        return NULL;
+    }
+
+    if (lyd_new_list(root, NULL, "interface", 0, &intf, name) != LY_SUCCESS) {
+        log_error("Create interface-%s node failed", name);
+        return NULL;
+    }
+
+    return intf;
+}
+
+static const char *interface_counter_names[IF_COUNTER_MAX] = {
+    [IF_COUNTER_IN_OCTETS] = "in-octets",
+    [IF_COUNTER_IN_UNICAST_PKTS] = "in-unicast-pkts",
+    [IF_COUNTER_IN_ERRORS] = "in-errors",
+    [IF_COUNTER_IN_DISCARDS] = "in-discards",
+    [IF_COUNTER_OUT_OCTETS] = "out-octets",
+    [IF_COUNTER_OUT_UNICAST_PKTS] = "out-unicast-pkts",
+    [IF_COUNTER_OUT_ERRORS] = "out-errors",
+    [IF_COUNTER_OUT_DISCARDS] = "out-discards",
+};
+
+struct lyd_node *oper_tree_interface_statistics(struct lyd_node *intf,
+                                                const char *discontinuity_time,
+                                                const uint64_t *counters)
+{
+    struct lyd_node *statistics;
+
+    statistics = oper_tree_add_container(intf, "statistics");
+    if (statistics == NULL) {
+        return NULL;
+    }
+
+    oper_tree_add_str(statistics, "discontinuity-time", discontinuity_time);
+    for (int i = 0; i < IF_COUNTER_MAX; i++) {
+        oper_tree_add_uint64(statistics, interface_counter_names[i], counters[i]);
+    }
+
+    return statistics;
+}
+
+struct lyd_node *oper_tree_add_container(struct lyd_node *node, const char *name)
+{
+    struct lyd_node *container = NULL;
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (lyd_new_inner(node, NULL, name, 0, &container) != LY_SUCCESS) {
+        log_error("Create %s node failed", name);
+        return NULL;
+    }
+
+    return container;
+}
+
+struct lyd_node *oper_tree_add_augment(const struct ly_ctx *ctx, struct lyd_node *node,
+                                       const char *module, const char *name)
+{
+    const struct lys_module *mod;
+    struct lyd_node *container = NULL;
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    mod = ly_ctx_get_module_implemented(ctx, module);
+    if (mod == NULL) {
+        log_error("Module %s is not implemented", module);
+        return NULL;
+    }
+
+    if (lyd_new_inner(node, mod, name, 0, &container) != LY_SUCCESS) {
+        log_error("Create %s:%s node failed", module, name);
+        return NULL;
+    }
+
+    return container;
+}
+
+void oper_tree_add_str(struct lyd_node *node, const char *name, const char *value)
+{
+    if (node == NULL || value == NULL) {
+        return;
+    }
+
+    if (lyd_new_term(node, NULL, name, value, 0, NULL) != LY_SUCCESS) {
+        log_error("Create %s=%s node failed", name, value);
+    }
+}
+
+void oper_tree_add_uint64(struct lyd_node *node, const char *name, uint64_t value)
+{
+    char value_str[24];
+
+    snprintf(value_str, sizeof(value_str), "%" PRIu64, value);
+    oper_tree_add_str(node, name, value_str);
+}
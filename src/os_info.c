@@ -0,0 +1,186 @@
+#include "os_info.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "util.h"
+
+/* DMI and devicetree strings are short; os-release is well under a page. */
+#define SYSFS_LINE_LEN 256
+#define OS_RELEASE_LEN 4096
+
+#define PRODUCT_NAME_PATH "/sys/devices/virtual/dmi/id/product_name"
+#define PRODUCT_VERSION_PATH "/sys/devices/virtual/dmi/id/product_version"
+#define SYS_MODEL_PATH "/sys/firmware/devicetree/base/model"
+
+static const char *os_release_paths[] = {
+    "/etc/os-release",
+    "/usr/lib/os-release",
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool probed = false;
+static char *hw_version = NULL;
+static char *sw_version = NULL;
+
+/* Reads up to 'size' - 1 bytes of 'path' with one read() into 'buf' and
+ * terminates them.  Returns the number of bytes read, -1 on error. */
+static ssize_t read_file(const char *path, char *buf, size_t size)
+{
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) {
+        return -1;
+    }
+
+    buf[n] = '\0';
+    return n;
+}
+
+/* Reads the first line of a sysfs attribute.  The devicetree terminates its
+ * strings with NUL rather than a newline, which ends the line as well. */
+static bool read_line(const char *path, char *buf, size_t size)
+{
+    if (read_file(path, buf, size) <= 0) {
+        return false;
+    }
+
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return buf[0] != '\0';
+}
+
+static char *probe_hardware_version()
+{
+    char name[SYSFS_LINE_LEN], version[SYSFS_LINE_LEN];
+    struct utsname uts;
+    size_t len;
+    char *res;
+
+    if (read_line(PRODUCT_NAME_PATH, name, sizeof(name))) {
+        if (!read_line(PRODUCT_VERSION_PATH, version, sizeof(version))) {
+            version[0] = '\0';
+        }
+        len = strlen(name) + strlen(version) + 2;
+        res = xmalloc(len);
+        snprintf(res, len, "%s %s", name, version);
+        return res;
+    }
+
+    if (read_line(SYS_MODEL_PATH, name, sizeof(name))) {
+        return strdup(name);
+    }
+
+    if (uname(&uts) != 0) {
+        log_error("Get hardware version failed");
+        return NULL;
+    }
+
+    return strdup(uts.machine);
+}
+
+/* Removes the quotes of an os-release value in place, with the backslash
+ * escapes of the shell. */
+static void unquote(char *value)
+{
+    char quote = value[0], *src = value + 1, *dst = value;
+
+    if (quote != '"' && quote != '\'') {
+        return;
+    }
+
+    for (; *src != '\0' && *src != quote; src++) {
+        if (*src == '\\' && quote == '"' && src[1] != '\0') {
+            src++;
+        }
+        *dst++ = *src;
+    }
+    *dst = '\0';
+}
+
+/* Returns the value of 'key' in the os-release 'buf', which is modified. */
+static char *os_release_value(char *buf, const char *key)
+{
+    size_t len = strlen(key);
+    char *line, *save = NULL;
+
+    for (line = strtok_r(buf, "\n", &save); line != NULL;
+         line = strtok_r(NULL, "\n", &save)) {
+        if (strncmp(line, key, len) == 0 && line[len] == '=') {
+            unquote(line + len + 1);
+            return line + len + 1;
+        }
+    }
+
+    return NULL;
+}
+
+static char *probe_software_version()
+{
+    char buf[OS_RELEASE_LEN];
+    char *value;
+
+    for (size_t i = 0; i < sizeof(os_release_paths) / sizeof(os_release_paths[0]); i++) {
+        if (read_file(os_release_paths[i], buf, sizeof(buf)) <= 0) {
+            continue;
+        }
+
+        value = os_release_value(buf, "PRETTY_NAME");
+        if (value != NULL && value[0] != '\0') {
+            return strdup(value);
+        }
+        log_warn("No PRETTY_NAME in %s", os_release_paths[i]);
+        return NULL;
+    }
+
+    log_error("Get software version failed: no os-release");
+    return NULL;
+}
+
+static void probe()
+{
+    pthread_mutex_lock(&mutex);
+    if (!probed) {
+        hw_version = probe_hardware_version();
+        sw_version = probe_software_version();
+        probed = true;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+const char *os_info_hardware_version()
+{
+    probe();
+    return hw_version;
+}
+
+const char *os_info_software_version()
+{
+    probe();
+    return sw_version;
+}
+
+void os_info_destroy()
+{
+    pthread_mutex_lock(&mutex);
+    free(hw_version);
+    free(sw_version);
+    hw_version = NULL;
+    sw_version = NULL;
+    probed = false;
+    pthread_mutex_unlock(&mutex);
+}
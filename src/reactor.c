@@ -0,0 +1,290 @@
+#include "reactor.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "hmap.h"
+#include "log.h"
+#include "util.h"
+
+/* Events taken from the kernel per epoll_wait(). */
+#define REACTOR_MAX_EVENTS 32
+
+struct fd_handler {
+    struct hmap_node node;          /* In 'handlers', by fd. */
+    int fd;
+    reactor_fd_cb cb;               /* NULL once removed. */
+    void *aux;
+    struct fd_handler *next_dead;
+};
+
+struct reactor_timer {
+    int fd;
+    reactor_timer_cb cb;
+    void *aux;
+};
+
+static int epoll_fd = -1;
+static int stop_fd = -1;
+static bool stopping = false;
+
+static struct hmap handlers = HMAP_INITIALIZER(&handlers);
+
+/* Handlers removed while a round of events is dispatched; a later event of
+ * the same round may still point at them, so they are freed after it. */
+static struct fd_handler *dead = NULL;
+
+static struct fd_handler *find_handler(int fd)
+{
+    struct fd_handler *h;
+
+    HMAP_FOR_EACH_WITH_HASH (h, node, hash_int(fd, 0), &handlers) {
+        if (h->fd == fd) {
+            return h;
+        }
+    }
+
+    return NULL;
+}
+
+static void free_dead()
+{
+    struct fd_handler *h;
+
+    while (dead != NULL) {
+        h = dead;
+        dead = h->next_dead;
+        free(h);
+    }
+}
+
+static void stop_cb(int fd, uint32_t events, void *aux)
+{
+    uint64_t value;
+
+    if (read(fd, &value, sizeof(value)) == sizeof(value)) {
+        stopping = true;
+    }
+}
+
+int reactor_init()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        log_error("Create epoll set failed: %s", strerror(errno));
+        return -1;
+    }
+
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd < 0) {
+        log_error("Create eventfd for event loop failed: %s", strerror(errno));
+        goto error;
+    }
+
+    if (reactor_add_fd(stop_fd, EPOLLIN, stop_cb, NULL) != 0) {
+        goto error;
+    }
+
+    return 0;
+
+error:
+    if (stop_fd >= 0) {
+        close(stop_fd);
+        stop_fd = -1;
+    }
+    close(epoll_fd);
+    epoll_fd = -1;
+    return -1;
+}
+
+void reactor_destroy()
+{
+    struct fd_handler *h, *next;
+
+    HMAP_FOR_EACH_SAFE (h, next, node, &handlers) {
+        hmap_remove(&handlers, &h->node);
+        free(h);
+    }
+    free_dead();
+
+    if (stop_fd >= 0) {
+        close(stop_fd);
+        stop_fd = -1;
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+}
+
+int reactor_add_fd(int fd, uint32_t events, reactor_fd_cb cb, void *aux)
+{
+    struct epoll_event ev = { .events = events };
+    struct fd_handler *h;
+
+    if (find_handler(fd) != NULL) {
+        log_error("Descriptor %d is in the event loop already", fd);
+        return -1;
+    }
+
+    h = xmalloc(sizeof(*h));
+    h->fd = fd;
+    h->cb = cb;
+    h->aux = aux;
+    h->next_dead = NULL;
+
+    ev.data.ptr = h;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        log_error("Add descriptor %d to event loop failed: %s", fd, strerror(errno));
+        free(h);
+        return -1;
+    }
+
+    hmap_insert(&handlers, &h->node, hash_int(fd, 0));
+    return 0;
+}
+
+int reactor_mod_fd(int fd, uint32_t events)
+{
+    struct epoll_event ev = { .events = events };
+    struct fd_handler *h = find_handler(fd);
+
+    if (h == NULL) {
+        return -1;
+    }
+
+    ev.data.ptr = h;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+        log_error("Modify descriptor %d in event loop failed: %s", fd, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+void reactor_del_fd(int fd)
+{
+    struct fd_handler *h = find_handler(fd);
+
+    if (h == NULL) {
+        return;
+    }
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    hmap_remove(&handlers, &h->node);
+
+    h->cb = NULL;
+    h->next_dead = dead;
+    dead = h;
+}
+
+static void timer_cb(int fd, uint32_t events, void *aux)
+{
+    struct reactor_timer *timer = aux;
+    uint64_t expirations;
+
+    /* Nothing to read if the timer was re-armed since it fired. */
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+
+    timer->cb(timer->aux);
+}
+
+struct reactor_timer *reactor_timer_create(reactor_timer_cb cb, void *aux)
+{
+    struct reactor_timer *timer;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        log_error("Create timerfd failed: %s", strerror(errno));
+        return NULL;
+    }
+
+    timer = xmalloc(sizeof(*timer));
+    timer->fd = fd;
+    timer->cb = cb;
+    timer->aux = aux;
+
+    if (reactor_add_fd(fd, EPOLLIN, timer_cb, timer) != 0) {
+        close(fd);
+        free(timer);
+        return NULL;
+    }
+
+    return timer;
+}
+
+static void ms_to_timespec(unsigned int ms, struct timespec *ts)
+{
+    ts->tv_sec = ms / 1000;
+    ts->tv_nsec = (long)(ms % 1000) * 1000000;
+}
+
+void reactor_timer_arm(struct reactor_timer *timer, unsigned int after_ms,
+                       unsigned int interval_ms)
+{
+    struct itimerspec spec;
+
+    ms_to_timespec(after_ms, &spec.it_value);
+    ms_to_timespec(interval_ms, &spec.it_interval);
+    if (timerfd_settime(timer->fd, 0, &spec, NULL) != 0) {
+        log_error("Arm timerfd failed: %s", strerror(errno));
+    }
+}
+
+void reactor_timer_destroy(struct reactor_timer *timer)
+{
+    if (timer == NULL) {
+        return;
+    }
+
+    reactor_del_fd(timer->fd);
+    close(timer->fd);
+    free(timer);
+}
+
+int reactor_run()
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    struct fd_handler *h;
+    int n;
+
+    stopping = false;
+    while (!stopping) {
+        n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Wait for events failed: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            h = events[i].data.ptr;
+            if (h->cb != NULL) {
+                h->cb(h->fd, events[i].events, h->aux);
+            }
+        }
+        free_dead();
+    }
+
+    return 0;
+}
+
+void reactor_stop()
+{
+    uint64_t one = 1;
+
+    if (stop_fd >= 0 && write(stop_fd, &one, sizeof(one)) < 0) {
+        /* The counter is already set, the loop stops anyway. */
+    }
+}
@@ -1,11 +1,331 @@
 #include "repo.h"
 
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sysrepo.h>
 
+#include "dynamic-string.h"
+#include "hash.h"
+#include "log.h"
+#include "util.h"
+#include "utils.h"
+
 void oper_actions_init(oper_actions_t *oper_actions)
 {
     pthread_mutex_init(&oper_actions->mutex, NULL);
+    pthread_cond_init(&oper_actions->queued, NULL);
+    pthread_cond_init(&oper_actions->taken, NULL);
     list_init(&oper_actions->actions);
+    hmap_init(&oper_actions->by_path);
+    oper_actions->n_actions = 0;
+    oper_actions->session = NULL;
+    oper_actions->running = false;
+    oper_actions->n_queued = 0;
+    oper_actions->n_coalesced = 0;
+    oper_actions->n_batches = 0;
+    oper_actions->n_waits = 0;
+    oper_actions->n_errors = 0;
+}
+
+static void action_free(action_t *action)
+{
+    free(action->path);
+    if (action->val != NULL) {
+        sr_free_val(action->val);
+    }
+    free(action->str);
+    free(action);
+}
+
+static uint32_t action_hash(sr_datastore_t ds, const char *path)
+{
+    return hash_string(path, ds);
+}
+
+static void remove_locked(oper_actions_t *actions, action_t *action)
+{
+    list_remove(&action->node);
+    hmap_remove(&actions->by_path, &action->hmap_node);
+    actions->n_actions--;
+    actions->n_coalesced++;
+    action_free(action);
+}
+
+/* Drops the queued edits of the nodes below 'path', which is deleted. */
+static void drop_below_locked(oper_actions_t *actions, sr_datastore_t ds,
+                              const char *path)
+{
+    size_t len = strlen(path);
+    action_t *action, *next;
+
+    LIST_FOR_EACH_SAFE (action, next, node, &actions->actions) {
+        if (action->ds == ds && strncmp(action->path, path, len) == 0 &&
+            action->path[len] == '/') {
+            remove_locked(actions, action);
+        }
+    }
+}
+
+static void enqueue(oper_actions_t *actions, action_t *action)
+{
+    uint32_t hash = action_hash(action->ds, action->path);
+    action_t *old;
+
+    pthread_mutex_lock(&actions->mutex);
+
+    /* Backpressure: the writer falls behind, let it take what is queued. */
+    while (actions->running && actions->n_actions >= OPER_ACTIONS_MAX_QUEUED) {
+        actions->n_waits++;
+        pthread_cond_wait(&actions->taken, &actions->mutex);
+    }
+
+    if (action->type == DELETE_ITEM) {
+        drop_below_locked(actions, action->ds, action->path);
+    }
+
+    /* A set after a delete of the same node is kept apart: the delete also
+     * removes what is below the node. */
+    HMAP_FOR_EACH_WITH_HASH (old, hmap_node, hash, &actions->by_path) {
+        if (old->ds == action->ds && strcmp(old->path, action->path) == 0 &&
+            (old->type == SET_ITEM || action->type == DELETE_ITEM)) {
+            remove_locked(actions, old);
+            break;
+        }
+    }
+
+    list_push_back(&actions->actions, &action->node);
+    hmap_insert(&actions->by_path, &action->hmap_node, hash);
+    actions->n_actions++;
+    actions->n_queued++;
+    pthread_cond_signal(&actions->queued);
+
+    pthread_mutex_unlock(&actions->mutex);
+}
+
+static action_t *action_create(action_type_t type, sr_datastore_t ds, const char *path)
+{
+    action_t *action = xmalloc(sizeof(*action));
+
+    action->type = type;
+    action->ds = ds;
+    action->path = strdup(path);
+    action->val = NULL;
+    action->str = NULL;
+    return action;
+}
+
+void oper_actions_set(oper_actions_t *actions, sr_datastore_t ds,
+                      const char *path, const sr_val_t *val)
+{
+    action_t *action = action_create(SET_ITEM, ds, path);
+
+    if (sr_dup_val(val, &action->val) != SR_ERR_OK) {
+        log_error("Queue %s failed: out of memory", path);
+        action_free(action);
+        return;
+    }
+    enqueue(actions, action);
+}
+
+void oper_actions_set_str(oper_actions_t *actions, sr_datastore_t ds,
+                          const char *path, const char *value)
+{
+    action_t *action = action_create(SET_ITEM, ds, path);
+
+    action->str = strdup(value);
+    enqueue(actions, action);
+}
+
+void oper_actions_delete(oper_actions_t *actions, sr_datastore_t ds,
+                         const char *path)
+{
+    enqueue(actions, action_create(DELETE_ITEM, ds, path));
+}
+
+static int apply_action(sr_session_ctx_t *session, const action_t *action)
+{
+    int rc;
+
+    if (action->type == DELETE_ITEM) {
+        rc = sr_delete_item(session, action->path, SR_EDIT_DEFAULT);
+    } else if (action->val != NULL) {
+        rc = sr_set_item(session, action->path, action->val, SR_EDIT_DEFAULT);
+    } else {
+        rc = sr_set_item_str(session, action->path, action->str, NULL, SR_EDIT_DEFAULT);
+    }
+
+    if (rc != SR_ERR_OK) {
+        log_error("Queued %s of %s failed: %s",
+                  action->type == DELETE_ITEM ? "delete" : "set",
+                  action->path, sr_strerror(rc));
+    }
+    return rc;
+}
+
+/* Applies the edits of 'batch' to 'ds', the deletes first, as one
+ * transaction.  Returns the number of errors. */
+static unsigned int apply_ds(sr_session_ctx_t *session, struct list_node *batch,
+                             sr_datastore_t ds)
+{
+    unsigned int errors = 0, edits = 0;
+    action_t *action;
+    int rc;
+
+    sr_session_switch_ds(session, ds);
+
+    for (int type = DELETE_ITEM; type <= SET_ITEM; type++) {
+        LIST_FOR_EACH (action, node, batch) {
+            if (action->ds != ds || action->type != (action_type_t)type) {
+                continue;
+            }
+            if (apply_action(session, action) == SR_ERR_OK) {
+                edits++;
+            } else {
+                errors++;
+            }
+        }
+    }
+
+    if (edits == 0) {
+        return errors;
+    }
+
+    rc = sr_apply_changes(session, 0);
+    if (rc != SR_ERR_OK) {
+        log_error("Apply %u queued edits failed: %s", edits, sr_strerror(rc));
+        sr_discard_changes(session);
+        errors++;
+    }
+
+    return errors;
+}
+
+static unsigned int apply_batch(sr_session_ctx_t *session, struct list_node *batch)
+{
+    static const sr_datastore_t datastores[] = {
+        SR_DS_STARTUP, SR_DS_RUNNING, SR_DS_CANDIDATE, SR_DS_OPERATIONAL,
+    };
+    unsigned int errors = 0;
+    bool present[sizeof(datastores) / sizeof(datastores[0])] = { false };
+    action_t *action;
+
+    LIST_FOR_EACH (action, node, batch) {
+        for (size_t i = 0; i < sizeof(datastores) / sizeof(datastores[0]); i++) {
+            if (action->ds == datastores[i]) {
+                present[i] = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(datastores) / sizeof(datastores[0]); i++) {
+        if (present[i]) {
+            errors += apply_ds(session, batch, datastores[i]);
+        }
+    }
+
+    return errors;
+}
+
+static void *writer_main(void *arg)
+{
+    oper_actions_t *actions = arg;
+    struct list_node batch;
+    action_t *action, *next;
+    unsigned int errors;
+
+    pthread_mutex_lock(&actions->mutex);
+    for (;;) {
+        while (actions->running && list_is_empty(&actions->actions)) {
+            pthread_cond_wait(&actions->queued, &actions->mutex);
+        }
+        if (list_is_empty(&actions->actions)) {
+            break;
+        }
+
+        /* Takes everything queued, the producers go on with an empty
+         * queue while the batch is applied. */
+        list_move(&batch, &actions->actions);
+        list_init(&actions->actions);
+        hmap_clear(&actions->by_path);
+        actions->n_actions = 0;
+        pthread_cond_broadcast(&actions->taken);
+        pthread_mutex_unlock(&actions->mutex);
+
+        errors = apply_batch(actions->session, &batch);
+        LIST_FOR_EACH_SAFE (action, next, node, &batch) {
+            list_remove(&action->node);
+            action_free(action);
+        }
+
+        pthread_mutex_lock(&actions->mutex);
+        actions->n_batches++;
+        actions->n_errors += errors;
+    }
+    pthread_mutex_unlock(&actions->mutex);
+
+    return NULL;
+}
+
+int oper_actions_start(oper_actions_t *actions, sr_conn_ctx_t *connection)
+{
+    int rc;
+
+    rc = sr_session_start(connection, SR_DS_RUNNING, &actions->session);
+    if (rc != SR_ERR_OK) {
+        log_error("Start session of the sysrepo writer failed: %s", sr_strerror(rc));
+        return -1;
+    }
+
+    actions->running = true;
+    if (pthread_create(&actions->thread, NULL, writer_main, actions) != 0) {
+        log_error("Create sysrepo writer thread failed");
+        actions->running = false;
+        sr_session_stop(actions->session);
+        actions->session = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void oper_actions_stop(oper_actions_t *actions)
+{
+    pthread_mutex_lock(&actions->mutex);
+    if (!actions->running) {
+        pthread_mutex_unlock(&actions->mutex);
+        return;
+    }
+    actions->running = false;
+    pthread_cond_signal(&actions->queued);
+    pthread_cond_broadcast(&actions->taken);
+    pthread_mutex_unlock(&actions->mutex);
+
+    pthread_join(actions->thread, NULL);
+    sr_session_stop(actions->session);
+    actions->session = NULL;
+
+    log_info("Sysrepo writer: %"PRIu64" edits queued, %"PRIu64" coalesced, "
+             "%"PRIu64" batches, %"PRIu64" producer waits, %"PRIu64" errors",
+             actions->n_queued,
+             actions->n_coalesced, actions->n_batches, actions->n_waits,
+             actions->n_errors);
+}
+
+void oper_actions_destroy(oper_actions_t *actions)
+{
+    action_t *action, *next;
+
+    oper_actions_stop(actions);
+
+    LIST_FOR_EACH_SAFE (action, next, node, &actions->actions) {
+        list_remove(&action->node);
+        action_free(action);
+    }
+    hmap_destroy(&actions->by_path);
+    pthread_cond_destroy(&actions->queued);
+    pthread_cond_destroy(&actions->taken);
+    pthread_mutex_destroy(&actions->mutex);
 }
 
 void clear_sysrepo(sr_session_ctx_t *session)
@@ -34,3 +354,313 @@ void clear_sysrepo(sr_session_ctx_t *session)
         fprintf(stderr, "Apply delete interfaces failed: %s\n", sr_strerror(rc));
     }
 }
+
+void write_batch_begin(write_batch_t *batch, sr_session_ctx_t *session,
+                       const char *name)
+{
+    batch->session = session;
+    batch->queue = NULL;
+    batch->ds = SR_DS_RUNNING;
+    batch->owned = NULL;
+    batch->ly_ctx = NULL;
+    batch->desired = NULL;
+    batch->name = name;
+    batch->edits = 0;
+    batch->pending = 0;
+    batch->commits = 0;
+    batch->errors = 0;
+    batch->start_us = get_monotonic_us();
+    batch->commit_us = 0;
+}
+
+void write_batch_begin_queued(write_batch_t *batch, oper_actions_t *queue,
+                              const char *name)
+{
+    write_batch_begin(batch, NULL, name);
+    batch->queue = queue;
+}
+
+void write_batch_begin_reconcile(write_batch_t *batch, sr_session_ctx_t *session,
+                                 const char *name, const char *const *owned)
+{
+    write_batch_begin(batch, session, name);
+    batch->owned = owned;
+    batch->ly_ctx = sr_acquire_context(sr_session_get_connection(session));
+}
+
+/* Adds 'path' to the content a reconcile wants, with 'value' if it is a
+ * leaf. */
+static int reconcile_set(write_batch_t *batch, const char *path, const char *value)
+{
+    struct lyd_node *node = NULL;
+    LY_ERR err;
+
+    /* A list or container that is there already is no error. */
+    err = lyd_new_path(batch->desired, batch->ly_ctx, path, value,
+                       LYD_NEW_PATH_UPDATE, &node);
+    if (err != LY_SUCCESS && err != LY_EEXIST) {
+        log_error("Set %s failed: %s", path, ly_errmsg(batch->ly_ctx));
+        batch->errors++;
+        return SR_ERR_LY;
+    }
+
+    /* The first path creates the tree, a path into another module a new
+     * top-level sibling. */
+    if (batch->desired == NULL) {
+        batch->desired = node;
+    }
+    if (batch->desired != NULL) {
+        batch->desired = lyd_first_sibling(batch->desired);
+    }
+    return SR_ERR_OK;
+}
+
+int write_batch_set(write_batch_t *batch, const char *path, const sr_val_t *val)
+{
+    char *value;
+    int rc;
+
+    if (batch->owned != NULL) {
+        value = val != NULL ? sr_val_to_str(val) : NULL;
+        rc = reconcile_set(batch, path, value);
+        free(value);
+        return rc;
+    }
+
+    if (batch->queue != NULL) {
+        oper_actions_set(batch->queue, batch->ds, path, val);
+        batch->edits++;
+        return SR_ERR_OK;
+    }
+
+    rc = sr_set_item(batch->session, path, val, SR_EDIT_DEFAULT);
+    if (rc != SR_ERR_OK) {
+        log_error("Set %s failed: %s", path, sr_strerror(rc));
+        batch->errors++;
+        return rc;
+    }
+
+    batch->edits++;
+    batch->pending++;
+    return rc;
+}
+
+int write_batch_set_str(write_batch_t *batch, const char *path, const char *value)
+{
+    int rc;
+
+    if (batch->owned != NULL) {
+        return reconcile_set(batch, path, value);
+    }
+
+    if (batch->queue != NULL) {
+        oper_actions_set_str(batch->queue, batch->ds, path, value);
+        batch->edits++;
+        return SR_ERR_OK;
+    }
+
+    rc = sr_set_item_str(batch->session, path, value, NULL, SR_EDIT_DEFAULT);
+    if (rc != SR_ERR_OK) {
+        log_error("Set %s=%s failed: %s", path, value, sr_strerror(rc));
+        batch->errors++;
+        return rc;
+    }
+
+    batch->edits++;
+    batch->pending++;
+    return rc;
+}
+
+int write_batch_delete(write_batch_t *batch, const char *path)
+{
+    int rc;
+
+    /* What a reconcile does not set is deleted anyway. */
+    if (batch->owned != NULL) {
+        return SR_ERR_OK;
+    }
+
+    if (batch->queue != NULL) {
+        oper_actions_delete(batch->queue, batch->ds, path);
+        batch->edits++;
+        return SR_ERR_OK;
+    }
+
+    rc = sr_delete_item(batch->session, path, SR_EDIT_DEFAULT);
+    if (rc != SR_ERR_OK) {
+        log_error("Delete %s failed: %s", path, sr_strerror(rc));
+        batch->errors++;
+        return rc;
+    }
+
+    batch->edits++;
+    batch->pending++;
+    return rc;
+}
+
+int write_batch_flush(write_batch_t *batch)
+{
+    uint64_t start;
+    int rc;
+
+    if (batch->pending == 0) {
+        return SR_ERR_OK;
+    }
+
+    start = get_monotonic_us();
+    rc = sr_apply_changes(batch->session, 0);
+    batch->commit_us += get_monotonic_us() - start;
+    batch->commits++;
+    batch->pending = 0;
+
+    if (rc != SR_ERR_OK) {
+        log_error("Apply %s changes failed: %s", batch->name, sr_strerror(rc));
+        sr_discard_changes(batch->session);
+        batch->errors++;
+    }
+
+    return rc;
+}
+
+/* A session edits one datastore at a time, so whatever is pending for the
+ * current one is applied first. */
+int write_batch_switch_ds(write_batch_t *batch, sr_datastore_t ds)
+{
+    int rc = write_batch_flush(batch);
+
+    if (batch->queue != NULL) {
+        batch->ds = ds;
+    } else {
+        sr_session_switch_ds(batch->session, ds);
+    }
+    return rc;
+}
+
+static const char *diff_operation(const struct lyd_node *node)
+{
+    struct lyd_meta *meta = lyd_find_meta(node->meta, NULL, "yang:operation");
+
+    return meta != NULL ? lyd_get_meta_value(meta) : NULL;
+}
+
+/* Sets the nodes of the subtree 'top' that have nothing but keys below them,
+ * which creates the ones above as well. */
+static void reconcile_create(write_batch_t *batch, const struct lyd_node *top)
+{
+    struct lyd_node *elem;
+    char *path;
+
+    LYD_TREE_DFS_BEGIN(top, elem) {
+        if (!lysc_is_key(elem->schema) && lyd_child_no_keys(elem) == NULL) {
+            path = lyd_path(elem, LYD_PATH_STD, NULL, 0);
+            if (elem->schema->nodetype & LYD_NODE_TERM) {
+                write_batch_set_str(batch, path, lyd_get_value(elem));
+            } else {
+                write_batch_set(batch, path, NULL);
+            }
+            free(path);
+        }
+        LYD_TREE_DFS_END(top, elem);
+    }
+}
+
+/* Turns the siblings 'diff' of a libyang diff into edits of the batch.  A
+ * node the diff only descends into is "none", and the keys of such a list
+ * carry no operation. */
+static void reconcile_diff(write_batch_t *batch, const struct lyd_node *diff)
+{
+    const struct lyd_node *node;
+    const char *op;
+    char *path;
+
+    LY_LIST_FOR(diff, node) {
+        op = diff_operation(node);
+        if (op == NULL) {
+            continue;
+        } else if (strcmp(op, "none") == 0) {
+            reconcile_diff(batch, lyd_child(node));
+        } else if (strcmp(op, "create") == 0) {
+            reconcile_create(batch, node);
+        } else {
+            /* A subtree that is not wanted, or a leaf of another value. */
+            path = lyd_path(node, LYD_PATH_STD, NULL, 0);
+            if (strcmp(op, "delete") == 0) {
+                write_batch_delete(batch, path);
+            } else {
+                write_batch_set_str(batch, path, lyd_get_value(node));
+            }
+            free(path);
+        }
+    }
+}
+
+/* Compares the content a reconcile wants with the owned subtrees of the
+ * running datastore and edits the difference, which is left pending. */
+static void reconcile(write_batch_t *batch)
+{
+    const char *const *owned = batch->owned;
+    struct ds xpath = DS_EMPTY_INITIALIZER;
+    struct lyd_node *diff = NULL;
+    const struct lyd_node *node;
+    sr_data_t *data = NULL;
+    int rc;
+
+    /* From here on the edits go to the session. */
+    batch->owned = NULL;
+
+    for (; *owned != NULL; owned++) {
+        ds_put_format(&xpath, "%s%s", xpath.length ? " | " : "", *owned);
+    }
+
+    rc = sr_get_data(batch->session, ds_cstr(&xpath), 0, 0, SR_OPER_DEFAULT, &data);
+    if (rc != SR_ERR_OK) {
+        log_error("Get %s failed: %s", ds_cstr(&xpath), sr_strerror(rc));
+        batch->errors++;
+        goto write_all;
+    }
+
+    if (lyd_diff_siblings(data != NULL ? data->tree : NULL, batch->desired, 0,
+                          &diff) != LY_SUCCESS) {
+        log_error("Compare %s with running failed: %s", batch->name,
+                  ly_errmsg(batch->ly_ctx));
+        batch->errors++;
+        goto write_all;
+    }
+
+    reconcile_diff(batch, diff);
+    goto cleanup;
+
+write_all:
+    /* The callers take what they set as written, so without a difference
+     * all of it is set; only what is no longer wanted stays. */
+    LY_LIST_FOR(batch->desired, node) {
+        reconcile_create(batch, node);
+    }
+
+cleanup:
+    lyd_free_all(diff);
+    sr_release_data(data);
+    lyd_free_all(batch->desired);
+    batch->desired = NULL;
+    sr_release_context(sr_session_get_connection(batch->session));
+    batch->ly_ctx = NULL;
+    ds_destroy(&xpath);
+}
+
+void write_batch_end(write_batch_t *batch)
+{
+    if (batch->owned != NULL) {
+        reconcile(batch);
+    }
+    write_batch_flush(batch);
+
+    if (batch->queue != NULL) {
+        log_debug("Write cycle %s: %u edits queued", batch->name, batch->edits);
+        return;
+    }
+
+    log_info("Write cycle %s: %u edits in %u commits, %"PRIu64" us committing, "
+             "%"PRIu64" us total, %u errors",
+             batch->name, batch->edits, batch->commits, batch->commit_us,
+             get_monotonic_us() - batch->start_us, batch->errors);
+}
@@ -0,0 +1,424 @@
+#include "sampler.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/route/rtnl.h>
+
+#include "hash.h"
+#include "hmap.h"
+#include "log.h"
+#include "oper_tree.h"
+#include "shash.h"
+#include "util.h"
+
+#define RING_MASK (SAMPLER_RING_SIZE - 1)
+
+/* Samples a reader does not look at, so the writer can go on while a reader
+ * walks the ring.  A reader that still read an overwritten sample retries. */
+#define RING_SLACK 64
+#define READ_RETRIES 3
+
+#define NSEC_PER_SEC 1000000000ul
+
+struct sample {
+    uint64_t time_ns;
+    uint64_t counters[IF_COUNTER_MAX];
+};
+
+/* A sequence lock per slot: 'seq' is 2 * n + 1 while the n-th sample ever
+ * written is written into the slot, 2 * n + 2 once it is complete. */
+struct ring_slot {
+    _Atomic uint64_t seq;
+    struct sample sample;
+};
+
+struct port_ring {
+    struct hmap_node node;          /* In 'by_index'. */
+    char *name;
+    int ifindex;
+    _Atomic uint64_t head;          /* Number of samples ever written. */
+    struct ring_slot slots[SAMPLER_RING_SIZE];
+};
+
+static unsigned int period_ms = SAMPLER_DEFAULT_PERIOD_MS;
+
+static struct hmap by_index = HMAP_INITIALIZER(&by_index);
+static struct shash by_name = SHASH_INITIALIZER(&by_name);
+
+static struct nl_sock *sk = NULL;
+static pthread_t thread;
+static volatile bool running = false;
+
+void sampler_set_period(unsigned int period)
+{
+    period_ms = period;
+}
+
+static struct port_ring *find_port_by_index(int ifindex)
+{
+    struct port_ring *port;
+
+    HMAP_FOR_EACH_WITH_HASH (port, node, hash_int(ifindex, 0), &by_index) {
+        if (port->ifindex == ifindex) {
+            return port;
+        }
+    }
+
+    return NULL;
+}
+
+static void ring_push(struct port_ring *port, uint64_t time_ns,
+                      const struct rtnl_link_stats64 *stats)
+{
+    uint64_t head = atomic_load_explicit(&port->head, memory_order_relaxed);
+    struct ring_slot *slot = &port->slots[head & RING_MASK];
+    struct sample *sample = &slot->sample;
+
+    /* The fence keeps the sample from being written before a reader of
+     * the old one can see the slot changing. */
+    atomic_store_explicit(&slot->seq, 2 * head + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    sample->time_ns = time_ns;
+    sample->counters[IF_COUNTER_IN_OCTETS] = stats->rx_bytes;
+    sample->counters[IF_COUNTER_IN_UNICAST_PKTS] = stats->rx_packets;
+    sample->counters[IF_COUNTER_IN_ERRORS] = stats->rx_errors;
+    sample->counters[IF_COUNTER_IN_DISCARDS] = stats->rx_dropped;
+    sample->counters[IF_COUNTER_OUT_OCTETS] = stats->tx_bytes;
+    sample->counters[IF_COUNTER_OUT_UNICAST_PKTS] = stats->tx_packets;
+    sample->counters[IF_COUNTER_OUT_ERRORS] = stats->tx_errors;
+    sample->counters[IF_COUNTER_OUT_DISCARDS] = stats->tx_dropped;
+
+    /* Publishes the sample to readers. */
+    atomic_store_explicit(&slot->seq, 2 * head + 2, memory_order_release);
+    atomic_store_explicit(&port->head, head + 1, memory_order_release);
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Parses one RTM_NEWLINK of the dump in place, without building a libnl
+ * object for it. */
+static int sample_cb(struct nl_msg *msg, void *arg)
+{
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+    struct nlattr *tb[IFLA_MAX + 1];
+    struct ifinfomsg *ifi;
+    struct port_ring *port;
+    struct rtnl_link_stats64 stats;
+
+    if (hdr->nlmsg_type != RTM_NEWLINK ||
+        nlmsg_parse(hdr, sizeof(*ifi), tb, IFLA_MAX, NULL) < 0 ||
+        tb[IFLA_STATS64] == NULL)
+    {
+        return NL_OK;
+    }
+
+    ifi = nlmsg_data(hdr);
+    port = find_port_by_index(ifi->ifi_index);
+    if (port == NULL) {
+        return NL_OK;
+    }
+
+    /* The attribute is not necessarily 8-byte aligned. */
+    memcpy(&stats, nla_data(tb[IFLA_STATS64]),
+           MIN(sizeof(stats), (size_t)nla_len(tb[IFLA_STATS64])));
+    ring_push(port, *(uint64_t*)arg, &stats);
+
+    return NL_OK;
+}
+
+static void sample_all()
+{
+    uint64_t time_ns = now_ns();
+    int rc;
+
+    nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, sample_cb, &time_ns);
+
+    rc = nl_rtgen_request(sk, RTM_GETLINK, AF_UNSPEC, NLM_F_DUMP);
+    if (rc < 0) {
+        log_error("Request link counters failed: %s", nl_geterror(rc));
+        return;
+    }
+
+    rc = nl_recvmsgs_default(sk);
+    if (rc < 0) {
+        log_error("Receive link counters failed: %s", nl_geterror(rc));
+    }
+}
+
+static void timespec_add_ms(struct timespec *ts, unsigned int ms)
+{
+    ts->tv_nsec += (long)(ms % 1000) * 1000000;
+    ts->tv_sec += ms / 1000 + ts->tv_nsec / NSEC_PER_SEC;
+    ts->tv_nsec %= NSEC_PER_SEC;
+}
+
+static void *sampler_main(void *arg)
+{
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (running) {
+        sample_all();
+
+        /* Absolute deadlines keep the period from drifting by the time a
+         * dump takes. */
+        timespec_add_ms(&next, period_ms);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+            continue;
+        }
+    }
+
+    return NULL;
+}
+
+static void destroy_ports()
+{
+    struct shash_node *node, *next;
+    struct port_ring *port;
+
+    SHASH_FOR_EACH_SAFE (node, next, &by_name) {
+        port = node->data;
+        hmap_remove(&by_index, &port->node);
+        free(port->name);
+        free(port);
+    }
+    shash_clear(&by_name);
+}
+
+int sampler_start(const struct sset *ports)
+{
+    struct port_ring *port;
+    const char *name;
+    int rc;
+
+    if (period_ms == 0) {
+        log_info("Counter sampler is disabled");
+        return 0;
+    }
+
+    SSET_FOR_EACH (name, ports) {
+        int ifindex = if_nametoindex(name);
+
+        if (ifindex == 0) {
+            log_warn("Interface-%s has no index, it is not sampled", name);
+            continue;
+        }
+
+        port = xmalloc(sizeof(*port));
+        port->name = strdup(name);
+        port->ifindex = ifindex;
+        atomic_init(&port->head, 0);
+        for (int i = 0; i < SAMPLER_RING_SIZE; i++) {
+            atomic_init(&port->slots[i].seq, 0);
+        }
+        hmap_insert(&by_index, &port->node, hash_int(ifindex, 0));
+        shash_add(&by_name, name, port);
+    }
+
+    sk = nl_socket_alloc();
+    if (sk == NULL) {
+        log_error("Allocate nl socket failed");
+        goto error;
+    }
+
+    rc = nl_connect(sk, NETLINK_ROUTE);
+    if (rc != 0) {
+        log_error("Connect to nl failed: %s", nl_geterror(rc));
+        goto error;
+    }
+
+    running = true;
+    if (pthread_create(&thread, NULL, sampler_main, NULL) != 0) {
+        log_error("Create counter sampler thread failed");
+        running = false;
+        goto error;
+    }
+
+    log_info("Sample counters of %lu ports every %u ms",
+             (unsigned long)shash_count(&by_name), period_ms);
+    return 0;
+
+error:
+    if (sk != NULL) {
+        nl_socket_free(sk);
+        sk = NULL;
+    }
+    destroy_ports();
+    return -1;
+}
+
+void sampler_stop()
+{
+    if (!running) {
+        return;
+    }
+
+    running = false;
+    pthread_join(thread, NULL);
+
+    nl_close(sk);
+    nl_socket_free(sk);
+    sk = NULL;
+
+    destroy_ports();
+}
+
+static uint64_t rate(uint64_t from, uint64_t to, uint64_t ns, uint64_t scale)
+{
+    /* A counter that went backwards was reset, there is no rate for it. */
+    if (to < from || ns == 0) {
+        return 0;
+    }
+
+    /* The byte delta of a second at line rate times 8 and NSEC_PER_SEC no
+     * longer fits in 64 bits. */
+    return (unsigned __int128)(to - from) * scale * NSEC_PER_SEC / ns;
+}
+
+static void peak(uint64_t *peak, uint64_t value)
+{
+    if (value > *peak) {
+        *peak = value;
+    }
+}
+
+/* Copies the 'idx'-th sample ever written of 'port' into 'sample'.  Returns
+ * false if its slot was overwritten before or while it was copied. */
+static bool read_sample(const struct port_ring *port, uint64_t idx,
+                        struct sample *sample)
+{
+    const struct ring_slot *slot = &port->slots[idx & RING_MASK];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq != 2 * idx + 2) {
+        return false;
+    }
+
+    memcpy(sample, &slot->sample, sizeof(*sample));
+
+    /* Orders the copy before the second look at the sequence. */
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq;
+}
+
+/* Walks the newest samples of 'port' into 'rates'.  Returns false if the
+ * writer overwrote a sample while it was read. */
+static bool read_rates(const struct port_ring *port, uint64_t head,
+                       struct port_rates *rates)
+{
+    struct sample newest, cur, prev;
+    uint64_t avg_samples, n, ns;
+
+    n = MIN(head, SAMPLER_RING_SIZE - RING_SLACK);
+    avg_samples = MIN(n - 1, MAX(1000 / period_ms, 1));
+
+    memset(rates, 0, sizeof(*rates));
+    rates->period_ms = period_ms;
+    rates->samples = n;
+
+    if (!read_sample(port, head - 1, &newest)) {
+        return false;
+    }
+
+    cur = newest;
+    for (uint64_t i = 1; i < n; i++) {
+        if (!read_sample(port, head - 1 - i, &prev)) {
+            return false;
+        }
+        ns = cur.time_ns - prev.time_ns;
+
+        peak(&rates->in_peak_bps, rate(prev.counters[IF_COUNTER_IN_OCTETS],
+                                       cur.counters[IF_COUNTER_IN_OCTETS], ns, 8));
+        peak(&rates->in_peak_pps, rate(prev.counters[IF_COUNTER_IN_UNICAST_PKTS],
+                                       cur.counters[IF_COUNTER_IN_UNICAST_PKTS], ns, 1));
+        peak(&rates->out_peak_bps, rate(prev.counters[IF_COUNTER_OUT_OCTETS],
+                                        cur.counters[IF_COUNTER_OUT_OCTETS], ns, 8));
+        peak(&rates->out_peak_pps, rate(prev.counters[IF_COUNTER_OUT_UNICAST_PKTS],
+                                        cur.counters[IF_COUNTER_OUT_UNICAST_PKTS], ns, 1));
+
+        if (i == avg_samples) {
+            ns = newest.time_ns - prev.time_ns;
+            rates->in_bps = rate(prev.counters[IF_COUNTER_IN_OCTETS],
+                                 newest.counters[IF_COUNTER_IN_OCTETS], ns, 8);
+            rates->in_pps = rate(prev.counters[IF_COUNTER_IN_UNICAST_PKTS],
+                                 newest.counters[IF_COUNTER_IN_UNICAST_PKTS], ns, 1);
+            rates->out_bps = rate(prev.counters[IF_COUNTER_OUT_OCTETS],
+                                  newest.counters[IF_COUNTER_OUT_OCTETS], ns, 8);
+            rates->out_pps = rate(prev.counters[IF_COUNTER_OUT_UNICAST_PKTS],
+                                  newest.counters[IF_COUNTER_OUT_UNICAST_PKTS], ns, 1);
+        }
+
+        cur = prev;
+    }
+
+    return true;
+}
+
+bool sampler_get_rates(const char *name, struct port_rates *rates)
+{
+    struct port_ring *port;
+    uint64_t head;
+
+    port = shash_find_data(&by_name, name);
+    if (port == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < READ_RETRIES; i++) {
+        head = atomic_load_explicit(&port->head, memory_order_acquire);
+        if (head < 2) {
+            return false;
+        }
+
+        if (read_rates(port, head, rates)) {
+            return true;
+        }
+    }
+
+    log_warn("Counter samples of port-%s changed while read", name);
+    return false;
+}
+
+bool sampler_get_counters(const char *name, uint64_t *counters)
+{
+    const struct port_ring *port;
+    struct sample sample;
+    uint64_t head;
+
+    port = shash_find_data(&by_name, name);
+    if (port == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < READ_RETRIES; i++) {
+        head = atomic_load_explicit(&port->head, memory_order_acquire);
+        if (head == 0) {
+            return false;
+        }
+
+        if (read_sample(port, head - 1, &sample)) {
+            memcpy(counters, sample.counters, sizeof(sample.counters));
+            return true;
+        }
+    }
+
+    log_warn("Counter samples of port-%s changed while read", name);
+    return false;
+}
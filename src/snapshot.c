@@ -0,0 +1,69 @@
+#include "snapshot.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/* How long a writer sleeps between looks at the readers it waits for. */
+#define DRAIN_POLL_NS 50000
+
+static pthread_mutex_t writer = PTHREAD_MUTEX_INITIALIZER;
+
+/* The low bit of the epoch selects the half that new read sections are
+ * counted in.  All accesses are sequentially consistent: a reader that is
+ * counted after a writer looked at its half is ordered after the pointer
+ * swap, and so sees the new snapshot. */
+static _Atomic unsigned int epoch = 0;
+static _Atomic unsigned long readers[2] = {0, 0};
+
+unsigned int snapshot_read_lock()
+{
+    unsigned int idx = atomic_load(&epoch) & 1;
+
+    atomic_fetch_add(&readers[idx], 1);
+    return idx;
+}
+
+void snapshot_read_unlock(unsigned int idx)
+{
+    atomic_fetch_sub(&readers[idx], 1);
+}
+
+const void *snapshot_get(struct snapshot_slot *slot)
+{
+    return atomic_load(&slot->current);
+}
+
+/* Waits until every read section entered before the call is left.
+ *
+ * A reader may have taken the epoch before the previous flip and be counted
+ * in the half that is current again, so both halves are flipped and drained
+ * in turn. */
+static void synchronize()
+{
+    struct timespec poll = { 0, DRAIN_POLL_NS };
+    unsigned int idx;
+
+    pthread_mutex_lock(&writer);
+    for (int i = 0; i < 2; i++) {
+        idx = atomic_fetch_add(&epoch, 1) & 1;
+        while (atomic_load(&readers[idx]) != 0) {
+            nanosleep(&poll, NULL);
+        }
+    }
+    pthread_mutex_unlock(&writer);
+}
+
+void snapshot_publish(struct snapshot_slot *slot, void *snapshot)
+{
+    void *old = atomic_exchange(&slot->current, snapshot);
+
+    if (old != NULL) {
+        synchronize();
+        slot->destroy(old);
+    }
+}
+
+void snapshot_slot_clear(struct snapshot_slot *slot)
+{
+    snapshot_publish(slot, NULL);
+}
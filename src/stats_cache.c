@@ -0,0 +1,105 @@
+#include "stats_cache.h"
+
+#include <stdlib.h>
+
+#include <netlink/netlink.h>
+#include <netlink/route/link.h>
+
+#include "collector.h"
+#include "link_cache.h"
+#include "log.h"
+#include "oper_tree.h"
+#include "snapshot.h"
+#include "util.h"
+#include "utils.h"
+
+static const rtnl_link_stat_id_t stat_ids[IF_COUNTER_MAX] = {
+    [IF_COUNTER_IN_OCTETS] = RTNL_LINK_RX_BYTES,
+    [IF_COUNTER_IN_UNICAST_PKTS] = RTNL_LINK_RX_PACKETS,
+    [IF_COUNTER_IN_ERRORS] = RTNL_LINK_RX_ERRORS,
+    [IF_COUNTER_IN_DISCARDS] = RTNL_LINK_RX_DROPPED,
+    [IF_COUNTER_OUT_OCTETS] = RTNL_LINK_TX_BYTES,
+    [IF_COUNTER_OUT_UNICAST_PKTS] = RTNL_LINK_TX_PACKETS,
+    [IF_COUNTER_OUT_ERRORS] = RTNL_LINK_TX_ERRORS,
+    [IF_COUNTER_OUT_DISCARDS] = RTNL_LINK_TX_DROPPED,
+};
+
+static void snapshot_destroy(void *snapshot_)
+{
+    struct stats_snapshot *snapshot = snapshot_;
+
+    shash_destroy_free_data(&snapshot->counters);
+    free(snapshot);
+}
+
+static struct snapshot_slot slot = SNAPSHOT_SLOT_INITIALIZER(snapshot_destroy);
+
+static void add_link_counters(struct nl_object *obj, void *arg)
+{
+    struct stats_snapshot *snapshot = (struct stats_snapshot*)arg;
+    struct rtnl_link *link = (struct rtnl_link*)obj;
+    const char *name = rtnl_link_get_name(link);
+    uint64_t *counters;
+
+    if (name == NULL) {
+        return;
+    }
+
+    counters = xmalloc(IF_COUNTER_MAX * sizeof(uint64_t));
+    for (int i = 0; i < IF_COUNTER_MAX; i++) {
+        counters[i] = rtnl_link_get_stat(link, stat_ids[i]);
+    }
+    shash_replace(&snapshot->counters, name, counters);
+}
+
+/* Dumps the counters of every link and publishes them. */
+static int dump(void *aux)
+{
+    struct stats_snapshot *snapshot;
+    struct nl_cache *links;
+
+    links = link_cache_dump();
+    if (links == NULL) {
+        log_error("Dump interface counters failed");
+        return -1;
+    }
+
+    snapshot = xmalloc(sizeof(*snapshot));
+    shash_init(&snapshot->counters);
+    nl_cache_foreach(links, add_link_counters, snapshot);
+    snapshot->taken_us = get_monotonic_us();
+    nl_cache_free(links);
+
+    snapshot_publish(&slot, snapshot);
+    return 0;
+}
+
+static struct collector collector =
+    COLLECTOR_INITIALIZER("Interface counters", dump, STATS_CACHE_DEFAULT_PERIOD_MS);
+
+void stats_cache_set_period(unsigned int period_ms)
+{
+    collector_set_period(&collector, period_ms);
+}
+
+void stats_cache_collect()
+{
+    collector_add(&collector, NULL);
+}
+
+const struct stats_snapshot *stats_cache_current()
+{
+    collector_read(&collector);
+    return snapshot_get(&slot);
+}
+
+const uint64_t *stats_snapshot_find(const struct stats_snapshot *snapshot,
+                                    const char *name)
+{
+    return shash_find_data(&snapshot->counters, name);
+}
+
+void stats_cache_destroy()
+{
+    snapshot_slot_clear(&slot);
+}
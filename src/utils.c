@@ -5,6 +5,7 @@
 #include <time.h>
 
 #include <netinet/in.h>
+#include <sysrepo/xpath.h>
 
 #include "log.h"
 
@@ -135,4 +136,29 @@ uint64_t get_age(char *age_str)
     }
 
     return (uint64_t)rawtime - age_str2num(age_str);
-}
\ No newline at end of file
+}
+
+/* Returns a copy of the value of 'key' in the first predicate of 'list' in
+ * 'xpath', for example "swp3" for list "interface" and key "name" in
+ * "/ietf-interfaces:interfaces/interface[name='swp3']/statistics".  Returns
+ * NULL if the list is not restricted by that key, the caller then has to
+ * provide every instance. */
+char *get_xpath_key(const char *xpath, const char *list, const char *key)
+{
+    sr_xpath_ctx_t state = {0};
+    char *copy, *value, *res = NULL;
+
+    if (xpath == NULL || strchr(xpath, '[') == NULL) {
+        return NULL;
+    }
+
+    copy = strdup(xpath);
+    value = sr_xpath_key_value(copy, list, key, &state);
+    if (value != NULL) {
+        res = strdup(value);
+    }
+
+    sr_xpath_recover(&state);
+    free(copy);
+    return res;
+}
@@ -0,0 +1,153 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "log.h"
+
+#define CACHE_LINE_SIZE 64
+
+/* The items [next, end) not taken yet.  Its owner and the thieves all take
+ * from 'next'; it runs past 'end' by at most one per thread. */
+struct shard {
+    _Alignas(CACHE_LINE_SIZE) _Atomic size_t next;
+    size_t end;
+};
+
+static struct shard shards[WORKER_POOL_MAX_WORKERS];
+static pthread_t threads[WORKER_POOL_MAX_WORKERS - 1];
+static unsigned int n_threads = 0;
+
+/* Taken for a whole run, so runs from different threads do not mix. */
+static pthread_mutex_t run_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The run in progress, set under 'mutex' before 'generation' moves. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t started = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+static uint64_t generation = 0;
+static uint64_t init_generation = 0;     /* At worker_pool_init(). */
+static unsigned int n_busy = 0;
+static bool exiting = false;
+static worker_pool_cb run_cb;
+static void *run_aux;
+
+/* Empties the own shard of thread 'self' first, then steals what is left in
+ * the others. */
+static void work(unsigned int self)
+{
+    unsigned int n_shards = n_threads + 1;
+    struct shard *shard;
+    size_t idx;
+
+    for (unsigned int i = 0; i < n_shards; i++) {
+        shard = &shards[(self + i) % n_shards];
+        while ((idx = atomic_fetch_add_explicit(&shard->next, 1, memory_order_relaxed))
+               < shard->end) {
+            run_cb(idx, run_aux);
+        }
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    unsigned int self = (unsigned int)(uintptr_t)arg;
+    uint64_t seen = init_generation;
+
+    pthread_mutex_lock(&mutex);
+    for (;;) {
+        while (!exiting && generation == seen) {
+            pthread_cond_wait(&started, &mutex);
+        }
+        if (exiting) {
+            break;
+        }
+        seen = generation;
+        pthread_mutex_unlock(&mutex);
+
+        work(self);
+
+        pthread_mutex_lock(&mutex);
+        if (--n_busy == 0) {
+            pthread_cond_signal(&finished);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return NULL;
+}
+
+int worker_pool_init(unsigned int n_workers)
+{
+    if (n_workers > WORKER_POOL_MAX_WORKERS - 1) {
+        n_workers = WORKER_POOL_MAX_WORKERS - 1;
+    }
+
+    exiting = false;
+    init_generation = generation;
+    for (n_threads = 0; n_threads < n_workers; n_threads++) {
+        if (pthread_create(&threads[n_threads], NULL, worker_main,
+                           (void*)(uintptr_t)(n_threads + 1)) != 0) {
+            log_error("Create worker thread failed");
+            worker_pool_destroy();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void worker_pool_destroy()
+{
+    pthread_mutex_lock(&mutex);
+    exiting = true;
+    pthread_cond_broadcast(&started);
+    pthread_mutex_unlock(&mutex);
+
+    for (unsigned int i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    n_threads = 0;
+}
+
+void worker_pool_run(size_t n_items, worker_pool_cb cb, void *aux)
+{
+    unsigned int n_shards;
+
+    pthread_mutex_lock(&run_mutex);
+
+    /* Waking the workers costs more than one item takes. */
+    if (n_threads == 0 || n_items < 2) {
+        for (size_t i = 0; i < n_items; i++) {
+            cb(i, aux);
+        }
+        goto out;
+    }
+
+    n_shards = n_threads + 1;
+    for (unsigned int i = 0; i < n_shards; i++) {
+        atomic_store_explicit(&shards[i].next, n_items * i / n_shards, memory_order_relaxed);
+        shards[i].end = n_items * (i + 1) / n_shards;
+    }
+
+    pthread_mutex_lock(&mutex);
+    run_cb = cb;
+    run_aux = aux;
+    n_busy = n_threads;
+    generation++;
+    pthread_cond_broadcast(&started);
+    pthread_mutex_unlock(&mutex);
+
+    work(0);
+
+    pthread_mutex_lock(&mutex);
+    while (n_busy != 0) {
+        pthread_cond_wait(&finished, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+out:
+    pthread_mutex_unlock(&run_mutex);
+}